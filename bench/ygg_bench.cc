@@ -0,0 +1,558 @@
+/*
+ * Benchmark harness for the friends-of-friends engines on synthetic cosmological workloads.
+ *
+ * Build from the repository root with, e.g.
+ *   g++ -O3 -std=c++17 -fopenmp bench/ygg_bench.cc pyfof/engine_select.cc pyfof/fof.cc pyfof/fof_brute.cc pyfof/fof_grid.cc \
+ *       pyfof/groups.cc -o ygg-bench
+ *
+ * Every (workload, N, D, linking length, threads) point of the sweep is run with every engine, and the
+ * groups are compared across engines. Results are written as JSON; the exit status is non-zero when
+ * two engines disagree.
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "../pyfof/engine_select.hpp"
+#include "../pyfof/stats.hpp"
+
+// Typedef for convenience
+typedef std::size_t size_t;
+
+/// Calls to the global operator new of the whole process, to see whether an engine allocates per point or group.
+static std::atomic<std::uint64_t> heap_allocations(0);
+
+void *operator new(size_t size) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+/// Settings of a sweep, filled from the command line.
+struct bench_options {
+    std::vector<std::string> workloads = {"uniform", "blobs", "soneira_peebles", "lattice"};
+    std::vector<std::string> engines = {"kdtree", "grid", "rtree", "brute", "auto"};
+    std::vector<size_t> sizes = {10000, 100000};
+    std::vector<size_t> dims = {3};
+    std::vector<double> linking_lengths = {0.2};   ///< In units of the mean interparticle separation.
+    std::vector<int> threads = {1};
+    size_t brute_max = 20000;                      ///< Largest N run with the O(N^2) engine.
+    size_t repeat = 1;                             ///< Runs per point; the fastest is reported.
+    unsigned seed = 42;
+    std::string output;                            ///< JSON file, standard output if empty.
+    bool calibrate = false;                        ///< Write the engine calibration table instead of JSON.
+};
+
+/// Result of one engine on one point of the sweep.
+struct bench_run {
+    std::string workload, engine;
+    size_t npts, dim;
+    double linking_length;
+    int threads;
+    double seconds;
+    size_t ngroups;
+    std::uint64_t peak_rss_kb;        ///< Peak resident set size during the run.
+    std::uint64_t rss_growth_kb;      ///< Growth of the resident set over its size before the run.
+    std::uint64_t heap_allocations;   ///< Calls to operator new during the fastest run.
+    fof_stats stats;
+    double speedup = 1.;
+    double efficiency = 1.;
+    bool matches_reference = true;
+};
+
+namespace {
+
+// ---------------------------------------------------------------------------------------------------------------
+// Workloads, all in the periodic unit box
+
+/// Uniform random points: the unclustered limit, every group is tiny.
+std::vector<double> uniform_points(size_t n, size_t dim, std::mt19937_64 &rng) {
+    std::uniform_real_distribution<double> u(0., 1.);
+    std::vector<double> x(n * dim);
+    for (auto &v : x) v = u(rng);
+    return x;
+}
+
+/// Gaussian blobs on a 20% uniform background, a crude stand-in for haloes in a field.
+std::vector<double> blob_points(size_t n, size_t dim, std::mt19937_64 &rng) {
+    std::uniform_real_distribution<double> u(0., 1.);
+    std::normal_distribution<double> g(0., 0.01);
+    const size_t nblobs = std::max<size_t>(1, n / 2000);
+    std::vector<double> centres(nblobs * dim);
+    for (auto &c : centres) c = u(rng);
+
+    std::vector<double> x(n * dim);
+    for (size_t i = 0; i < n; ++i) {
+        const bool background = u(rng) < 0.2;
+        const size_t b = static_cast<size_t>(u(rng) * nblobs) % nblobs;
+        for (size_t d = 0; d < dim; ++d) {
+            const double v = background ? u(rng) : centres[b * dim + d] + g(rng);
+            x[i * dim + d] = v - std::floor(v);
+        }
+    }
+    return x;
+}
+
+/**
+ * @brief Soneira & Peebles (1978) hierarchical clustering.
+ *
+ * Each top-level sphere of radius R holds `eta` spheres of radius R / lambda placed uniformly inside it,
+ * recursively for `levels` levels; the centres of the last level are the points. With eta = 4 and
+ * lambda = 1.9 in 3-D the two-point correlation follows the observed xi(r) ~ r^-1.8.
+ */
+std::vector<double> soneira_peebles_points(size_t n, size_t dim, std::mt19937_64 &rng) {
+    const size_t eta = 4, levels = 6;
+    const double lambda = 1.9, radius0 = 0.1;
+    std::uniform_real_distribution<double> u(0., 1.);
+    std::normal_distribution<double> g(0., 1.);
+
+    // Uniform point in the unit ball, by rejection-free direction and radius sampling
+    auto in_ball = [&](double *out) {
+        double norm = 0.;
+        for (size_t d = 0; d < dim; ++d) {
+            out[d] = g(rng);
+            norm += out[d] * out[d];
+        }
+        const double r = std::pow(u(rng), 1. / dim) / std::sqrt(norm);
+        for (size_t d = 0; d < dim; ++d) out[d] *= r;
+    };
+
+    std::vector<double> x;
+    x.reserve(n * dim);
+    std::vector<double> level(dim), next;
+    while (x.size() < n * dim) {
+        for (size_t d = 0; d < dim; ++d) level[d] = u(rng);
+        double radius = radius0;
+        std::vector<double> centres = level;
+        for (size_t l = 0; l < levels; ++l) {
+            next.assign(centres.size() * eta, 0.);
+            radius /= lambda;
+            for (size_t c = 0; c < centres.size() / dim; ++c) {
+                for (size_t k = 0; k < eta; ++k) {
+                    double *p = &next[(c * eta + k) * dim];
+                    in_ball(p);
+                    for (size_t d = 0; d < dim; ++d) p[d] = centres[c * dim + d] + radius * lambda * p[d];
+                }
+            }
+            centres.swap(next);
+        }
+        for (size_t k = 0; k < centres.size() && x.size() < n * dim; ++k) {
+            x.push_back(centres[k] - std::floor(centres[k]));
+        }
+    }
+    return x;
+}
+
+/// Regular lattice with Gaussian displacements of 20% of the spacing, like early-time N-body initial conditions.
+std::vector<double> lattice_points(size_t n, size_t dim, std::mt19937_64 &rng) {
+    size_t side = static_cast<size_t>(std::ceil(std::pow(static_cast<double>(n), 1. / dim)));
+    const double spacing = 1. / side;
+    std::normal_distribution<double> g(0., 0.2 * spacing);
+    std::vector<double> x(n * dim);
+    for (size_t i = 0; i < n; ++i) {
+        size_t cell = i;
+        for (size_t d = 0; d < dim; ++d) {
+            const double v = (cell % side + 0.5) * spacing + g(rng);
+            x[i * dim + d] = v - std::floor(v);
+            cell /= side;
+        }
+    }
+    return x;
+}
+
+std::vector<double> make_workload(const std::string &name, size_t n, size_t dim, unsigned seed) {
+    std::mt19937_64 rng(seed);
+    if (name == "uniform") return uniform_points(n, dim, rng);
+    if (name == "blobs") return blob_points(n, dim, rng);
+    if (name == "soneira_peebles") return soneira_peebles_points(n, dim, rng);
+    if (name == "lattice") return lattice_points(n, dim, rng);
+    throw std::invalid_argument("unknown workload " + name);
+}
+
+// ---------------------------------------------------------------------------------------------------------------
+// Engines
+
+/// Label every point with the smallest index of its group, a representation every engine agrees on.
+std::vector<size_t> canonical_labels(const group_catalog &catalog, size_t npts) {
+    std::vector<size_t> labels(npts, npts);
+    for (size_t g = 0; g < catalog.ngroups(); ++g) {
+        size_t first = npts;
+        for (size_t k = catalog.offsets[g]; k < catalog.offsets[g + 1]; ++k) first = std::min(first, catalog.members[k]);
+        for (size_t k = catalog.offsets[g]; k < catalog.offsets[g + 1]; ++k) labels[catalog.members[k]] = first;
+    }
+    return labels;
+}
+
+/// Largest dimension each engine of the harness handles.
+size_t max_dimension(const std::string &engine) {
+    if (engine == "grid") return 3;
+    if (engine == "rtree") return 4;
+    if (engine == "kdtree") return 6;
+    return static_cast<size_t>(-1);
+}
+
+/**
+ * @brief Run one engine, "auto" choosing one from the calibration table.
+ *
+ * @return bool False if the engine does not support this configuration.
+ */
+bool run_engine(const std::string &engine, size_t leaf_size, std::vector<double> &x, size_t n, size_t dim, double b,
+                std::vector<size_t> &labels, size_t &ngroups, fof_stats &stats) {
+    engine_config config = {engine, leaf_size};
+    if (engine == "auto") {
+        config = select_engine(sample_data_shape(x.data(), n, dim, b, 1.));
+    }
+    if (dim > max_dimension(config.engine)) {
+        return false;
+    }
+    const auto catalog = friends_of_friends_engine(config, x.data(), n, dim, b, 1., &stats);
+    ngroups = catalog.ngroups();
+    labels = canonical_labels(catalog, n);
+    return true;
+}
+
+/**
+ * @brief Time every engine, and the kd-tree with several leaf sizes, on every point of the sweep.
+ *
+ * The fastest configuration of each point and thread count is written, with the shape `select_engine`
+ * will compare against, as the source of pyfof/engine_calibration.hpp.
+ */
+void calibrate(const bench_options &opt, std::ostream &out) {
+    static const size_t leaf_sizes[] = {4, 8, 16, 32, 64};
+
+    std::ostringstream rows, thread_list;
+    for (int threads : opt.threads) {
+        threads = std::max(threads, 1);
+#ifdef _OPENMP
+        omp_set_num_threads(threads);
+#endif
+        thread_list << (thread_list.tellp() > 0 ? "," : "") << threads;
+        for (auto const &workload : opt.workloads) {
+            for (size_t n : opt.sizes) {
+                for (size_t dim : opt.dims) {
+                    std::vector<double> x = make_workload(workload, n, dim, opt.seed);
+                    for (double b : opt.linking_lengths) {
+                        const double b_box = b / std::pow(static_cast<double>(n), 1. / dim);
+                        const data_shape shape = sample_data_shape(x.data(), n, dim, b_box, 1.);
+
+                        engine_config best = {"", 0};
+                        double best_seconds = HUGE_VAL;
+                        for (auto const &engine : opt.engines) {
+                            if (engine == "auto" || (engine == "brute" && n > opt.brute_max)) continue;
+                            const size_t nleaf = engine == "kdtree" ? sizeof(leaf_sizes) / sizeof(leaf_sizes[0]) : 1;
+                            for (size_t l = 0; l < nleaf; ++l) {
+                                const size_t leaf = engine == "kdtree" ? leaf_sizes[l] : 16;
+                                std::vector<size_t> labels;
+                                size_t ngroups;
+                                for (size_t rep = 0; rep < opt.repeat; ++rep) {
+                                    fof_stats stats;
+                                    const auto t0 = std::chrono::steady_clock::now();
+                                    if (!run_engine(engine, leaf, x, n, dim, b_box, labels, ngroups, stats)) break;
+                                    const double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+                                    if (s < best_seconds) {
+                                        best_seconds = s;
+                                        best = {engine, leaf};
+                                    }
+                                }
+                            }
+                        }
+                        if (best.engine.empty()) continue;
+                        std::cerr << threads << " thread(s) " << workload << " n=" << n << " D=" << dim << " b=" << b
+                                  << " neighbours=" << shape.mean_neighbours << ": " << best.engine << " leaf " << best.leaf_size << ", " << best_seconds << " s" << std::endl;
+                        rows << "    {" << threads << ", " << dim << ", " << std::log10(static_cast<double>(n)) << ", "
+                             << std::log10(std::max(0.01, shape.mean_neighbours)) << ", \"" << best.engine << "\", "
+                             << best.leaf_size << "},\n";
+                    }
+                }
+            }
+        }
+    }
+
+    int processors = 1;
+#ifdef _OPENMP
+    processors = omp_get_num_procs();
+#endif
+    out << "#pragma once\n#include <cstdlib>\n\n"
+        << "/**\n * @file engine_calibration.hpp\n * @brief Fastest engine measured per data shape, read by `select_engine`.\n *\n"
+        << " * Generated by `ygg-bench --calibrate` with " << thread_list.str() << " thread(s) on a machine with "
+        << processors << " processor(s);\n * run it again on the target machine, with its thread counts (e.g. `--threads 1,16,64`), "
+        << "to refresh the table.\n * Runs with a thread count more than twice away from every entry do not use the table.\n"
+        << " */\n\n"
+        << "/// Fastest configuration measured for one data shape.\n"
+        << "struct calibration_entry {\n"
+        << "    int nthreads;              ///< OpenMP threads of the measurement.\n"
+        << "    std::size_t ndim;          ///< Dimensionality of the points.\n"
+        << "    double log10_npts;         ///< Decimal logarithm of the number of points.\n"
+        << "    double log10_neighbours;   ///< Decimal logarithm of the mean neighbour count within the linking length.\n"
+        << "    const char *engine;        ///< Fastest engine.\n"
+        << "    std::size_t leaf_size;     ///< Fastest kd-tree leaf size, when the engine is \"kdtree\".\n"
+        << "};\n\n"
+        << "static const calibration_entry ENGINE_CALIBRATION[] = {\n"
+        << rows.str() << "};\n";
+}
+
+// ---------------------------------------------------------------------------------------------------------------
+// Command line and output
+
+template <typename T>
+std::vector<T> parse_list(const std::string &text) {
+    std::vector<T> out;
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        // Accept scientific notation such as 1e6 for integer lists too
+        out.push_back(static_cast<T>(std::strtod(item.c_str(), nullptr)));
+    }
+    return out;
+}
+
+template <>
+std::vector<std::string> parse_list<std::string>(const std::string &text) {
+    std::vector<std::string> out;
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ',')) out.push_back(item);
+    return out;
+}
+
+void print_usage(const char *prog) {
+    std::cerr << "Usage: " << prog << " [options]\n"
+              << "\n"
+              << "Options (lists are comma separated):\n"
+              << "  --workloads LIST   uniform,blobs,soneira_peebles,lattice (all)\n"
+              << "  --engines LIST     kdtree,grid,rtree,brute,auto (all)\n"
+              << "  --n LIST           numbers of points, e.g. 1e4,1e5,1e6 (1e4,1e5)\n"
+              << "  --dims LIST        dimensions, 1 to 6 (3)\n"
+              << "  --b LIST           linking lengths in units of the mean separation (0.2)\n"
+              << "  --threads LIST     OpenMP thread counts (1)\n"
+              << "  --brute-max N      largest N run with the brute-force engine (20000)\n"
+              << "  --repeat N         runs per point, the fastest is kept (1)\n"
+              << "  --seed S           seed of the workloads (42)\n"
+              << "  --output FILE      JSON output file (standard output)\n"
+              << "  --calibrate        time every engine and kd-tree leaf size, and write the fastest per point\n"
+              << "                     as pyfof/engine_calibration.hpp to the output instead of the JSON\n";
+}
+
+int parse_options(int argc, char **argv, bench_options &opt) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            return -1;
+        }
+        if (arg == "--calibrate") {
+            opt.calibrate = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << "\n";
+            return 1;
+        }
+        const std::string v = argv[++i];
+        if (arg == "--workloads") opt.workloads = parse_list<std::string>(v);
+        else if (arg == "--engines") opt.engines = parse_list<std::string>(v);
+        else if (arg == "--n") opt.sizes = parse_list<size_t>(v);
+        else if (arg == "--dims") opt.dims = parse_list<size_t>(v);
+        else if (arg == "--b") opt.linking_lengths = parse_list<double>(v);
+        else if (arg == "--threads") opt.threads = parse_list<int>(v);
+        else if (arg == "--brute-max") opt.brute_max = std::strtoul(v.c_str(), nullptr, 10);
+        else if (arg == "--repeat") opt.repeat = std::max<size_t>(1, std::strtoul(v.c_str(), nullptr, 10));
+        else if (arg == "--seed") opt.seed = static_cast<unsigned>(std::strtoul(v.c_str(), nullptr, 10));
+        else if (arg == "--output") opt.output = v;
+        else {
+            std::cerr << "Unknown option " << arg << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------------------------------------------
+// Memory of a run
+
+/// A field of /proc/self/status in KiB, such as "VmRSS" or "VmHWM"; 0 if it cannot be read.
+std::uint64_t status_kb(const std::string &field) {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, field.size() + 1, field + ":") == 0) {
+            return std::strtoull(line.c_str() + field.size() + 1, nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Reset the peak resident set size of the process to its current size.
+ *
+ * @return bool False if the kernel does not allow it, in which case VmHWM keeps the peak of the
+ *              whole process.
+ */
+bool reset_peak_rss() {
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+    clear_refs.flush();
+    return static_cast<bool>(clear_refs);
+}
+
+void write_json(std::ostream &out, const std::vector<bench_run> &runs, bool all_equal) {
+    int max_threads = 1;
+#ifdef _OPENMP
+    max_threads = omp_get_num_procs();
+#endif
+    out << "{\n  \"processors\": " << max_threads << ",\n  \"all_equal\": " << (all_equal ? "true" : "false")
+        << ",\n  \"runs\": [";
+    for (size_t r = 0; r < runs.size(); ++r) {
+        const bench_run &run = runs[r];
+        out << (r ? ",\n" : "\n") << "    {\"workload\": \"" << run.workload << "\", \"engine\": \"" << run.engine
+            << "\", \"n\": " << run.npts << ", \"dim\": " << run.dim << ", \"b\": " << run.linking_length
+            << ", \"threads\": " << run.threads << ", \"seconds\": " << run.seconds
+            << ", \"particles_per_s\": " << (run.seconds > 0. ? run.npts / run.seconds : 0.)
+            << ", \"speedup\": " << run.speedup << ", \"efficiency\": " << run.efficiency
+            << ", \"ngroups\": " << run.ngroups << ", \"peak_rss_kb\": " << run.peak_rss_kb
+            << ", \"rss_growth_kb\": " << run.rss_growth_kb
+            << ", \"heap_allocations\": " << run.heap_allocations << ", \"engine_allocations\": " << run.stats.allocations
+            << ", \"pairs_tested\": " << run.stats.pairs_tested << ", \"phases\": {";
+        for (size_t p = 0; p < run.stats.phases.size(); ++p) {
+            out << (p ? ", " : "") << "\"" << run.stats.phases[p].name << "\": " << run.stats.phases[p].wall_ns;
+        }
+        out << "}, \"matches_reference\": " << (run.matches_reference ? "true" : "false") << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+} // End of anonymous namespace
+
+int main(int argc, char **argv) {
+    bench_options opt;
+    const int parsed = parse_options(argc, argv, opt);
+    if (parsed != 0) {
+        print_usage(argv[0]);
+        return parsed < 0 ? 0 : 1;
+    }
+
+    for (auto const &engine : opt.engines) {
+        if (engine != "auto" && engine != "brute" && max_dimension(engine) == static_cast<size_t>(-1)) {
+            std::cerr << "Unknown engine " << engine << "\n";
+            return 1;
+        }
+    }
+
+    if (opt.calibrate) {
+        if (opt.output.empty()) {
+            calibrate(opt, std::cout);
+        } else {
+            std::ofstream fout(opt.output);
+            calibrate(opt, fout);
+        }
+        return 0;
+    }
+
+    std::vector<bench_run> runs;
+    bool all_equal = true;
+    bool warned_rss = false;
+    for (auto const &workload : opt.workloads) {
+        for (size_t n : opt.sizes) {
+            for (size_t dim : opt.dims) {
+                std::vector<double> x;
+                try {
+                    x = make_workload(workload, n, dim, opt.seed);
+                } catch (const std::exception &e) {
+                    std::cerr << e.what() << "\n";
+                    return 1;
+                }
+                for (double b : opt.linking_lengths) {
+                    const double b_box = b / std::pow(static_cast<double>(n), 1. / dim);
+                    std::vector<size_t> reference;
+                    for (auto const &engine : opt.engines) {
+                        if (engine == "brute" && n > opt.brute_max) continue;
+                        const size_t first_run = runs.size();
+                        for (int threads : opt.threads) {
+#ifdef _OPENMP
+                            omp_set_num_threads(std::max(threads, 1));
+#endif
+                            bench_run run;
+                            run.workload = workload;
+                            run.engine = engine;
+                            run.npts = n;
+                            run.dim = dim;
+                            run.linking_length = b;
+                            run.threads = threads;
+                            run.seconds = HUGE_VAL;
+
+                            // The peak is reset before every point, so that it is not that of an earlier, larger run
+                            std::vector<size_t> labels;
+                            bool supported = true;
+                            if (!reset_peak_rss() && !warned_rss) {
+                                std::cerr << "Warning: cannot reset the peak RSS; peak_rss_kb and rss_growth_kb "
+                                             "include the earlier runs\n";
+                                warned_rss = true;
+                            }
+                            const std::uint64_t rss0 = status_kb("VmRSS");
+                            for (size_t rep = 0; rep < opt.repeat && supported; ++rep) {
+                                fof_stats stats;
+                                const std::uint64_t allocations0 = heap_allocations.load();
+                                const auto t0 = std::chrono::steady_clock::now();
+                                supported = run_engine(engine, 16, x, n, dim, b_box, labels, run.ngroups, stats);
+                                const double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+                                if (s < run.seconds) {
+                                    run.seconds = s;
+                                    run.stats = stats;
+                                    run.heap_allocations = heap_allocations.load() - allocations0;
+                                }
+                            }
+                            if (!supported) break;
+                            run.peak_rss_kb = std::max(status_kb("VmHWM"), rss0);
+                            run.rss_growth_kb = run.peak_rss_kb - rss0;
+
+                            // The first engine that ran this point is the reference for the others
+                            if (reference.empty()) {
+                                reference = labels;
+                            }
+                            run.matches_reference = labels == reference;
+                            all_equal = all_equal && run.matches_reference;
+
+                            // Scaling relative to the first thread count of the sweep
+                            if (runs.size() > first_run) {
+                                const bench_run &base = runs[first_run];
+                                run.speedup = base.seconds / run.seconds;
+                                run.efficiency = run.speedup * std::max(base.threads, 1) / std::max(threads, 1);
+                            }
+                            std::cerr << workload << " " << engine << " n=" << n << " D=" << dim << " b=" << b
+                                      << " threads=" << threads << ": " << run.seconds << " s"
+                                      << (run.matches_reference ? "" : " MISMATCH") << std::endl;
+                            runs.push_back(run);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    if (opt.output.empty()) {
+        write_json(std::cout, runs, all_equal);
+    } else {
+        std::ofstream fout(opt.output);
+        write_json(fout, runs, all_equal);
+    }
+    return all_equal ? 0 : 2;
+}
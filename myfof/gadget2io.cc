@@ -1,12 +1,15 @@
 /* Routines to read Gadget2 snapshot format */
 #include "gadget2io.hpp"
 
+#include <algorithm>
+#include <cmath>
+
 /* Reads the "file_in" snapshot and stores it on the "header" instance
    of Header. "fin" is a ifstream instance that is leaved open for further
    reading if "close" == false.
 */
 int readHeader(std::string file_in, Header &header, std::ifstream &fin,
-               bool close = false)
+               bool close)
 {
 
   /* Read the Snap Header*/
@@ -125,7 +128,8 @@ void fastforwardNVars(std::ifstream &fin, size_t size, size_t n)
 }
 
 /* Fastforward the fstream "fin" to variable labled "BLOCK".
-   Prints "fin" metadata if myid == 0.
+   Prints "fin" metadata if myid == 0. Stops with "fin" failed if the
+   block is not in the file.
 */
 void fastforwardToBlock(std::ifstream &fin, std::string BLOCK, int myid)
 {
@@ -139,7 +143,8 @@ void fastforwardToBlock(std::ifstream &fin, std::string BLOCK, int myid)
   while (iterate)
   {
 
-    fin >> block;
+    if (!(fin >> block))
+      return;
     for (int i = 0; i < 4; i++)
       blockStringLike[i] = block.name[i];
 
@@ -171,7 +176,10 @@ void readPos(std::ifstream &fin, Header &data, int isnap, points_t &xx, int myid
 
   float num_float1, num_float2, num_float3; // Dummy vars to read x,y, and z
   fastforwardToBlock(fin, "POS ", myid);
- 
+
+  /* Gas particles come first in the block */
+  fastforwardNVars(fin, 3 * sizeof(float), data.npart[0]);
+
   /* Read DM only positions ptype=1 */
   {
     int i = 1;
@@ -196,4 +204,134 @@ void readPos(std::ifstream &fin, Header &data, int isnap, points_t &xx, int myid
       xx[pp].second = pp; // It should be the particle ID!
     }
   }
+
+  /* Leave the stream at the end of the block */
+  size_t after = 0;
+  for (int i = 2; i <= 5; i++)
+    after += data.npart[i];
+  fastforwardNVars(fin, 3 * sizeof(float), after);
+}
+
+/* Reads the dark-matter positions of snapshot fin into the flat vector xx
+   (3 values per particle), normalised by the box size like readPos. The
+   block is read in one go rather than one float at a time; the stream is
+   left at the end of the block.
+*/
+void readPos(std::ifstream &fin, Header &data, first_touch_vector<double> &xx, int myid)
+{
+
+  fastforwardToBlock(fin, "POS ", myid);
+
+  size_t after = 0;
+  for (int i = 2; i <= 5; i++)
+    after += data.npart[i];
+
+  fastforwardNVars(fin, 3 * sizeof(float), data.npart[0]);
+
+  std::vector<float> buffer(3 * size_t(data.npart[1]));
+  fin.read((char *)buffer.data(), buffer.size() * sizeof(float));
+
+  xx.resize(buffer.size());
+#pragma omp parallel for schedule(static)
+  for (long k = 0; k < static_cast<long>(buffer.size()); k++)
+    xx[k] = buffer[k] / data.boxsize;
+
+  fastforwardNVars(fin, 3 * sizeof(float), after);
+}
+
+/* Reads the positions of every particle that is not dark matter (gas,
+   stars, black holes, ...) into xx, normalised by the box size like
+   readPos, and their Gadget types into ptype. The stream must be
+   positioned before the POS block, e.g. freshly opened by readHeader.
+*/
+void readPosBaryons(std::ifstream &fin, Header &data, std::vector<double> &xx, std::vector<int> &ptype, int myid)
+{
+
+  fastforwardToBlock(fin, "POS ", myid);
+
+  size_t nbar = 0;
+  for (int i = 0; i <= 5; i++)
+    if (i != 1)
+      nbar += data.npart[i];
+  xx.resize(3 * nbar);
+  ptype.resize(nbar);
+
+  size_t k = 0;
+  std::vector<float> buffer;
+  for (int i = 0; i <= 5; i++)
+  {
+    if (i == 1)
+    {
+      fastforwardNVars(fin, 3 * sizeof(float), data.npart[i]);
+      continue;
+    }
+    buffer.resize(3 * size_t(data.npart[i]));
+    fin.read((char *)buffer.data(), buffer.size() * sizeof(float));
+    for (int pp = 0; pp < data.npart[i]; pp++, k++)
+    {
+      for (int d = 0; d < 3; d++)
+        xx[3 * k + d] = buffer[3 * pp + d] / data.boxsize;
+      ptype[k] = i;
+    }
+  }
+}
+
+/* Reads the velocities of the dark-matter block of snapshot fin into vv
+   (3 floats per particle), converting Gadget's u = v/sqrt(a) into peculiar
+   velocities. Gas particles come first in the block and are skipped; the
+   stream is left at the end of the block.
+*/
+void readVel(std::ifstream &fin, Header &data, std::vector<double> &vv, int myid)
+{
+
+  fastforwardToBlock(fin, "VEL ", myid);
+
+  const double sqrta = sqrt(data.time);
+  size_t after = 0;
+  for (int i = 2; i <= 5; i++)
+    after += data.npart[i];
+
+  fastforwardNVars(fin, 3 * sizeof(float), data.npart[0]);
+
+  std::vector<float> buffer(3 * size_t(data.npart[1]));
+  fin.read((char *)buffer.data(), buffer.size() * sizeof(float));
+
+  vv.resize(buffer.size());
+  for (size_t k = 0; k < buffer.size(); k++)
+    vv[k] = buffer[k] * sqrta;
+
+  fastforwardNVars(fin, 3 * sizeof(float), after);
+}
+
+/* Fills mm with the dark-matter particle masses, either from massarr[1]
+   or, when it is zero, from the type-1 entries of the MASS block. Only
+   types with a zero massarr entry are stored in that block.
+*/
+void readMass(std::ifstream &fin, Header &data, std::vector<double> &mm, int myid)
+{
+
+  mm.resize(data.npart[1]);
+  if (data.massarr[1] != 0)
+  {
+    std::fill(mm.begin(), mm.end(), data.massarr[1]);
+    return;
+  }
+
+  fastforwardToBlock(fin, "MASS", myid);
+
+  size_t before = 0, after = 0;
+  if (data.massarr[0] == 0)
+    before += data.npart[0];
+  for (int i = 2; i <= 5; i++)
+    if (data.massarr[i] == 0)
+      after += data.npart[i];
+
+  fastforwardNVars(fin, sizeof(float), before);
+
+  std::vector<float> buffer(data.npart[1]);
+  fin.read((char *)buffer.data(), buffer.size() * sizeof(float));
+  for (size_t k = 0; k < buffer.size(); k++)
+    mm[k] = buffer[k];
+
+  fastforwardNVars(fin, sizeof(float), after);
 }
\ No newline at end of file
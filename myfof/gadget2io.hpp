@@ -10,8 +10,12 @@
 #include <cstdint>
 #include <boost/geometry/geometry.hpp>
 #include <fstream>
+#include <iostream>
+#include <vector>
 #include <string.h>
 
+#include "../pyfof/memory.hpp"
+
 namespace bg = boost::geometry;
 
 typedef std::size_t size_t;
@@ -174,4 +178,62 @@ void fastforwardToBlock(std::ifstream &fin, std::string BLOCK, int myid);
  */
 void readPos(std::ifstream &fin, Header &data, int isnap, points_t &xx, int myid);
 
+/**
+ * @brief Reads the dark-matter positions into a flat array of three contiguous values per particle.
+ *
+ * Same selection and normalisation as the `points_t` overload, but without building Boost.Geometry
+ * points, which is what the kd-tree engine and the command-line driver consume. The stream is left
+ * at the end of the block.
+ *
+ * @param fin Reference to the input file stream, already open and positioned before the "POS " block.
+ * @param data Reference to the `Header` structure of the snapshot.
+ * @param xx Vector resized to 3 * npart[1] and filled with the normalised positions by an OpenMP static
+ *           loop, so that each page is first touched by the thread that will process it.
+ * @param myid Identifier for the process or thread calling this function; if `myid` equals 0, additional monitoring output is generated.
+ */
+void readPos(std::ifstream &fin, Header &data, first_touch_vector<double> &xx, int myid);
+
+/**
+ * @brief Reads the positions of all non dark-matter particles (gas, stars, black holes, ...).
+ *
+ * Positions are normalised by the box size as in `readPos` and stored three per particle, in file
+ * order with the type-1 particles skipped. Used to attach baryons to the groups found on the dark
+ * matter of hydro snapshots (see `testHydro`).
+ *
+ * @param fin Reference to the input file stream, positioned before the "POS " block (e.g. freshly opened by `readHeader`).
+ * @param data Reference to the `Header` structure of the snapshot.
+ * @param xx Vector filled with the normalised positions.
+ * @param ptype Vector filled with the Gadget particle type of each position.
+ * @param myid Identifier for the process or thread calling this function; if `myid` equals 0, additional monitoring output is generated.
+ */
+void readPosBaryons(std::ifstream &fin, Header &data, std::vector<double> &xx, std::vector<int> &ptype, int myid);
+
+/**
+ * @brief Reads the velocities of the dark-matter component from a snapshot file stream.
+ *
+ * Gadget-2 stores u = v / sqrt(a) in the "VEL " block; the values are multiplied by sqrt(a) so that
+ * `vv` holds peculiar velocities, three contiguous components per particle in file order. The stream
+ * is left at the end of the block.
+ *
+ * @param fin Reference to the input file stream, already open and positioned before the "VEL " block.
+ * @param data Reference to the `Header` structure of the snapshot.
+ * @param vv Vector resized to 3 * npart[1] and filled with the velocities.
+ * @param myid Identifier for the process or thread calling this function; if `myid` equals 0, additional monitoring output is generated.
+ */
+void readVel(std::ifstream &fin, Header &data, std::vector<double> &vv, int myid);
+
+/**
+ * @brief Reads the masses of the dark-matter particles.
+ *
+ * If `massarr[1]` is set, every particle gets that mass and the stream is not touched. Otherwise the
+ * type-1 entries of the "MASS" block are read (the block only stores types whose `massarr` is zero)
+ * and the stream is left at the end of the block.
+ *
+ * @param fin Reference to the input file stream, already open and positioned before the "MASS" block.
+ * @param data Reference to the `Header` structure of the snapshot.
+ * @param mm Vector resized to npart[1] and filled with the masses.
+ * @param myid Identifier for the process or thread calling this function; if `myid` equals 0, additional monitoring output is generated.
+ */
+void readMass(std::ifstream &fin, Header &data, std::vector<double> &mm, int myid);
+
 #endif
\ No newline at end of file
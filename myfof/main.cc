@@ -1,17 +1,577 @@
+/*
+ * Command-line friends-of-friends driver for sequences of Gadget-2 snapshots.
+ *
+ * The engines come from libygg (see pyfof/ygg.h). Build it at the repository root, then the driver from
+ * this directory with, e.g.
+ *   g++ -O3 -std=c++14 -fopenmp main.cc gadget2io.cc -o ygg-fof -L.. -lygg -Wl,-rpath,'$ORIGIN/..' -lpthread
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <vector>
 
-#include "fof.hpp"
+#include <sys/resource.h>
 
-int main() {
-    
-    double linking_length = 0.01;  // Linking length for clustering
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
-    // Run the friends-of-friends algorithm
-    std::vector<std::vector<size_t>> clusters = friends_of_friends_rtree("/home/tcastro/Pinocchio/example/snap_000", linking_length);
+#include "../pyfof/memory.hpp"
+#include "../pyfof/pipeline.hpp"
+#include "../pyfof/ygg.h"
+#include "gadget2io.hpp"
 
-    // Print the resulting clusters
-    std::cout << "Clusters formed: " << clusters.size() << std::endl;
+// Typedef for convenience
+typedef std::size_t size_t;
 
+/// Settings of a run, filled from the command line.
+struct driver_options {
+    std::vector<std::string> snapshots;  ///< Snapshot files, processed in order.
+    double linking_length = 0.2;         ///< Linking length in units of the mean interparticle separation.
+    std::string engine = "kdtree";       ///< libygg engine: auto, grid, kdtree, rtree or brute.
+    int threads = 0;                     ///< OpenMP threads used for clustering, 0 for the runtime default.
+    std::string output_dir = ".";        ///< Directory the catalogs are written to.
+    std::string format = "binary";       ///< Catalog format, "binary" or "ascii".
+    size_t min_members = 1;              ///< Smallest group written to the catalog.
+    size_t in_flight = 2;                ///< Maximum number of snapshots held in memory at once.
+    bool profile = false;                ///< Count hardware events in every clustering phase.
+    bool huge_pages = false;             ///< Back the large arrays by transparent huge pages.
+    std::string index_dir;               ///< Directory of saved kd-trees, empty to build them on every run.
+    std::string checkpoint_dir;          ///< Directory of the checkpoints of the clustering, empty for none.
+    double checkpoint_every = 300.;      ///< Seconds between two checkpoints.
+    bool baryons = false;                ///< Attach the other particle types to the dark-matter groups.
+};
+
+/// Releases a libygg index.
+struct index_deleter {
+    void operator()(ygg_index *index) const { ygg_index_destroy(index); }
+};
+
+/// Dark-matter positions of one snapshot, handed from the reader to the clustering stage.
+struct snapshot_data {
+    std::string path;            ///< File the snapshot was read from.
+    Header header;               ///< Gadget-2 header of the file.
+    first_touch_vector<double> pos;  ///< Positions in units of the box, three contiguous values per particle.
+    std::unique_ptr<ygg_index, index_deleter> index;  ///< Saved kd-tree, mapped instead of reading `pos`.
+    std::vector<double> baryons;     ///< Positions of the other particle types in units of the box, if attached.
+    double read_ms;              ///< Time spent reading the file.
+};
+
+/// Releases a libygg result.
+struct result_deleter {
+    void operator()(ygg_result *result) const { ygg_result_destroy(result); }
+};
+
+/// Groups of one snapshot, handed from the clustering stage to the writer.
+struct snapshot_catalog {
+    std::string path;                                     ///< File the snapshot was read from.
+    size_t npart;                                         ///< Number of clustered particles.
+    double linking_length;                                ///< Linking length used, in units of the box.
+    std::unique_ptr<ygg_result, result_deleter> result;   ///< Groups, phases and work counters of the clustering.
+    bool attached = false;                                ///< Whether the other particle types were attached.
+    std::vector<int64_t> baryon_labels;                   ///< Group of every other particle, -1 if none.
+    double read_ms;                                       ///< Time spent reading the file.
+};
+
+namespace {
+
+std::mutex print_mutex;
+
+/// Milliseconds elapsed since t0.
+double elapsed_ms(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+void print_usage(const char *prog) {
+    std::cerr << "Usage: " << prog << " [options] SNAPSHOT [SNAPSHOT ...]\n"
+              << "\n"
+              << "Friends-of-friends groups of the dark matter of each Gadget-2 snapshot. Reading the next\n"
+              << "snapshot, clustering the current one and writing the previous catalog overlap.\n"
+              << "\n"
+              << "Options:\n"
+              << "  -b, --linking-length B  linking length in units of the mean interparticle separation (0.2)\n"
+              << "  -e, --engine NAME       auto, grid, kdtree, rtree or brute (kdtree)\n"
+              << "  -t, --threads N         OpenMP threads used for clustering (runtime default)\n"
+              << "  -o, --output-dir DIR    directory the catalogs are written to (.)\n"
+              << "  -f, --format FMT        catalog format: binary or ascii (binary)\n"
+              << "  -m, --min-members N     smallest group written to the catalog (1)\n"
+              << "      --in-flight N       snapshots held in memory at once, at least 2 (2)\n"
+              << "      --profile           report the IPC and cache misses per particle of each phase\n"
+              << "      --huge-pages        back the large arrays by transparent huge pages\n"
+              << "      --index-dir DIR     keep the kd-tree of every snapshot in DIR/<name>.kdt and map it\n"
+              << "                          back on later runs instead of reading the positions (kdtree/auto)\n"
+              << "      --checkpoint-dir DIR  save the progress of the clustering to DIR/<name>.ckpt and resume\n"
+              << "                          from it if the run is restarted (kdtree/auto)\n"
+              << "      --checkpoint-every S  seconds between two checkpoints (300)\n"
+              << "      --baryons           attach the gas, stars and black holes to the group of their nearest\n"
+              << "                          dark-matter particle within the linking length\n"
+              << "  -h, --help              show this message\n"
+              << "\n"
+              << "Each catalog is written to DIR/<snapshot file name>.fof. The binary format is\n"
+              << "uint64 ngroups, uint64 nmembers, uint64 offsets[ngroups + 1], uint64 members[nmembers];\n"
+              << "the ascii format has one line per group: its size followed by its members. Members are\n"
+              << "indices of the dark-matter particles in file order.\n"
+              << "\n"
+              << "With --baryons, the groups of the other particles, numbered like the catalog and -1 for\n"
+              << "none, go to DIR/<snapshot file name>.baryons, in file order with the dark matter skipped:\n"
+              << "uint64 n, int64 labels[n] in binary, one label per line in ascii.\n"
+              << "\n"
+              << "Arrays are first touched by the OpenMP thread that processes them; bind the threads, e.g.\n"
+              << "with OMP_PLACES=cores OMP_PROC_BIND=close, to keep them in the memory of their socket.\n";
+}
+
+/**
+ * @brief Parse the command line into `opt`.
+ *
+ * @return int 0 to run, 1 on error, -1 if only the help was requested.
+ */
+int parse_options(int argc, char **argv, driver_options &opt) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        auto value = [&](const char *name) -> const char * {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << name << "\n";
+                return nullptr;
+            }
+            return argv[++i];
+        };
+        const char *v = nullptr;
+        if (arg == "-h" || arg == "--help") {
+            return -1;
+        } else if (arg == "-b" || arg == "--linking-length") {
+            if (!(v = value("--linking-length"))) return 1;
+            opt.linking_length = std::atof(v);
+        } else if (arg == "-e" || arg == "--engine") {
+            if (!(v = value("--engine"))) return 1;
+            opt.engine = v;
+        } else if (arg == "-t" || arg == "--threads") {
+            if (!(v = value("--threads"))) return 1;
+            opt.threads = std::atoi(v);
+        } else if (arg == "-o" || arg == "--output-dir") {
+            if (!(v = value("--output-dir"))) return 1;
+            opt.output_dir = v;
+        } else if (arg == "-f" || arg == "--format") {
+            if (!(v = value("--format"))) return 1;
+            opt.format = v;
+        } else if (arg == "-m" || arg == "--min-members") {
+            if (!(v = value("--min-members"))) return 1;
+            opt.min_members = std::strtoul(v, nullptr, 10);
+        } else if (arg == "--profile") {
+            opt.profile = true;
+        } else if (arg == "--huge-pages") {
+            opt.huge_pages = true;
+        } else if (arg == "--index-dir") {
+            if (!(v = value("--index-dir"))) return 1;
+            opt.index_dir = v;
+        } else if (arg == "--checkpoint-dir") {
+            if (!(v = value("--checkpoint-dir"))) return 1;
+            opt.checkpoint_dir = v;
+        } else if (arg == "--checkpoint-every") {
+            if (!(v = value("--checkpoint-every"))) return 1;
+            opt.checkpoint_every = std::atof(v);
+        } else if (arg == "--baryons") {
+            opt.baryons = true;
+        } else if (arg == "--in-flight") {
+            if (!(v = value("--in-flight"))) return 1;
+            opt.in_flight = std::strtoul(v, nullptr, 10);
+        } else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "Unknown option " << arg << "\n";
+            return 1;
+        } else {
+            opt.snapshots.push_back(arg);
+        }
+    }
+
+    if (opt.snapshots.empty()) {
+        std::cerr << "No snapshot given\n";
+        return 1;
+    }
+    if (!(opt.linking_length > 0.)) {
+        std::cerr << "The linking length must be positive\n";
+        return 1;
+    }
+    if (opt.engine != "auto" && opt.engine != "grid" && opt.engine != "kdtree" && opt.engine != "rtree" &&
+        opt.engine != "brute") {
+        std::cerr << "Unknown engine " << opt.engine << "\n";
+        return 1;
+    }
+    if ((!opt.index_dir.empty() || !opt.checkpoint_dir.empty()) && opt.engine != "kdtree" && opt.engine != "auto") {
+        std::cerr << (opt.index_dir.empty() ? "--checkpoint-dir" : "--index-dir")
+                  << " needs the kdtree or auto engine\n";
+        return 1;
+    }
+    if (!(opt.checkpoint_every >= 0.)) {
+        std::cerr << "The checkpoint interval cannot be negative\n";
+        return 1;
+    }
+    if (opt.format != "binary" && opt.format != "ascii") {
+        std::cerr << "Unknown format " << opt.format << "\n";
+        return 1;
+    }
+    if (opt.in_flight < 2) {
+        std::cerr << "At least two snapshots must be allowed in flight\n";
+        return 1;
+    }
     return 0;
-}
\ No newline at end of file
+}
+
+/// Total number of dark-matter particles in the simulation, from the header.
+double total_dark_matter(const Header &header) {
+    const double n = std::ldexp(static_cast<double>(static_cast<uint32_t>(header.nTotalHW[1])), 32) +
+                     header.npartTotal[1];
+    return n > 0. ? n : header.npart[1];
+}
+
+/// File name of a snapshot in `dir`, with `suffix` appended.
+std::string output_path(const std::string &snapshot, const std::string &dir, const char *suffix) {
+    const size_t slash = snapshot.find_last_of('/');
+    const std::string name = slash == std::string::npos ? snapshot : snapshot.substr(slash + 1);
+    return dir + "/" + name + suffix;
+}
+
+/// Identifier of a snapshot its saved kd-tree must match: the hash of its header, without the trailing padding.
+uint64_t snapshot_checksum(const Header &header) {
+    return ygg_checksum(&header, offsetof(Header, la) + sizeof(header.la));
+}
+
+/// Checkpoint of the clustering of a snapshot, removed once its catalog is written.
+std::string checkpoint_path(const std::string &snapshot, const driver_options &opt) {
+    return output_path(snapshot, opt.checkpoint_dir, ".ckpt");
+}
+
+/**
+ * @brief Read the header and dark-matter positions of one snapshot, and the other positions if attached.
+ *
+ * With an index directory, the kd-tree saved by an earlier run is mapped instead when it matches the
+ * header, and the positions are not read.
+ */
+bool read_snapshot(const std::string &path, const driver_options &opt, snapshot_data &snap) {
+    const auto t0 = std::chrono::steady_clock::now();
+    std::ifstream fin;
+    snap.path = path;
+    if (readHeader(path, snap.header, fin, false)) {
+        return false;
+    }
+    if (opt.baryons) {
+        // Both readers start from the POS block, so come back to it for the dark matter
+        const auto before_pos = fin.tellg();
+        std::vector<int> ptype;
+        readPosBaryons(fin, snap.header, snap.baryons, ptype, 1);
+        if (!fin) {
+            std::cerr << "Error in reading the baryon positions of " << path << "\n";
+            return false;
+        }
+        fin.seekg(before_pos);
+    }
+    if (!opt.index_dir.empty()) {
+        ygg_options options;
+        ygg_options_init(&options);
+        options.engine = opt.engine.c_str();
+        options.profile = opt.profile;
+        ygg_index *index = nullptr;
+        if (ygg_index_open(output_path(path, opt.index_dir, ".kdt").c_str(), nullptr,
+                           static_cast<size_t>(snap.header.npart[1]), 3, 1., snapshot_checksum(snap.header),
+                           &options, &index) == YGG_OK) {
+            snap.index.reset(index);
+            snap.read_ms = elapsed_ms(t0);
+            return true;
+        }
+    }
+    readPos(fin, snap.header, snap.pos, 1);
+    if (!fin) {
+        std::cerr << "Error in reading the positions of " << path << "\n";
+        return false;
+    }
+    snap.read_ms = elapsed_ms(t0);
+    return true;
+}
+
+/// Peak resident set size of the process so far, in MiB.
+double peak_rss_mib() {
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss / 1024. : 0.;
+}
+
+/**
+ * @brief Link a snapshot with libygg; positions are in units of the (periodic) box. False on failure.
+ *
+ * With an index directory, a kd-tree built here is saved for the next runs; failing to save it is
+ * only reported. With a checkpoint directory, a run of the snapshot killed before its catalog was
+ * written resumes from its checkpoint.
+ */
+bool cluster_snapshot(const snapshot_data &snap, const driver_options &opt, snapshot_catalog &out) {
+    out.path = snap.path;
+    out.npart = snap.index ? static_cast<size_t>(snap.header.npart[1]) : snap.pos.size() / 3;
+    out.linking_length = opt.linking_length / std::cbrt(total_dark_matter(snap.header));
+    out.read_ms = snap.read_ms;
+
+    std::unique_ptr<ygg_index, index_deleter> built;
+    ygg_index *index = snap.index.get();
+    ygg_result *result = nullptr;
+    ygg_status status = YGG_OK;
+    if (!index) {
+        ygg_options options;
+        ygg_options_init(&options);
+        options.engine = opt.engine.c_str();
+        options.profile = opt.profile;
+        status = ygg_index_create(snap.pos.data(), out.npart, 3, 1., &options, &index);
+        built.reset(index);
+    }
+    if (status == YGG_OK && opt.checkpoint_dir.empty()) {
+        status = ygg_index_fof(index, out.linking_length, 1, &result);
+    } else if (status == YGG_OK) {
+        status = ygg_index_fof_checkpointed(index, out.linking_length, 1, checkpoint_path(snap.path, opt).c_str(),
+                                            opt.checkpoint_every, &result);
+    }
+    if (status != YGG_OK) {
+        std::lock_guard<std::mutex> lock(print_mutex);
+        std::cerr << "Error in clustering " << snap.path << ": " << ygg_last_error() << "\n";
+        return false;
+    }
+    out.result.reset(result);
+
+    if (opt.baryons) {
+        // Attached within the linking length, like a last friend of the group
+        out.attached = true;
+        out.baryon_labels.resize(snap.baryons.size() / 3);
+        if (ygg_index_attach(index, result, snap.baryons.data(), out.baryon_labels.size(), out.linking_length,
+                             out.baryon_labels.data()) != YGG_OK) {
+            std::lock_guard<std::mutex> lock(print_mutex);
+            std::cerr << "Error in attaching the baryons of " << snap.path << ": " << ygg_last_error() << "\n";
+            return false;
+        }
+    }
+
+    if (built && !opt.index_dir.empty() &&
+        ygg_index_save(index, output_path(snap.path, opt.index_dir, ".kdt").c_str(),
+                       snapshot_checksum(snap.header)) != YGG_OK) {
+        std::lock_guard<std::mutex> lock(print_mutex);
+        std::cerr << "Warning: cannot save the kd-tree of " << snap.path << ": " << ygg_last_error() << "\n";
+    }
+    return true;
+}
+
+/// Path of the catalog of a snapshot: its file name in the output directory, with a ".fof" suffix.
+std::string catalog_path(const std::string &snapshot, const driver_options &opt) {
+    return output_path(snapshot, opt.output_dir, ".fof");
+}
+
+/// Write the groups with at least `min_members` members in the format selected on the command line.
+bool write_catalog(const snapshot_catalog &snap, const driver_options &opt, uint64_t &written) {
+    const std::string path = catalog_path(snap.path, opt);
+    const size_t ngroups_all = ygg_result_ngroups(snap.result.get());
+    const size_t *offsets = ygg_result_offsets(snap.result.get());
+    const size_t *members = ygg_result_members(snap.result.get());
+    auto kept = [&](size_t g) { return offsets[g + 1] - offsets[g] >= opt.min_members; };
+
+    uint64_t ngroups = 0, nmembers = 0;
+    for (size_t g = 0; g < ngroups_all; ++g) {
+        if (kept(g)) {
+            ++ngroups;
+            nmembers += offsets[g + 1] - offsets[g];
+        }
+    }
+    written = ngroups;
+
+    if (opt.format == "binary") {
+        std::ofstream fout(path, std::ios::binary);
+        fout.write(reinterpret_cast<const char *>(&ngroups), sizeof(ngroups));
+        fout.write(reinterpret_cast<const char *>(&nmembers), sizeof(nmembers));
+        uint64_t offset = 0;
+        fout.write(reinterpret_cast<const char *>(&offset), sizeof(offset));
+        for (size_t g = 0; g < ngroups_all; ++g) {
+            if (kept(g)) {
+                offset += offsets[g + 1] - offsets[g];
+                fout.write(reinterpret_cast<const char *>(&offset), sizeof(offset));
+            }
+        }
+        for (size_t g = 0; g < ngroups_all; ++g) {
+            if (!kept(g)) continue;
+            for (size_t k = offsets[g]; k < offsets[g + 1]; ++k) {
+                const uint64_t v = members[k];
+                fout.write(reinterpret_cast<const char *>(&v), sizeof(v));
+            }
+        }
+        return static_cast<bool>(fout);
+    }
+
+    std::ofstream fout(path);
+    for (size_t g = 0; g < ngroups_all; ++g) {
+        if (!kept(g)) continue;
+        fout << offsets[g + 1] - offsets[g];
+        for (size_t k = offsets[g]; k < offsets[g + 1]; ++k) fout << ' ' << members[k];
+        fout << '\n';
+    }
+    return static_cast<bool>(fout);
+}
+
+/// Write the groups of the attached particles, renumbered like the catalog written with `min_members`.
+bool write_baryons(const snapshot_catalog &snap, const driver_options &opt) {
+    const std::string path = output_path(snap.path, opt.output_dir, ".baryons");
+    const size_t ngroups_all = ygg_result_ngroups(snap.result.get());
+    const size_t *offsets = ygg_result_offsets(snap.result.get());
+
+    std::vector<int64_t> renumbered(ngroups_all, -1);
+    int64_t next = 0;
+    for (size_t g = 0; g < ngroups_all; ++g) {
+        if (offsets[g + 1] - offsets[g] >= opt.min_members) renumbered[g] = next++;
+    }
+    auto group = [&](int64_t label) { return label < 0 ? int64_t(-1) : renumbered[label]; };
+
+    if (opt.format == "binary") {
+        std::ofstream fout(path, std::ios::binary);
+        const uint64_t n = snap.baryon_labels.size();
+        fout.write(reinterpret_cast<const char *>(&n), sizeof(n));
+        for (const int64_t label : snap.baryon_labels) {
+            const int64_t v = group(label);
+            fout.write(reinterpret_cast<const char *>(&v), sizeof(v));
+        }
+        return static_cast<bool>(fout);
+    }
+
+    std::ofstream fout(path);
+    for (const int64_t label : snap.baryon_labels) fout << group(label) << '\n';
+    return static_cast<bool>(fout);
+}
+
+} // End of anonymous namespace
+
+int main(int argc, char **argv) {
+    driver_options opt;
+    const int parsed = parse_options(argc, argv, opt);
+    if (parsed != 0) {
+        print_usage(argv[0]);
+        return parsed < 0 ? 0 : 1;
+    }
+#ifdef _OPENMP
+    if (opt.threads > 0) {
+        omp_set_num_threads(opt.threads);
+    }
+    // Placement only holds when thread t always runs on the same socket
+    if (omp_get_max_threads() > 1 && omp_get_proc_bind() == omp_proc_bind_false) {
+        std::cerr << "Warning: OpenMP threads are not bound; set OMP_PLACES and OMP_PROC_BIND to keep every array "
+                     "in the memory of the threads that use it\n";
+    } else {
+        std::cout << "OpenMP: " << omp_get_max_threads() << " threads over " << omp_get_num_places() << " places"
+                  << std::endl;
+    }
+#endif
+    if (opt.huge_pages) {
+        set_huge_pages(true);
+        ygg_set_huge_pages(1);
+    }
+
+    // A slot is taken before a snapshot is read and given back once its catalog is written, so at
+    // most `in_flight` snapshots are alive, each either as positions or as its catalog: the one being
+    // written, the one being clustered and those read ahead of them
+    slot_pool slots(opt.in_flight);
+    bounded_queue<snapshot_data> to_cluster(1);
+    bounded_queue<snapshot_catalog> to_write(1);
+    std::atomic<int> failures(0);
+    const auto t0 = std::chrono::steady_clock::now();
+
+    std::thread reader([&] {
+        for (auto const &path : opt.snapshots) {
+            slots.acquire();
+            snapshot_data snap;
+            if (!read_snapshot(path, opt, snap)) {
+                ++failures;
+                slots.release();
+                continue;
+            }
+            to_cluster.push(std::move(snap));
+        }
+        to_cluster.close();
+    });
+
+    std::thread writer([&] {
+        snapshot_catalog snap;
+        while (to_write.pop(snap)) {
+            const auto tw = std::chrono::steady_clock::now();
+            uint64_t ngroups = 0;
+            if (!write_catalog(snap, opt, ngroups) || (snap.attached && !write_baryons(snap, opt))) {
+                {
+                    std::lock_guard<std::mutex> lock(print_mutex);
+                    std::cerr << "Error in writing the catalog of " << snap.path << "\n";
+                }
+                ++failures;
+                snap = snapshot_catalog();
+                slots.release();
+                continue;
+            }
+            if (!opt.checkpoint_dir.empty()) {
+                std::remove(checkpoint_path(snap.path, opt).c_str());
+            }
+            const double write_ms = elapsed_ms(tw);
+            ygg_stats stats;
+            ygg_result_stats(snap.result.get(), &stats);
+            std::unique_lock<std::mutex> lock(print_mutex);
+            std::cout << snap.path << ": " << snap.npart << " particles, " << ngroups << " groups (b = "
+                      << snap.linking_length << " box, " << stats.engine << "), ";
+            if (snap.attached) {
+                const size_t grouped = snap.baryon_labels.size() -
+                                       std::count(snap.baryon_labels.begin(), snap.baryon_labels.end(), int64_t(-1));
+                std::cout << grouped << " of " << snap.baryon_labels.size() << " baryons attached, ";
+            }
+            std::cout << "read " << snap.read_ms << " ms";
+            for (size_t i = 0; i < stats.nphases; ++i) {
+                ygg_phase phase;
+                ygg_result_phase(snap.result.get(), i, &phase);
+                std::cout << ", " << phase.name << " " << phase.wall_ns * 1e-6 << " ms";
+                const uint64_t bytes = ygg_result_phase_bytes(snap.result.get(), i);
+                if (bytes > 0 && phase.wall_ns > 0) {
+                    std::cout << " (" << double(bytes) / phase.wall_ns << " GB/s)";
+                }
+                if (phase.hw.cycles > 0 && phase.hw.instructions >= 0) {
+                    std::cout << " (IPC " << double(phase.hw.instructions) / phase.hw.cycles;
+                    if (phase.hw.llc_misses >= 0) {
+                        std::cout << ", " << double(phase.hw.llc_misses) / snap.npart << " LLC misses/particle";
+                    }
+                    std::cout << ")";
+                }
+            }
+            std::cout << ", write " << write_ms << " ms, " << stats.pairs_tested << " pairs tested, peak RSS "
+                      << peak_rss_mib() << " MiB" << std::endl;
+            lock.unlock();
+
+            // The catalog is freed before the reader may take the slot for another snapshot
+            snap = snapshot_catalog();
+            slots.release();
+        }
+    });
+
+    // Clustering runs on the main thread, so OpenMP uses the thread count set above
+    snapshot_data snap;
+    while (to_cluster.pop(snap)) {
+        snapshot_catalog cat;
+        const bool clustered = cluster_snapshot(snap, opt, cat);
+        snap = snapshot_data();
+        if (!clustered) {
+            ++failures;
+            slots.release();
+            continue;
+        }
+        to_write.push(std::move(cat));
+    }
+    to_write.close();
+
+    reader.join();
+    writer.join();
+
+    std::cout << "Processed " << opt.snapshots.size() << " snapshots in " << elapsed_ms(t0) << " ms";
+    if (failures > 0) {
+        std::cout << ", " << failures << " failed";
+    }
+    std::cout << std::endl;
+    return failures > 0 ? 1 : 0;
+}
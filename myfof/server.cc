@@ -0,0 +1,658 @@
+/*
+ * Resident friends-of-friends server for Gadget-2 snapshots.
+ *
+ * Snapshots are read once and kept in memory with their kd-tree; clients then ask for FoF groups,
+ * labels, ball queries and halo properties over a local Unix domain socket (see ygg_client.py for
+ * the Python client). Build from this directory with, e.g.
+ *   g++ -O3 -std=c++17 -fopenmp server.cc gadget2io.cc ../pyfof/groups.cc ../pyfof/halo_properties.cc \
+ *       -o ygg-server -lpthread -lrt
+ *
+ * Protocol (native byte order, version 1). A request is a 16-byte header
+ *   uint32 magic "YGGS", uint16 version, uint16 op, uint64 size
+ * followed by `size` bytes of arguments. The reply is a 16-byte header
+ *   uint32 magic "YGGS", uint16 status, uint8 narrays, uint8 shared, uint64 size
+ * followed by `size` bytes. On success the reply holds `narrays` uint64 element counts, then either
+ * the arrays themselves, back to back (shared = 0), or the name of a POSIX shared memory object
+ * holding them (shared = 1), which the client maps instead of reading them from the socket. Every
+ * array has 8-byte elements. On failure the bytes are the error message.
+ *
+ * The fof and labels arrays of a catalog are copied into shared memory once, by the first request
+ * that needs them, and the same object is handed to every later request for that catalog; it is
+ * unlinked when the catalog is replaced or the snapshot unloaded. Other large replies are copied into
+ * an object of their own, unlinked at the next request of the connection or when it closes. Either
+ * way the client maps the object before sending anything else.
+ *
+ * Lengths are in the units of the snapshot, velocities are peculiar velocities (the VEL block times
+ * sqrt(a)) and indices refer to the dark-matter particles in file order.
+ *
+ *   op              arguments                      reply arrays
+ *   1 load          path                           uint64 [id, npart], double [boxsize, particle mass]
+ *                                                  (0 if the masses vary, see the MASS block)
+ *   2 unload        uint64 id                      -
+ *   3 fof           uint64 id, double b            uint64 offsets[ngroups + 1], uint64 members[npart]
+ *   4 labels        uint64 id, double b            int64 labels[npart]
+ *   5 ball          uint64 id, double x, y, z, r   uint64 indices, increasing
+ *   6 halo          uint64 id, double b            uint64 npart, double mass, double com[3 ngroups],
+ *                                                  double vel[3 ngroups], double sigma_v, double extent
+ *                                                  (vel and sigma_v empty without a VEL block)
+ *
+ * The catalog of the last linking length of each snapshot is kept, so that labels and halo
+ * properties of a FoF run come for free.
+ */
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <csignal>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "../pyfof/fof_kdtree.hpp"
+#include "../pyfof/halo_properties.hpp"
+#include "../pyfof/kdtree.hpp"
+#include "../pyfof/memory.hpp"
+#include "gadget2io.hpp"
+
+// Typedef for convenience
+typedef std::size_t size_t;
+
+/// Settings of the server, filled from the command line.
+struct server_options {
+    std::string socket_path = "/tmp/ygg-server.sock";  ///< Unix socket the server listens on.
+    std::vector<std::string> snapshots;                ///< Snapshots loaded at start-up.
+    int threads = 0;                                   ///< OpenMP threads per request, 0 for the runtime default.
+    bool huge_pages = false;                           ///< Back the large arrays by transparent huge pages.
+};
+
+/// A shared memory object holding the arrays of a reply, unlinked once nobody hands it out any more.
+struct shared_arrays {
+    std::string name;                       ///< Name of the object, as given to `shm_open`.
+    ~shared_arrays() { shm_unlink(name.c_str()); }
+};
+
+/// A snapshot kept in memory with its index.
+struct resident_snapshot {
+    std::string path;                       ///< File the snapshot was read from.
+    Header header;                          ///< Gadget-2 header of the file.
+    first_touch_vector<double> pos;         ///< Positions in units of the box, three contiguous values per particle.
+    std::vector<double> vel;                ///< Peculiar velocities, three per particle; empty without a VEL block.
+    std::vector<double> mass;               ///< Per-particle masses, left empty when `massarr[1]` is set.
+    std::unique_ptr<kd_tree<3>> tree;       ///< Periodic kd-tree over `pos`, with a unit box.
+
+    std::mutex catalog_mutex;               ///< Guards the cached catalog.
+    double catalog_length = -1.;            ///< Linking length of the cached catalog, in units of the box.
+    std::shared_ptr<const group_catalog> catalog;  ///< Groups of the last linking length.
+    std::shared_ptr<const shared_arrays> catalog_shared[2];  ///< fof and labels replies of `catalog`, once shared.
+
+    size_t npart() const { return pos.size() / 3; }
+};
+
+namespace {
+
+const uint32_t PROTOCOL_MAGIC = 0x53474759;  // "YGGS" in little-endian byte order
+const uint16_t PROTOCOL_VERSION = 1;
+
+/// Replies up to this many bytes of arrays are sent through the socket rather than shared memory.
+const size_t INLINE_BYTES = 4096;
+
+/// Arguments of a request are never longer than this.
+const size_t MAX_REQUEST_BYTES = 1 << 16;
+
+enum op_code : uint16_t { OP_LOAD = 1, OP_UNLOAD = 2, OP_FOF = 3, OP_LABELS = 4, OP_BALL = 5, OP_HALO = 6 };
+
+enum reply_status : uint16_t { REPLY_OK = 0, REPLY_BAD_REQUEST = 1, REPLY_NOT_FOUND = 2, REPLY_ERROR = 3 };
+
+struct request_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t op;
+    uint64_t size;
+};
+
+struct reply_header {
+    uint32_t magic;
+    uint16_t status;
+    uint8_t narrays;
+    uint8_t shared;
+    uint64_t size;
+};
+
+static_assert(sizeof(request_header) == 16 && sizeof(reply_header) == 16, "headers must be packed");
+
+/// A failed request, reported to the client with `status`.
+struct request_error : std::runtime_error {
+    request_error(reply_status status, const std::string &what) : std::runtime_error(what), status(status) {}
+    reply_status status;
+};
+
+/// Arrays of a reply, borrowed from `owners`.
+struct reply {
+    std::vector<const void *> data;
+    std::vector<uint64_t> counts;
+    std::vector<std::shared_ptr<const void>> owners;
+    std::shared_ptr<const shared_arrays> shared;  ///< The arrays already in shared memory, if so.
+
+    template <typename T>
+    void add(const T *p, size_t n) {
+        static_assert(sizeof(T) == 8, "replies hold 8-byte elements");
+        data.push_back(p);
+        counts.push_back(n);
+    }
+
+    /// Add an array owned by the reply.
+    template <typename T>
+    void add(std::vector<T> values) {
+        auto owned = std::make_shared<std::vector<T>>(std::move(values));
+        add(owned->data(), owned->size());
+        owners.push_back(owned);
+    }
+
+    size_t bytes() const {
+        size_t total = 0;
+        for (auto n : counts) total += 8 * n;
+        return total;
+    }
+};
+
+/// Arguments of a request, read in order.
+struct request_reader {
+    const std::vector<char> &bytes;
+    size_t at = 0;
+
+    template <typename T>
+    T get() {
+        if (at + sizeof(T) > bytes.size()) throw request_error(REPLY_BAD_REQUEST, "truncated request");
+        T value;
+        std::memcpy(&value, bytes.data() + at, sizeof(T));
+        at += sizeof(T);
+        return value;
+    }
+};
+
+/// Loaded snapshots by id.
+struct server_state {
+    std::mutex mutex;
+    std::map<uint64_t, std::shared_ptr<resident_snapshot>> snapshots;
+    uint64_t next_id = 1;
+};
+
+std::mutex print_mutex;
+
+/// Socket path, removed when the server is interrupted.
+char socket_to_remove[sizeof(sockaddr_un::sun_path)];
+
+/// Shared memory objects are named `shared_prefix` followed by a counter, so all can be removed on exit.
+char shared_prefix[64];
+std::atomic<uint64_t> shared_count(0);
+
+void remove_socket_and_exit(int) {
+    unlink(socket_to_remove);
+    // Only async-signal-safe calls here: the path of object k is built by hand under /dev/shm
+    char path[sizeof("/dev/shm") + sizeof(shared_prefix) + 20];
+    const size_t prefix = std::strlen(std::strcpy(path, "/dev/shm"));
+    const size_t base = prefix + std::strlen(std::strcpy(path + prefix, shared_prefix));
+    const uint64_t count = shared_count.load();
+    for (uint64_t k = 0; k < count; ++k) {
+        char digits[20];
+        size_t n = 0;
+        for (uint64_t v = k; n == 0 || v > 0; v /= 10) digits[n++] = static_cast<char>('0' + v % 10);
+        for (size_t i = 0; i < n; ++i) path[base + i] = digits[n - 1 - i];
+        path[base + n] = '\0';
+        unlink(path);
+    }
+    _exit(0);
+}
+
+void print_usage(const char *prog) {
+    std::cerr << "Usage: " << prog << " [options] [SNAPSHOT ...]\n"
+              << "\n"
+              << "Keeps Gadget-2 snapshots and their kd-trees in memory and answers friends-of-friends,\n"
+              << "label, ball-query and halo-property requests over a local Unix socket. The snapshots\n"
+              << "given on the command line are loaded at start-up; clients load others on demand.\n"
+              << "\n"
+              << "Options:\n"
+              << "  -s, --socket PATH       Unix socket to listen on (/tmp/ygg-server.sock)\n"
+              << "  -t, --threads N         OpenMP threads per request (runtime default)\n"
+              << "      --huge-pages        back the large arrays by transparent huge pages\n"
+              << "  -h, --help              show this message\n";
+}
+
+/**
+ * @brief Parse the command line into `opt`.
+ *
+ * @return int 0 to run, 1 on error, -1 if only the help was requested.
+ */
+int parse_options(int argc, char **argv, server_options &opt) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        auto value = [&](const char *name) -> const char * {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << name << "\n";
+                return nullptr;
+            }
+            return argv[++i];
+        };
+        const char *v = nullptr;
+        if (arg == "-h" || arg == "--help") {
+            return -1;
+        } else if (arg == "-s" || arg == "--socket") {
+            if (!(v = value("--socket"))) return 1;
+            opt.socket_path = v;
+        } else if (arg == "-t" || arg == "--threads") {
+            if (!(v = value("--threads"))) return 1;
+            opt.threads = std::atoi(v);
+        } else if (arg == "--huge-pages") {
+            opt.huge_pages = true;
+        } else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "Unknown option " << arg << "\n";
+            return 1;
+        } else {
+            opt.snapshots.push_back(arg);
+        }
+    }
+    if (opt.socket_path.size() >= sizeof(sockaddr_un::sun_path)) {
+        std::cerr << "The socket path is too long\n";
+        return 1;
+    }
+    return 0;
+}
+
+/// Read exactly `n` bytes; false at the end of the stream or on error.
+bool read_all(int fd, void *buf, size_t n) {
+    char *p = static_cast<char *>(buf);
+    while (n > 0) {
+        const ssize_t got = read(fd, p, n);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        p += got;
+        n -= static_cast<size_t>(got);
+    }
+    return true;
+}
+
+/// Write exactly `n` bytes; false on error.
+bool write_all(int fd, const void *buf, size_t n) {
+    const char *p = static_cast<const char *>(buf);
+    while (n > 0) {
+        const ssize_t sent = send(fd, p, n, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        p += sent;
+        n -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+/// Read a snapshot and build its index.
+std::shared_ptr<resident_snapshot> load_snapshot(const std::string &path) {
+    auto snap = std::make_shared<resident_snapshot>();
+    std::ifstream fin;
+    snap->path = path;
+    if (readHeader(path, snap->header, fin, false)) {
+        throw request_error(REPLY_NOT_FOUND, "cannot open " + path);
+    }
+    readPos(fin, snap->header, snap->pos, 1);
+    if (!fin) {
+        throw request_error(REPLY_ERROR, "cannot read the positions of " + path);
+    }
+    // Velocities are optional: without a VEL block the halo replies leave vel and sigma_v empty
+    const auto after_pos = fin.tellg();
+    readVel(fin, snap->header, snap->vel, 1);
+    if (!fin) {
+        std::vector<double>().swap(snap->vel);
+        fin.clear();
+        fin.seekg(after_pos);
+    }
+    if (snap->header.massarr[1] == 0 && snap->header.npart[1] > 0) {
+        // Variable masses, stored in the MASS block after the velocities
+        readMass(fin, snap->header, snap->mass, 1);
+        if (!fin) {
+            throw request_error(REPLY_ERROR, "cannot read the masses of " + path);
+        }
+    }
+    snap->tree.reset(new kd_tree<3>(snap->pos.data(), snap->npart(), 1.));
+    return snap;
+}
+
+std::shared_ptr<resident_snapshot> find_snapshot(server_state &state, uint64_t id) {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    const auto it = state.snapshots.find(id);
+    if (it == state.snapshots.end()) {
+        throw request_error(REPLY_NOT_FOUND, "no snapshot " + std::to_string(id));
+    }
+    return it->second;
+}
+
+/// Catalog of a snapshot for a linking length in snapshot units, reusing the last one if it matches.
+std::shared_ptr<const group_catalog> snapshot_catalog(resident_snapshot &snap, double linking_length) {
+    if (!(linking_length > 0.)) {
+        throw request_error(REPLY_BAD_REQUEST, "the linking length must be positive");
+    }
+    const double b = linking_length / snap.header.boxsize;
+    std::lock_guard<std::mutex> lock(snap.catalog_mutex);
+    if (!snap.catalog || snap.catalog_length != b) {
+        snap.catalog = std::make_shared<const group_catalog>(friends_of_friends_kdtree(*snap.tree, b));
+        snap.catalog_length = b;
+        for (auto &shared : snap.catalog_shared) shared.reset();
+    }
+    return snap.catalog;
+}
+
+reply handle_load(server_state &state, const std::vector<char> &args) {
+    const std::string path(args.begin(), args.end());
+    std::shared_ptr<resident_snapshot> snap;
+    uint64_t id = 0;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        for (auto const &entry : state.snapshots) {
+            if (entry.second->path == path) {
+                id = entry.first;
+                snap = entry.second;
+            }
+        }
+    }
+    if (!snap) {
+        // Read outside the lock, so that the other snapshots stay available meanwhile
+        snap = load_snapshot(path);
+        std::lock_guard<std::mutex> lock(state.mutex);
+        id = state.next_id++;
+        state.snapshots[id] = snap;
+        std::lock_guard<std::mutex> print_lock(print_mutex);
+        std::cout << "Loaded " << path << " as snapshot " << id << ": " << snap->npart() << " particles"
+                  << std::endl;
+    }
+    reply out;
+    out.add(std::vector<uint64_t>{id, snap->npart()});
+    out.add(std::vector<double>{snap->header.boxsize, snap->header.massarr[1]});
+    return out;
+}
+
+reply handle_unload(server_state &state, const std::vector<char> &args) {
+    request_reader in{args};
+    const uint64_t id = in.get<uint64_t>();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (state.snapshots.erase(id) == 0) {
+        throw request_error(REPLY_NOT_FOUND, "no snapshot " + std::to_string(id));
+    }
+    return reply();
+}
+
+/// Copy the arrays of a reply into a new shared memory object.
+std::shared_ptr<const shared_arrays> share_reply(const reply &out) {
+    const std::string name = shared_prefix + std::to_string(shared_count++);
+    const size_t bytes = out.bytes();
+    const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        throw request_error(REPLY_ERROR, std::string("shm_open: ") + std::strerror(errno));
+    }
+    void *map = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(bytes)) == 0) {
+        map = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        throw request_error(REPLY_ERROR, std::string("cannot map the reply: ") + std::strerror(errno));
+    }
+    char *p = static_cast<char *>(map);
+    for (size_t a = 0; a < out.data.size(); ++a) {
+        std::memcpy(p, out.data[a], 8 * out.counts[a]);
+        p += 8 * out.counts[a];
+    }
+    munmap(map, bytes);
+    auto shared = std::make_shared<shared_arrays>();
+    shared->name = name;
+    return shared;
+}
+
+/**
+ * @brief Shared memory copy of the fof (`which` = 0) or labels (1) reply of a catalog.
+ *
+ * The copy is made by the first request and kept with the catalog, so later requests for it hand out
+ * the same object. If the catalog was replaced meanwhile, a copy of this request only is made.
+ */
+std::shared_ptr<const shared_arrays> share_catalog_reply(resident_snapshot &snap,
+                                                         const std::shared_ptr<const group_catalog> &catalog,
+                                                         size_t which, const reply &out) {
+    {
+        std::lock_guard<std::mutex> lock(snap.catalog_mutex);
+        if (snap.catalog == catalog && snap.catalog_shared[which]) return snap.catalog_shared[which];
+    }
+    // Copied outside the lock, so that requests of other catalog arrays do not wait
+    auto shared = share_reply(out);
+    std::lock_guard<std::mutex> lock(snap.catalog_mutex);
+    if (snap.catalog != catalog) return shared;
+    if (!snap.catalog_shared[which]) snap.catalog_shared[which] = shared;
+    return snap.catalog_shared[which];
+}
+
+reply handle_request(server_state &state, uint16_t op, const std::vector<char> &args) {
+    if (op == OP_LOAD) return handle_load(state, args);
+    if (op == OP_UNLOAD) return handle_unload(state, args);
+
+    request_reader in{args};
+    const auto snap = find_snapshot(state, in.get<uint64_t>());
+    reply out;
+    out.owners.push_back(snap);  // Keeps the snapshot alive even if unloaded meanwhile
+
+    if (op == OP_FOF || op == OP_LABELS) {
+        const auto catalog = snapshot_catalog(*snap, in.get<double>());
+        out.owners.push_back(catalog);
+        if (op == OP_FOF) {
+            out.add(catalog->offsets.data(), catalog->offsets.size());
+            out.add(catalog->members.data(), catalog->members.size());
+        } else {
+            out.add(catalog->labels.data(), catalog->labels.size());
+        }
+        if (out.bytes() > INLINE_BYTES) {
+            out.shared = share_catalog_reply(*snap, catalog, op == OP_FOF ? 0 : 1, out);
+        }
+    } else if (op == OP_BALL) {
+        const double boxsize = snap->header.boxsize;
+        double centre[3];
+        for (auto &x : centre) x = in.get<double>() / boxsize;
+        const double radius = in.get<double>() / boxsize;
+        std::vector<uint64_t> indices;
+        snap->tree->ball_query(centre, radius, [&](size_t k, double) { indices.push_back(snap->tree->index(k)); });
+        std::sort(indices.begin(), indices.end());
+        out.add(std::move(indices));
+    } else if (op == OP_HALO) {
+        const auto catalog = snapshot_catalog(*snap, in.get<double>());
+        const double boxsize = snap->header.boxsize;
+        const double *mass = snap->mass.empty() ? nullptr : snap->mass.data();
+        halo_properties props = compute_halo_properties(*catalog, snap->pos.data(), snap->vel.data(), mass, 3,
+                                                        snap->header.massarr[1], 1.);
+        for (auto &x : props.com) x *= boxsize;
+        for (auto &r : props.extent) r *= boxsize;
+        out.add(std::move(props.npart));
+        out.add(std::move(props.mass));
+        out.add(std::move(props.com));
+        out.add(std::move(props.vel));
+        out.add(std::move(props.sigma_v));
+        out.add(std::move(props.extent));
+    } else {
+        throw request_error(REPLY_BAD_REQUEST, "unknown operation " + std::to_string(op));
+    }
+    return out;
+}
+
+/// Serve one client until it disconnects.
+void serve_connection(int fd, server_state &state, const server_options &opt) {
+#ifdef _OPENMP
+    if (opt.threads > 0) {
+        omp_set_num_threads(opt.threads);
+    }
+#endif
+    std::shared_ptr<const shared_arrays> shared;  // Shared memory of the last reply, kept until the client moved on
+    std::vector<char> args;
+    request_header request;
+    while (read_all(fd, &request, sizeof(request))) {
+        shared.reset();
+
+        reply_header header = {PROTOCOL_MAGIC, REPLY_OK, 0, 0, 0};
+        std::string message;
+        reply out;
+        if (request.magic != PROTOCOL_MAGIC || request.version != PROTOCOL_VERSION ||
+            request.size > MAX_REQUEST_BYTES) {
+            // The stream cannot be trusted past a bad header
+            header.status = REPLY_BAD_REQUEST;
+            message = "bad request header";
+            header.size = message.size();
+            write_all(fd, &header, sizeof(header));
+            write_all(fd, message.data(), message.size());
+            break;
+        }
+        args.resize(request.size);
+        if (!read_all(fd, args.data(), args.size())) {
+            break;
+        }
+
+        try {
+            out = handle_request(state, request.op, args);
+        } catch (const request_error &e) {
+            header.status = e.status;
+            message = e.what();
+        } catch (const std::bad_alloc &) {
+            header.status = REPLY_ERROR;
+            message = "out of memory";
+        } catch (const std::exception &e) {
+            header.status = REPLY_ERROR;
+            message = e.what();
+        }
+
+        if (header.status == REPLY_OK && out.bytes() > INLINE_BYTES) {
+            try {
+                shared = out.shared ? out.shared : share_reply(out);
+                header.shared = 1;
+            } catch (const request_error &e) {
+                header.status = e.status;
+                message = e.what();
+            }
+        }
+
+        bool sent;
+        if (header.status != REPLY_OK) {
+            header.size = message.size();
+            sent = write_all(fd, &header, sizeof(header)) && write_all(fd, message.data(), message.size());
+        } else {
+            header.narrays = static_cast<uint8_t>(out.counts.size());
+            header.size = 8 * out.counts.size() + (header.shared ? shared->name.size() : out.bytes());
+            sent = write_all(fd, &header, sizeof(header)) &&
+                   write_all(fd, out.counts.data(), 8 * out.counts.size());
+            if (header.shared) {
+                sent = sent && write_all(fd, shared->name.data(), shared->name.size());
+            } else {
+                for (size_t a = 0; sent && a < out.data.size(); ++a) {
+                    sent = write_all(fd, out.data[a], 8 * out.counts[a]);
+                }
+            }
+        }
+        if (!sent) {
+            break;
+        }
+    }
+    close(fd);
+}
+
+/// Create the listening socket, refusing to take over the one of a running server.
+int listen_on(const std::string &path) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    const int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    const bool running = probe >= 0 && connect(probe, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0;
+    if (probe >= 0) close(probe);
+    if (running) {
+        std::cerr << "A server is already listening on " << path << "\n";
+        return -1;
+    }
+    unlink(path.c_str());
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    const mode_t mask = umask(0077);  // Only the owner may connect
+    const bool bound = fd >= 0 && bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0;
+    umask(mask);
+    if (!bound || listen(fd, 16) != 0) {
+        std::cerr << "Cannot listen on " << path << ": " << std::strerror(errno) << "\n";
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+} // End of anonymous namespace
+
+int main(int argc, char **argv) {
+    server_options opt;
+    const int parsed = parse_options(argc, argv, opt);
+    if (parsed != 0) {
+        print_usage(argv[0]);
+        return parsed < 0 ? 0 : 1;
+    }
+#ifdef _OPENMP
+    if (opt.threads > 0) {
+        omp_set_num_threads(opt.threads);
+    }
+#endif
+    if (opt.huge_pages) {
+        set_huge_pages(true);
+    }
+
+    std::snprintf(shared_prefix, sizeof(shared_prefix), "/ygg-%ld-", static_cast<long>(getpid()));
+
+    server_state state;
+    for (auto const &path : opt.snapshots) {
+        try {
+            handle_load(state, std::vector<char>(path.begin(), path.end()));
+        } catch (const std::exception &e) {
+            std::cerr << "Error in loading " << path << ": " << e.what() << "\n";
+            return 1;
+        }
+    }
+
+    const int listener = listen_on(opt.socket_path);
+    if (listener < 0) {
+        return 1;
+    }
+    std::strncpy(socket_to_remove, opt.socket_path.c_str(), sizeof(socket_to_remove) - 1);
+    std::signal(SIGINT, remove_socket_and_exit);
+    std::signal(SIGTERM, remove_socket_and_exit);
+    std::signal(SIGPIPE, SIG_IGN);
+    std::cout << "Listening on " << opt.socket_path << std::endl;
+
+    // One thread per client; snapshots are shared and immutable once loaded
+    while (true) {
+        const int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "accept: " << std::strerror(errno) << "\n";
+            break;
+        }
+        std::thread(serve_connection, fd, std::ref(state), std::cref(opt)).detach();
+    }
+    close(listener);
+    unlink(opt.socket_path.c_str());
+    return 1;
+}
@@ -0,0 +1,40 @@
+#include "attach.hpp"
+#include "periodic.hpp"
+
+#include <algorithm>
+
+// Typedef for convenience
+typedef std::size_t size_t;
+
+namespace {
+
+/// Number of consecutive particles handed to a thread at a time.
+const size_t ATTACH_BATCH = 256;
+
+} // End of anonymous namespace
+
+// Batched, hinted nearest-neighbour queries against the labelled index
+std::vector<std::int64_t> attach_to_nearest(const kd_tree3 &tree, const first_touch_vector<std::int64_t> &labels,
+                                            const double *pos, size_t npts, double max_distance) {
+    std::vector<std::int64_t> out(npts, -1);
+    const double max2 = max_distance > 0. ? max_distance * max_distance : HUGE_VAL;
+    const double boxsize = tree.boxsize();
+    const size_t nbatches = (npts + ATTACH_BATCH - 1) / ATTACH_BATCH;
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (long b = 0; b < static_cast<long>(nbatches); ++b) {
+        const size_t begin = b * ATTACH_BATCH, end = std::min(npts, begin + ATTACH_BATCH);
+        size_t hint = tree.size();
+        for (size_t i = begin; i < end; ++i) {
+            double x[3], d2;
+            for (size_t d = 0; d < 3; ++d) x[d] = periodic_wrap(pos[i * 3 + d], boxsize);
+            const size_t k = tree.nearest(x, d2, hint);
+            if (k < tree.size()) {
+                hint = k;
+                if (d2 <= max2) out[i] = labels[tree.index(k)];
+            }
+        }
+    }
+
+    return out;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "kdtree.hpp"
+#include "memory.hpp"
+
+/**
+ * @brief Assign particles to the group of their nearest indexed particle.
+ *
+ * This is how gas, stars and black holes are attached to groups found by running FoF on the dark
+ * matter only: a nearest-neighbour query against the dark-matter index (periodic if the index is)
+ * replaces a second FoF pass over the much larger mixed particle set. Queries are processed in
+ * parallel in batches of consecutive particles; within a batch each query starts from the previous
+ * answer, which is close for snapshots stored in a space-filling-curve order such as Gadget's.
+ *
+ * @param tree Index over the particles that carry the labels (e.g. dark matter).
+ * @param labels Group of every indexed particle, indexed like the input of the tree, -1 if ungrouped.
+ * @param pos Pointer to the positions of the particles to attach, three contiguous values each.
+ * @param npts Number of particles to attach.
+ * @param max_distance Particles farther than this from every indexed particle are left unassigned;
+ *                     non-positive values disable the limit.
+ * @return std::vector<std::int64_t> Group of every attached particle, -1 when unassigned.
+ */
+std::vector<std::int64_t> attach_to_nearest(const kd_tree3 &tree, const first_touch_vector<std::int64_t> &labels,
+                                            const double *pos, std::size_t npts, double max_distance);
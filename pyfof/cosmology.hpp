@@ -0,0 +1,71 @@
+#pragma once
+#include <cmath>
+#include <stdexcept>
+
+/**
+ * @brief Background cosmology of a snapshot, as stored in the Gadget-2 header.
+ *
+ * The fields map one to one onto `Header::om0`, `Header::oml`, `Header::h` and `Header::redshift`.
+ * Lengths and masses follow the Gadget convention of comoving kpc/h and 1e10 Msun/h scaled by
+ * `length_unit` and `mass_unit`, so that h cancels out of the densities below. The density
+ * parameters and redshift have no default: they must come from the snapshot being analysed.
+ */
+struct cosmology {
+    double om0;                ///< Matter density parameter today.
+    double oml;                ///< Dark-energy (cosmological constant) density parameter today.
+    double h;                  ///< Hubble parameter in units of 100 km/s/Mpc.
+    double redshift;           ///< Redshift of the snapshot.
+    double length_unit = 1.;   ///< Position unit in comoving kpc/h (e.g. the box size when positions are normalised).
+    double mass_unit = 1.;     ///< Mass unit in 1e10 Msun/h.
+};
+
+/// Critical density today in 1e10 Msun/h / (kpc/h)^3, i.e. 3 H0^2 / (8 pi G).
+const double RHO_CRIT0_GADGET = 2.77536627e-8;
+
+/**
+ * @brief Dimensionless Hubble rate squared, E^2(z) = H^2(z) / H0^2.
+ */
+inline double hubble_e2(const cosmology &c) {
+    const double a1 = 1. + c.redshift;
+    const double ok = 1. - c.om0 - c.oml;
+    return c.om0 * a1 * a1 * a1 + ok * a1 * a1 + c.oml;
+}
+
+/**
+ * @brief Matter density parameter at the snapshot redshift.
+ */
+inline double omega_m(const cosmology &c) {
+    const double a1 = 1. + c.redshift;
+    return c.om0 * a1 * a1 * a1 / hubble_e2(c);
+}
+
+/**
+ * @brief Critical density at the snapshot redshift expressed per comoving volume, in code units.
+ *
+ * A sphere of comoving radius r enclosing mass M has a mean physical density above Delta times the
+ * critical density exactly when M / (4/3 pi r^3) exceeds Delta times this value.
+ */
+inline double critical_density_comoving(const cosmology &c) {
+    const double a1 = 1. + c.redshift;
+    const double l3 = c.length_unit * c.length_unit * c.length_unit;
+    return RHO_CRIT0_GADGET * l3 / c.mass_unit * hubble_e2(c) / (a1 * a1 * a1);
+}
+
+/**
+ * @brief Virial overdensity relative to critical from the Bryan & Norman (1998) fit.
+ *
+ * The fit exists for flat models with a cosmological constant and for open models without one.
+ *
+ * @throws std::invalid_argument For any other model.
+ */
+inline double delta_vir_bryan_norman(const cosmology &c) {
+    const double x = omega_m(c) - 1.;
+    if (std::fabs(c.om0 + c.oml - 1.) < 1e-6) {
+        return 18. * M_PI * M_PI + 82. * x - 39. * x * x;
+    }
+    if (c.oml == 0.) {
+        return 18. * M_PI * M_PI + 60. * x - 32. * x * x;
+    }
+    throw std::invalid_argument("the Bryan & Norman virial overdensity needs a flat model or one without "
+                                "a cosmological constant");
+}
@@ -0,0 +1,240 @@
+#pragma once
+#include <cstdlib>
+
+/**
+ * @file engine_calibration.hpp
+ * @brief Fastest engine measured per data shape, read by `select_engine`.
+ *
+ * Generated by `ygg-bench --calibrate` with 1 thread(s) on a machine with 1 processor(s);
+ * run it again on the target machine, with its thread counts (e.g. `--threads 1,16,64`), to refresh the table.
+ * Runs with a thread count more than twice away from every entry do not use the table.
+ */
+
+/// Fastest configuration measured for one data shape.
+struct calibration_entry {
+    int nthreads;              ///< OpenMP threads of the measurement.
+    std::size_t ndim;          ///< Dimensionality of the points.
+    double log10_npts;         ///< Decimal logarithm of the number of points.
+    double log10_neighbours;   ///< Decimal logarithm of the mean neighbour count within the linking length.
+    const char *engine;        ///< Fastest engine.
+    std::size_t leaf_size;     ///< Fastest kd-tree leaf size, when the engine is "kdtree".
+};
+
+static const calibration_entry ENGINE_CALIBRATION[] = {
+    {1, 1, 3, -0.333699, "grid", 16},
+    {1, 1, 3, -0.0127743, "grid", 16},
+    {1, 1, 3, 0.271741, "grid", 16},
+    {1, 2, 3, -0.884607, "grid", 16},
+    {1, 2, 3, -0.139879, "grid", 16},
+    {1, 2, 3, 0.442184, "grid", 16},
+    {1, 3, 3, -2, "kdtree", 32},
+    {1, 3, 3, -0.270647, "grid", 16},
+    {1, 3, 3, 0.642594, "rtree", 16},
+    {1, 4, 3, -2, "kdtree", 16},
+    {1, 4, 3, -0.294781, "kdtree", 16},
+    {1, 4, 3, 0.711379, "rtree", 16},
+    {1, 5, 3, -2, "kdtree", 16},
+    {1, 5, 3, -0.838849, "kdtree", 16},
+    {1, 5, 3, 0.680979, "brute", 16},
+    {1, 6, 3, -2, "kdtree", 16},
+    {1, 6, 3, -1.13988, "kdtree", 8},
+    {1, 6, 3, 0.747738, "brute", 16},
+    {1, 1, 4, -0.522879, "grid", 16},
+    {1, 1, 4, 0, "grid", 16},
+    {1, 1, 4, 0.30103, "grid", 16},
+    {1, 2, 4, -2, "grid", 16},
+    {1, 2, 4, 0.0791812, "grid", 16},
+    {1, 2, 4, 0.477121, "grid", 16},
+    {1, 3, 4, -2, "grid", 16},
+    {1, 3, 4, -0.30103, "grid", 16},
+    {1, 3, 4, 0.662758, "grid", 16},
+    {1, 4, 4, -2, "rtree", 16},
+    {1, 4, 4, -0.69897, "kdtree", 16},
+    {1, 4, 4, 0.740363, "rtree", 16},
+    {1, 5, 4, -2, "kdtree", 16},
+    {1, 5, 4, -1, "kdtree", 32},
+    {1, 5, 4, 0.755875, "kdtree", 32},
+    {1, 6, 4, -2, "kdtree", 32},
+    {1, 6, 4, -2, "kdtree", 32},
+    {1, 6, 4, 0.716003, "kdtree", 32},
+    {1, 1, 5, -0.360526, "grid", 16},
+    {1, 1, 5, 0.241534, "grid", 16},
+    {1, 1, 5, 0.417625, "grid", 16},
+    {1, 2, 5, -2, "grid", 16},
+    {1, 2, 5, -0.0594958, "grid", 16},
+    {1, 2, 5, 0.417625, "grid", 16},
+    {1, 3, 5, -2, "grid", 16},
+    {1, 3, 5, -0.184435, "grid", 16},
+    {1, 3, 5, 0.452388, "grid", 16},
+    {1, 4, 5, -2, "kdtree", 16},
+    {1, 4, 5, -0.360526, "kdtree", 32},
+    {1, 4, 5, 0.593717, "rtree", 16},
+    {1, 5, 5, -2, "kdtree", 32},
+    {1, 5, 5, -2, "kdtree", 32},
+    {1, 5, 5, 0.660663, "kdtree", 32},
+    {1, 6, 5, -2, "kdtree", 32},
+    {1, 6, 5, -2, "kdtree", 32},
+    {1, 6, 5, 0.593717, "kdtree", 32},
+    {1, 1, 6, -0.307816, "grid", 16},
+    {1, 1, 6, -0.307816, "grid", 16},
+    {1, 1, 6, 0.391154, "grid", 16},
+    {1, 2, 6, -2, "kdtree", 32},
+    {1, 2, 6, -0.307816, "grid", 16},
+    {1, 2, 6, 0.595274, "grid", 16},
+    {1, 3, 6, -2, "grid", 16},
+    {1, 3, 6, -0.608846, "grid", 16},
+    {1, 3, 6, 0.537282, "grid", 16},
+    {1, 4, 6, -2, "kdtree", 16},
+    {1, 4, 6, -0.307816, "kdtree", 16},
+    {1, 4, 6, 0.752882, "rtree", 16},
+    {1, 5, 6, -2, "kdtree", 16},
+    {1, 5, 6, -0.608846, "kdtree", 32},
+    {1, 5, 6, 0.789094, "kdtree", 32},
+    {1, 6, 6, -2, "kdtree", 16},
+    {1, 6, 6, -2, "kdtree", 32},
+    {1, 6, 6, 0.752882, "kdtree", 32},
+    {1, 1, 3, 0.913967, "grid", 16},
+    {1, 1, 3, 1.31191, "grid", 16},
+    {1, 1, 3, 1.61782, "grid", 16},
+    {1, 2, 3, 1.79178, "rtree", 16},
+    {1, 2, 3, 2.48057, "brute", 16},
+    {1, 2, 3, 2.7849, "brute", 16},
+    {1, 3, 3, 2.49152, "brute", 16},
+    {1, 3, 3, 2.85604, "brute", 16},
+    {1, 3, 3, 2.85997, "brute", 16},
+    {1, 4, 3, 2.69663, "rtree", 16},
+    {1, 4, 3, 2.78969, "rtree", 16},
+    {1, 4, 3, 2.79035, "brute", 16},
+    {1, 5, 3, 2.82925, "brute", 16},
+    {1, 5, 3, 2.84209, "brute", 16},
+    {1, 5, 3, 2.84356, "brute", 16},
+    {1, 6, 3, 2.86297, "brute", 16},
+    {1, 6, 3, 2.86417, "brute", 16},
+    {1, 6, 3, 2.86422, "brute", 16},
+    {1, 1, 4, 0.146128, "grid", 16},
+    {1, 1, 4, 0.544068, "grid", 16},
+    {1, 1, 4, 0.908485, "grid", 16},
+    {1, 2, 4, 1.08279, "rtree", 16},
+    {1, 2, 4, 1.81291, "rtree", 16},
+    {1, 2, 4, 2.3638, "rtree", 16},
+    {1, 3, 4, 2.02531, "rtree", 16},
+    {1, 3, 4, 2.90703, "rtree", 16},
+    {1, 3, 4, 3.15694, "rtree", 16},
+    {1, 4, 4, 2.35044, "rtree", 16},
+    {1, 4, 4, 3.03503, "rtree", 16},
+    {1, 4, 4, 3.04261, "rtree", 16},
+    {1, 5, 4, 2.77078, "kdtree", 64},
+    {1, 5, 4, 3.04759, "kdtree", 64},
+    {1, 5, 4, 3.04778, "kdtree", 64},
+    {1, 6, 4, 3.07273, "kdtree", 64},
+    {1, 6, 4, 3.10452, "kdtree", 64},
+    {1, 6, 4, 3.10483, "kdtree", 64},
+    {1, 1, 5, -0.184435, "grid", 16},
+    {1, 1, 5, 0.292687, "grid", 16},
+    {1, 1, 5, 0.417625, "grid", 16},
+    {1, 2, 5, -0.0594958, "grid", 16},
+    {1, 2, 5, 0.753418, "grid", 16},
+    {1, 2, 5, 1.35128, "grid", 16},
+    {1, 3, 5, 0.882512, "rtree", 16},
+    {1, 3, 5, 2.03129, "rtree", 16},
+    {1, 3, 5, 2.73307, "rtree", 16},
+    {1, 4, 5, 1.66886, "rtree", 16},
+    {1, 4, 5, 2.85445, "rtree", 16},
+    {1, 4, 5, 3.11091, "rtree", 16},
+    {1, 5, 5, 2.17855, "kdtree", 64},
+    {1, 5, 5, 3.04661, "kdtree", 64},
+    {1, 5, 5, 3.06239, "kdtree", 64},
+    {1, 6, 5, 2.72028, "kdtree", 64},
+    {1, 6, 5, 3.12342, "kdtree", 64},
+    {1, 6, 5, 3.12363, "kdtree", 32},
+    {1, 1, 6, -2, "grid", 16},
+    {1, 1, 6, 0.345397, "grid", 16},
+    {1, 1, 6, 0.470336, "grid", 16},
+    {1, 2, 6, -2, "grid", 16},
+    {1, 2, 6, 0.0901245, "grid", 16},
+    {1, 2, 6, 0.909668, "grid", 16},
+    {1, 3, 6, -0.00678556, "kdtree", 32},
+    {1, 3, 6, 1.19733, "grid", 16},
+    {1, 3, 6, 2.06785, "grid", 16},
+    {1, 4, 6, 0.806128, "rtree", 16},
+    {1, 4, 6, 2.23934, "rtree", 16},
+    {1, 4, 6, 2.97898, "rtree", 16},
+    {1, 5, 6, 1.49836, "kdtree", 32},
+    {1, 5, 6, 2.8867, "kdtree", 64},
+    {1, 5, 6, 3.10707, "kdtree", 64},
+    {1, 6, 6, 2.01129, "kdtree", 64},
+    {1, 6, 6, 3.10397, "kdtree", 64},
+    {1, 6, 6, 3.12731, "kdtree", 32},
+    {1, 1, 3, 0.537728, "grid", 16},
+    {1, 1, 3, 0.927564, "grid", 16},
+    {1, 1, 3, 1.20959, "grid", 16},
+    {1, 2, 3, 1.27709, "rtree", 16},
+    {1, 2, 3, 1.92912, "brute", 16},
+    {1, 2, 3, 2.39438, "brute", 16},
+    {1, 3, 3, 2.00792, "brute", 16},
+    {1, 3, 3, 2.76925, "brute", 16},
+    {1, 3, 3, 2.99562, "brute", 16},
+    {1, 4, 3, 2.40656, "brute", 16},
+    {1, 4, 3, 2.98122, "brute", 16},
+    {1, 4, 3, 2.99957, "brute", 16},
+    {1, 5, 3, 2.38173, "brute", 16},
+    {1, 5, 3, 2.9981, "brute", 16},
+    {1, 5, 3, 2.99957, "brute", 16},
+    {1, 6, 3, 2.67675, "brute", 16},
+    {1, 6, 3, 2.99957, "brute", 16},
+    {1, 6, 3, 2.99957, "brute", 16},
+    {1, 1, 4, 0.0413927, "grid", 16},
+    {1, 1, 4, 0.447158, "grid", 16},
+    {1, 1, 4, 0.763428, "grid", 16},
+    {1, 2, 4, 0.322219, "rtree", 16},
+    {1, 2, 4, 1.10037, "rtree", 16},
+    {1, 2, 4, 1.6637, "rtree", 16},
+    {1, 3, 4, 1.24797, "rtree", 16},
+    {1, 3, 4, 2.05881, "rtree", 16},
+    {1, 3, 4, 2.66521, "rtree", 16},
+    {1, 4, 4, 1.89597, "rtree", 16},
+    {1, 4, 4, 2.76477, "rtree", 16},
+    {1, 4, 4, 3.23596, "rtree", 16},
+    {1, 5, 4, 2.07737, "kdtree", 64},
+    {1, 5, 4, 2.89143, "kdtree", 64},
+    {1, 5, 4, 3.48742, "brute", 16},
+    {1, 6, 4, 2.3934, "kdtree", 64},
+    {1, 6, 4, 3.15217, "kdtree", 64},
+    {1, 6, 4, 3.57874, "brute", 16},
+    {1, 1, 5, -0.360526, "grid", 16},
+    {1, 1, 5, 0.292687, "grid", 16},
+    {1, 1, 5, 0.542564, "grid", 16},
+    {1, 2, 5, -0.661556, "grid", 16},
+    {1, 2, 5, 0.241534, "grid", 16},
+    {1, 2, 5, 0.991657, "grid", 16},
+    {1, 3, 5, 0.815565, "rtree", 16},
+    {1, 3, 5, 1.54256, "rtree", 16},
+    {1, 3, 5, 2.17159, "rtree", 16},
+    {1, 4, 5, 1.29269, "rtree", 16},
+    {1, 4, 5, 2.13916, "rtree", 16},
+    {1, 4, 5, 2.79708, "rtree", 16},
+    {1, 5, 5, 1.68284, "kdtree", 32},
+    {1, 5, 5, 2.58642, "kdtree", 64},
+    {1, 5, 5, 3.24586, "kdtree", 64},
+    {1, 6, 5, 2.01054, "kdtree", 32},
+    {1, 6, 5, 2.88264, "kdtree", 32},
+    {1, 6, 5, 3.47716, "kdtree", 64},
+    {1, 1, 6, -2, "grid", 16},
+    {1, 1, 6, -0.608846, "grid", 16},
+    {1, 1, 6, 0.294244, "grid", 16},
+    {1, 2, 6, -0.608846, "grid", 16},
+    {1, 2, 6, -0.307816, "grid", 16},
+    {1, 2, 6, 0.391154, "grid", 16},
+    {1, 3, 6, -0.00678556, "rtree", 16},
+    {1, 3, 6, 0.752882, "rtree", 16},
+    {1, 3, 6, 1.48458, "rtree", 16},
+    {1, 4, 6, 0.537282, "rtree", 16},
+    {1, 4, 6, 1.55551, "rtree", 16},
+    {1, 4, 6, 2.26097, "rtree", 16},
+    {1, 5, 6, 1.22366, "kdtree", 16},
+    {1, 5, 6, 2.15383, "kdtree", 32},
+    {1, 5, 6, 2.79273, "kdtree", 32},
+    {1, 6, 6, 1.663, "kdtree", 32},
+    {1, 6, 6, 2.49666, "kdtree", 32},
+    {1, 6, 6, 3.15481, "kdtree", 32},
+};
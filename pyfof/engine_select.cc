@@ -0,0 +1,167 @@
+#include "engine_select.hpp"
+#include "engine_calibration.hpp"
+#include "fof.hpp"
+#include "fof_brute.hpp"
+#include "fof_grid.hpp"
+#include "fof_kdtree.hpp"
+#include "periodic.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Typedef for convenience
+typedef std::size_t size_t;
+
+namespace {
+
+/// Smallest neighbour count used in the logarithmic distance, so that isolated points stay comparable.
+const double MIN_NEIGHBOURS = 0.01;
+
+/// Largest dimension each engine handles.
+size_t max_dimension(const std::string &engine) {
+    if (engine == "grid") return 3;
+    if (engine == "rtree") return 4;
+    if (engine == "kdtree") return 6;
+    return static_cast<size_t>(-1);
+}
+
+template <size_t D>
+group_catalog kdtree_friends_of_friends(const double *data, size_t npts, double linking_length, double boxsize,
+                                        size_t leaf_size, fof_stats *stats) {
+    const kd_tree<D> tree(data, npts, boxsize, leaf_size, stats);
+    return friends_of_friends_kdtree(tree, linking_length, stats);
+}
+
+} // End of anonymous namespace
+
+// Bounding box over all points, neighbour count over strided samples
+data_shape sample_data_shape(const double *data, size_t npts, size_t ndim, double linking_length, double boxsize,
+                             size_t nsample) {
+    data_shape shape = {npts, ndim, boxsize, 0., 0., 1};
+#ifdef _OPENMP
+    shape.nthreads = omp_get_max_threads();
+#endif
+    if (npts == 0 || ndim == 0) {
+        return shape;
+    }
+
+    if (boxsize > 0.) {
+        shape.extent = boxsize;
+    } else {
+        for (size_t d = 0; d < ndim; ++d) {
+            double lo = data[d], hi = data[d];
+            for (size_t i = 1; i < npts; ++i) {
+                lo = std::min(lo, data[i * ndim + d]);
+                hi = std::max(hi, data[i * ndim + d]);
+            }
+            shape.extent = std::max(shape.extent, hi - lo);
+        }
+    }
+
+    // Keep the count within a few distances per point, so that sampling never dominates small runs
+    size_t ncentres = std::max<size_t>(1, std::min(npts, nsample));
+    const size_t nsubset = std::min(npts, 64 * ncentres);
+    ncentres = std::max<size_t>(1, std::min(ncentres, (4 * npts + 65536) / nsubset));
+    const double b2 = linking_length * linking_length;
+    size_t friends = 0;
+    for (size_t c = 0; c < ncentres; ++c) {
+        const size_t i = c * npts / ncentres;
+        for (size_t s = 0; s < nsubset; ++s) {
+            const size_t j = s * npts / nsubset;
+            if (j == i) {
+                continue;
+            }
+            double d2 = 0.;
+            for (size_t d = 0; d < ndim; ++d) {
+                const double dx = periodic_delta(data[j * ndim + d] - data[i * ndim + d], boxsize);
+                d2 += dx * dx;
+            }
+            friends += d2 < b2;
+        }
+    }
+    shape.mean_neighbours = static_cast<double>(friends) / ncentres * static_cast<double>(npts - 1) /
+                            std::max<size_t>(1, nsubset - 1);
+    return shape;
+}
+
+// Nearest calibrated shape among the entries of the closest thread count and dimension
+engine_config select_engine(const data_shape &shape) {
+    const double log_n = std::log10(std::max<double>(1., shape.npts));
+    const double log_nb = std::log10(std::max(MIN_NEIGHBOURS, shape.mean_neighbours));
+    engine_config config = {"kdtree", 16};
+
+    // Thread counts are compared by ratio; beyond a factor of two the table is not used
+    const double log_threads = std::log2(std::max(1, shape.nthreads));
+    int best_threads = 0;
+    double best_thread_gap = HUGE_VAL;
+    for (auto const &entry : ENGINE_CALIBRATION) {
+        const double gap = std::fabs(std::log2(std::max(1, entry.nthreads)) - log_threads);
+        if (gap < best_thread_gap) {
+            best_thread_gap = gap;
+            best_threads = entry.nthreads;
+        }
+    }
+    if (best_thread_gap > 1.) {
+        if (shape.ndim > max_dimension(config.engine)) config.engine = "brute";
+        return config;
+    }
+
+    size_t best_dim = 0;
+    for (auto const &entry : ENGINE_CALIBRATION) {
+        if (entry.nthreads != best_threads) continue;
+        const size_t gap = entry.ndim > shape.ndim ? entry.ndim - shape.ndim : shape.ndim - entry.ndim;
+        const size_t best_gap = best_dim > shape.ndim ? best_dim - shape.ndim : shape.ndim - best_dim;
+        if (best_dim == 0 || gap < best_gap) best_dim = entry.ndim;
+    }
+
+    double best = HUGE_VAL;
+    for (auto const &entry : ENGINE_CALIBRATION) {
+        if (entry.nthreads != best_threads || entry.ndim != best_dim) {
+            continue;
+        }
+        const double dn = entry.log10_npts - log_n;
+        const double db = entry.log10_neighbours - log_nb;
+        const double distance = dn * dn + db * db;
+        if (distance < best) {
+            best = distance;
+            config.engine = entry.engine;
+            config.leaf_size = entry.leaf_size;
+        }
+    }
+
+    if (shape.ndim > max_dimension(config.engine)) {
+        config.engine = shape.ndim > max_dimension("kdtree") ? "brute" : "kdtree";
+    }
+    return config;
+}
+
+// Dispatch on the engine name and, for the kd-tree, on the dimension
+group_catalog friends_of_friends_engine(const engine_config &config, double *data, size_t npts, size_t ndim,
+                                        double linking_length, double boxsize, fof_stats *stats) {
+    if (config.engine == "grid") {
+        return friends_of_friends_grid(data, npts, ndim, linking_length, boxsize, config.bits, stats);
+    }
+    if (config.engine == "rtree") {
+        return friends_of_friends_catalog(data, npts, ndim, linking_length, boxsize, stats);
+    }
+    if (config.engine == "brute") {
+        return friends_of_friends_brute_catalog(data, npts, ndim, linking_length, boxsize, stats);
+    }
+    if (config.engine == "kdtree") {
+        switch (ndim) {
+            case 1: return kdtree_friends_of_friends<1>(data, npts, linking_length, boxsize, config.leaf_size, stats);
+            case 2: return kdtree_friends_of_friends<2>(data, npts, linking_length, boxsize, config.leaf_size, stats);
+            case 3: return kdtree_friends_of_friends<3>(data, npts, linking_length, boxsize, config.leaf_size, stats);
+            case 4: return kdtree_friends_of_friends<4>(data, npts, linking_length, boxsize, config.leaf_size, stats);
+            case 5: return kdtree_friends_of_friends<5>(data, npts, linking_length, boxsize, config.leaf_size, stats);
+            case 6: return kdtree_friends_of_friends<6>(data, npts, linking_length, boxsize, config.leaf_size, stats);
+            default: throw std::invalid_argument("the kd-tree engine supports 1 to 6 dimensions");
+        }
+    }
+    throw std::invalid_argument("unknown engine " + config.engine);
+}
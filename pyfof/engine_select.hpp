@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdlib>
+#include <string>
+
+#include "groups.hpp"
+#include "stats.hpp"
+
+/**
+ * @brief Shape of a data set, as seen by the engine selection.
+ */
+struct data_shape {
+    std::size_t npts;          ///< Number of points.
+    std::size_t ndim;          ///< Dimensionality of the points.
+    double boxsize;            ///< Side of the periodic box, non-positive for open boundaries.
+    double extent;             ///< Largest side of the bounding box, or the box side when periodic.
+    double mean_neighbours;    ///< Estimated mean number of other points within one linking length.
+    int nthreads;              ///< OpenMP threads the run will use.
+};
+
+/**
+ * @brief Engine and index parameters for one run.
+ */
+struct engine_config {
+    std::string engine;        ///< "grid", "kdtree", "rtree" or "brute".
+    std::size_t leaf_size;     ///< Points per kd-tree leaf; unused by the other engines.
+    unsigned bits = 32;        ///< Significant bits per fixed-point coordinate of the grid engine.
+};
+
+/**
+ * @brief Measure the shape of a data set on a sample of its points.
+ *
+ * The bounding box is taken over every point. The neighbour count is estimated by counting, for
+ * up to `nsample` evenly strided centres, the friends among an evenly strided subset of at most 64
+ * times as many points, and scaling by the subset fraction; clustered data therefore report their
+ * actual crowding rather than the mean density. Fewer centres are used when that would cost more
+ * than about four distances per point. The thread count is `omp_get_max_threads()`.
+ *
+ * @param data Pointer to the coordinates, `ndim` contiguous values per point.
+ * @param npts Number of points.
+ * @param ndim Dimensionality of the points.
+ * @param linking_length The linking length of the run.
+ * @param boxsize Side of the periodic box; non-positive values disable periodic boundaries.
+ * @param nsample Number of centres of the neighbour count.
+ * @return data_shape The measured shape.
+ */
+data_shape sample_data_shape(const double *data, std::size_t npts, std::size_t ndim, double linking_length,
+                             double boxsize = 0., std::size_t nsample = 256);
+
+/**
+ * @brief Pick the engine and leaf size for a data set from the calibration table.
+ *
+ * The table (engine_calibration.hpp, regenerated on the target machine by `ygg-bench --calibrate`)
+ * holds the fastest configuration measured for a set of thread counts, dimensions, sizes and neighbour
+ * counts. The entry nearest to `shape` in log N and log neighbour count is used, among those of the
+ * closest thread count and dimension; engines that do not support the dimension fall back to the
+ * kd-tree, or to brute force beyond six dimensions. When no entry was measured within a factor of two
+ * of `shape.nthreads`, the table does not describe this machine (e.g. a single-core table on a
+ * multicore node, where the serial grid linking would be picked over the parallel engines) and the
+ * kd-tree is used.
+ *
+ * @param shape Shape of the data, from `sample_data_shape`.
+ * @return engine_config The selected configuration.
+ */
+engine_config select_engine(const data_shape &shape);
+
+/**
+ * @brief Run friends-of-friends with the given engine.
+ *
+ * @param config Engine and leaf size, e.g. from `select_engine`.
+ * @param data Pointer to the coordinates, `ndim` contiguous values per point; not modified.
+ * @param npts Number of points.
+ * @param ndim Dimensionality of the points.
+ * @param linking_length Maximum distance between points to be considered part of the same cluster.
+ * @param boxsize Side of the periodic box; non-positive values disable periodic boundaries.
+ * @param stats Optional statistics, filled by the engine.
+ * @return group_catalog The groups, with the labels of every particle.
+ */
+group_catalog friends_of_friends_engine(const engine_config &config, double *data, std::size_t npts, std::size_t ndim,
+                                        double linking_length, double boxsize = 0., fof_stats *stats = nullptr);
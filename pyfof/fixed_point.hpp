@@ -0,0 +1,80 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+/**
+ * @brief Mapping between coordinates and 32-bit fixed-point integers.
+ *
+ * In a periodic box the side [0, L) is mapped onto the whole 32-bit range, so the difference of two
+ * coordinates taken modulo 2^32 and read as a signed integer is already the minimum image: no
+ * `fabs` and no `d > L/2` branch are needed. With open boundaries the bounding box is mapped onto
+ * [0, 2^31), so that differences never overflow a signed 32-bit integer.
+ *
+ * The caller picks how many of those bits carry information: coordinates are rounded to steps of
+ * `step` and the lower bits are left at zero, which keeps the same integer arithmetic whatever the
+ * resolution. A pair distance is then off by at most sqrt(D) steps.
+ */
+struct fixed_point_frame {
+    bool periodic;               ///< Whether the integer range wraps around the periodic box.
+    unsigned bits;               ///< Significant bits of every coordinate.
+    double unit;                 ///< Length of one integer step, 2^-32 L or 2^-31 of the range when open.
+    double step;                 ///< Quantization step, the length of one significant step.
+    std::vector<double> origin;  ///< Lower corner of the mapped region.
+
+    /**
+     * @brief Set up the mapping for a set of points.
+     *
+     * @param data Pointer to the coordinates, `ndim` contiguous values per point.
+     * @param npts Number of points, used to find the bounding box with open boundaries.
+     * @param ndim Dimensionality of the points.
+     * @param boxsize Side of the periodic box; non-positive values map the bounding box instead.
+     * @param nbits Significant bits per coordinate, clamped to [1, 32] (to [1, 31] with open boundaries).
+     */
+    fixed_point_frame(const double *data, std::size_t npts, std::size_t ndim, double boxsize, unsigned nbits)
+        : periodic(boxsize > 0.), origin(ndim, 0.) {
+        bits = std::min(std::max(nbits, 1u), periodic ? 32u : 31u);
+        if (periodic) {
+            step = std::ldexp(boxsize, -static_cast<int>(bits));
+            unit = std::ldexp(boxsize, -32);
+            return;
+        }
+
+        std::vector<double> hi(ndim, -HUGE_VAL);
+        for (std::size_t d = 0; d < ndim; ++d) origin[d] = npts ? HUGE_VAL : 0.;
+        for (std::size_t i = 0; i < npts; ++i) {
+            for (std::size_t d = 0; d < ndim; ++d) {
+                origin[d] = std::min(origin[d], data[i * ndim + d]);
+                hi[d] = std::max(hi[d], data[i * ndim + d]);
+            }
+        }
+        double extent = 0.;
+        for (std::size_t d = 0; d < ndim && npts; ++d) extent = std::max(extent, hi[d] - origin[d]);
+        if (extent <= 0.) extent = 1.;
+        step = extent / (std::ldexp(1., static_cast<int>(bits)) - 1.);
+        unit = std::ldexp(step, -static_cast<int>(31 - bits));
+    }
+
+    /// Bits of the integer range, 32 when it wraps around the periodic box and 31 otherwise.
+    unsigned range_bits() const { return periodic ? 32u : 31u; }
+
+    /// Fixed-point value of coordinate `x` along dimension `d`.
+    std::uint32_t quantize(double x, std::size_t d) const {
+        const double s = (x - origin[d]) / step;
+        if (periodic) {
+            // Wrap into the box first; the rounded value of L itself wraps to zero
+            const double n = std::ldexp(1., static_cast<int>(bits));
+            double f = std::fmod(std::nearbyint(s), n);
+            if (f < 0.) f += n;
+            return static_cast<std::uint32_t>(static_cast<std::uint64_t>(f) << (32 - bits));
+        }
+        return static_cast<std::uint32_t>(static_cast<std::uint64_t>(std::nearbyint(s)) << (31 - bits));
+    }
+
+    /// Worst-case error of a pair distance in `ndim` dimensions, relative to the linking length `b`.
+    double resolution_error(std::size_t ndim, double b) const {
+        return b > 0. ? std::sqrt(static_cast<double>(ndim)) * step / b : 0.;
+    }
+};
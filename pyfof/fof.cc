@@ -1,55 +1,39 @@
-#define BOOST_LOG_DYN_LINK 1 // Needed for logging
 #include <iostream>
 #include <vector>
 #include <list>
 #include <cmath>
+#include <cstdint>
+#include <limits>
 #include <unordered_set>
 
 #include <boost/geometry/geometry.hpp>
 #include <boost/geometry/index/rtree.hpp>
 #include <boost/mpl/range_c.hpp>
 #include <boost/mpl/for_each.hpp>
+#include <boost/iterator/function_output_iterator.hpp>
 
-#include <boost/log/trivial.hpp>
-#include <boost/log/utility/setup.hpp>
-#include <boost/log/core/core.hpp>
-#include <boost/log/expressions.hpp>
-#include <chrono>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "fof.hpp"
 #include "fof_brute.hpp"
+#include "groups.hpp"
+#include "stats.hpp"
 
 // Namespace aliases for easier access
 namespace bg = boost::geometry;
 namespace bmpl = boost::mpl;
 namespace bgi = bg::index;
-namespace bl = boost::log;
 
 // Typedef for convenience
 typedef std::size_t size_t;
 
-void init_logging() {
-    // Register a simple formatter factory to allow custom log formatting.
-    bl::register_simple_formatter_factory<boost::log::trivial::severity_level, char>("Severity");
+/// Smallest breadth-first level of a group that is expanded by all threads rather than one.
+const size_t PARALLEL_LEVEL = 512;
 
-    // Add a console log with a simple format that includes timestamp, severity, and the actual message.
-    bl::add_console_log(
-        std::cout,
-        bl::keywords::format = "[%TimeStamp%] [%Severity%] %Message%"
-    );
-
-    // Add attributes like timestamp and process ID, which are often used in log formatting.
-    bl::add_common_attributes();
-}
-
-void finalize_logging() {
-    // Flush all sinks to make sure all logged messages are written out
-    bl::core::get()->flush();
-
-    // Remove all sinks
-    bl::core::get()->remove_all_sinks();
-
-}
+/// Frontier points handed to a thread at a time while a level is expanded in parallel.
+const size_t PARALLEL_CHUNK = 32;
 
 /**
  * @brief Struct to set coordinates for a Boost Geometry point in a D-dimensional space.
@@ -202,6 +186,64 @@ struct add_scalar_to_point {
         bg::set<i>(p, new_coord); // Set the new coordinate value in the point
     }
 };
+
+/**
+ * @brief Build the search boxes covering the linking ball around a point.
+ *
+ * Without periodic boundaries (L <= 0) this is the single box [x - b, x + b]. In a periodic box of
+ * side L, the parts of that box that stick out of [0, L] are wrapped to the opposite face, so up to
+ * 2^D disjoint boxes are written; they go to a caller-provided array so the query loop never allocates.
+ *
+ * @tparam D Dimensionality of the space in which the points exist.
+ * @param x Pointer to the D coordinates of the point at the centre of the search.
+ * @param b Half side of the search box (the linking length).
+ * @param L Box size; non-positive values disable periodic wrapping.
+ * @param boxes Output array with room for 2^D boxes.
+ * @return size_t The number of boxes to query.
+ */
+template <size_t D>
+size_t query_boxes(const double *x, double b, double L, bg::model::box<bg::model::point<double, D, bg::cs::cartesian>> *boxes) {
+    typedef bg::model::point<double, D, bg::cs::cartesian> point_t;
+    typedef bmpl::range_c<size_t, 0, D> dim_range;
+
+    // Per-dimension list of [lo, hi] intervals, at most two once wrapped
+    double lo[D][2], hi[D][2];
+    size_t nint[D];
+    for (size_t i = 0; i < D; ++i) {
+        lo[i][0] = x[i] - b;
+        hi[i][0] = x[i] + b;
+        nint[i] = 1;
+        if (L > 0. && lo[i][0] < 0.) {
+            lo[i][1] = lo[i][0] + L; hi[i][1] = L;
+            lo[i][0] = 0.;
+            nint[i] = 2;
+        } else if (L > 0. && hi[i][0] > L) {
+            lo[i][1] = 0.; hi[i][1] = hi[i][0] - L;
+            hi[i][0] = L;
+            nint[i] = 2;
+        }
+    }
+
+    // Cartesian product of the intervals
+    size_t nbox = 1;
+    for (size_t i = 0; i < D; ++i) nbox *= nint[i];
+
+    for (size_t k = 0; k < nbox; ++k) {
+        double l[D], u[D];
+        size_t r = k;
+        for (size_t i = 0; i < D; ++i) {
+            size_t j = r % nint[i];
+            r /= nint[i];
+            l[i] = lo[i][j];
+            u[i] = hi[i][j];
+        }
+        point_t lower, upper;
+        bmpl::for_each<dim_range>(point_setter<D>(lower, l));
+        bmpl::for_each<dim_range>(point_setter<D>(upper, u));
+        boxes[k] = bg::model::box<point_t>(lower, upper);
+    }
+    return nbox;
+}
 /*
 // Main function to perform friends-of-friends clustering using an R-tree
 template <size_t D>
@@ -418,122 +460,232 @@ std::vector<std::vector<size_t>> friends_of_friends_rtree(double *data, size_t n
     return groups; // Return all the groups found
 }
 */
-// Main function to perform friends-of-friends clustering using an R-tree
-template <size_t D>
-std::vector<std::vector<size_t>> friends_of_friends_rtree(double *data, size_t npts, double linking_length) {
-    
+/**
+ * @brief R-tree indexable getter reading the point of a particle index straight from the caller's buffer.
+ *
+ * The tree then stores nothing but the indices, so no copy of the coordinates is made: the point is
+ * rebuilt from `data` whenever the tree needs it, which costs D loads from an array that is already
+ * in cache during the queries.
+ *
+ * @tparam D Dimensionality of the space in which the points exist.
+ * @tparam Index Integer type of the stored particle indices.
+ */
+template <size_t D, typename Index>
+struct buffer_indexable {
     typedef bg::model::point<double, D, bg::cs::cartesian> point_t;
-    typedef std::pair<point_t, size_t> value_t;
-    using tree_t = bgi::rtree<value_t, bgi::rstar<16,1>>;
-    typedef bmpl::range_c<size_t, 0, D> dim_range;
+    typedef point_t result_type;
 
-    init_logging();
-    using namespace std::chrono;
-    high_resolution_clock::time_point t1, t2;
-    // Now BOOST_LOG_TRIVIAL will work as expected.
-    BOOST_LOG_TRIVIAL(info) << "Starting to reserve space for points";
-    t1 = high_resolution_clock::now();
+    const double *data; ///< Coordinates of the particles, D per particle.
 
-    // Reserve space for points to avoid multiple reallocations
-    std::vector<std::pair<point_t, size_t>> points;
-    points.reserve(npts);
-    t2 = high_resolution_clock::now();
-    BOOST_LOG_TRIVIAL(info) << "Reserved space in " << duration_cast<milliseconds>(t2 - t1).count() << " ms";
+    explicit buffer_indexable(const double *data) : data(data) {}
 
-    BOOST_LOG_TRIVIAL(info) << "Starting to populate R-tree with points";
-    t1 = high_resolution_clock::now();
-    // Populate the R-tree with the points from the data array
-    for (size_t i = 0; i < npts; ++i) {
+    result_type operator()(Index i) const {
         point_t point;
-        // Initialize point coordinates from the data array
-        boost::mpl::for_each<dim_range>(point_setter<D>(point, data + i * D));
-        points.push_back(std::make_pair(point, i)); // Pair point with its index
+        bmpl::for_each<bmpl::range_c<size_t, 0, D>>(point_setter<D>(point, const_cast<double *>(data + i * D)));
+        return point;
     }
-    t2 = high_resolution_clock::now();
-    BOOST_LOG_TRIVIAL(info) << "Populated R-tree in " << duration_cast<milliseconds>(t2 - t1).count() << " ms";
-
-    BOOST_LOG_TRIVIAL(info) << "Creating an R-tree";
-    t1 = high_resolution_clock::now();
-    // Create an R-tree using the points vector
-    tree_t tree(points.begin(), points.end());
-    t2 = high_resolution_clock::now();
-    BOOST_LOG_TRIVIAL(info) << "Created R-tree in " << duration_cast<seconds>(t2 - t1).count() << " s";
-
-    // This will store the groups of points that are within the linking length
-    std::vector<std::vector<size_t>> groups;
+};
 
-    // Auxiliary structure to keep track of processed points
-    std::vector<bool> processed_points(npts, false);
+/**
+ * @brief Friends-of-friends clustering with an R-tree of particle indices.
+ *
+ * The tree holds one `Index` per particle and reads positions from `data` through `buffer_indexable`,
+ * so the peak memory of the index is the input plus a few bytes per particle, rather than two more
+ * copies of the coordinates. 32-bit indices are used whenever the number of points allows it.
+ *
+ * Groups are grown breadth-first directly at the end of the catalog's member array, which doubles as
+ * the frontier, and the queries append their results there, so the linking loop only allocates when
+ * the group offsets outgrow their capacity.
+ *
+ * A single percolating group can hold most of the particles, so a breadth-first level of at least
+ * `PARALLEL_LEVEL` points is expanded by all OpenMP threads: they take chunks of the level from a
+ * dynamic schedule, so threads done with sparse regions keep taking work from dense ones, and claim
+ * each new friend with a compare-and-swap on its label, so that it joins the next level exactly once.
+ * The friends found by each thread are then appended to the members; the groups are the same for any
+ * number of threads, only the order of the members inside a large group may change.
+ */
+template <size_t D, typename Index>
+group_catalog friends_of_friends_rtree(double *data, size_t npts, double linking_length, double boxsize, fof_stats *stats) {
+    
+    typedef bg::model::point<double, D, bg::cs::cartesian> point_t;
+    typedef buffer_indexable<D, Index> getter_t;
+    using tree_t = bgi::rtree<Index, bgi::rstar<16,1>, getter_t>;
+    typedef bmpl::range_c<size_t, 0, D> dim_range;
 
-    BOOST_LOG_TRIVIAL(info) << "Building groups";
-    t1 = high_resolution_clock::now();
-    // Loop until all points are grouped
-    while (!std::all_of(processed_points.begin(), processed_points.end(), [](bool v) { return v; })) {
-        std::vector<value_t> to_add;
-        // Start with an arbitrary point from the R-tree that has not been processed
-        for (const auto& p : points) {
-            if (!processed_points[p.second]) {
-                to_add.push_back(p);
-                break;
-            }
+    YGG_STATS(if (stats) stats->npts = npts;)
+    phase_timer load_timer(stats, "load");
+    // The values of the tree are the particle indices themselves, first touched by their owner thread
+    first_touch_vector<Index> indices(npts);
+    #pragma omp parallel for schedule(static)
+    for (long i = 0; i < static_cast<long>(npts); ++i) {
+        indices[i] = static_cast<Index>(i);
+    }
+    load_timer.add_bytes(npts * sizeof(Index));
+    load_timer.stop();
+
+    phase_timer index_timer(stats, "index");
+    // Pack the R-tree over the indices; the index array is released as soon as the tree holds them
+    const getter_t getter(data);
+    tree_t tree(indices.begin(), indices.end(), bgi::rstar<16,1>(), getter);
+    first_touch_vector<Index>().swap(indices);
+    index_timer.stop();
+
+    phase_timer link_timer(stats, "link");
+    // Every particle ends up in exactly one group, so the members and labels are allocated once; the
+    // labels also tell which points were already grouped
+    group_catalog catalog;
+    catalog.labels.resize(npts);
+    parallel_fill(catalog.labels.data(), npts, std::int64_t(-1));
+    catalog.members.reserve(npts);
+    catalog.offsets.reserve(1);
+    catalog.offsets.push_back(0);
+    std::uint64_t allocations = 3;
+
+    // Work counters, added to the statistics once at the end
+    YGG_STATS(std::uint64_t visited = 0, tested = 0, linked = 0;)
+
+    int nthreads = 1;
+#ifdef _OPENMP
+    nthreads = omp_in_parallel() ? 1 : omp_get_max_threads();
+#endif
+    // Friends found by each thread in a parallel level, kept across levels and groups
+    std::vector<std::vector<size_t>> found(nthreads);
+    ++allocations;
+    std::int64_t *labels = catalog.labels.data();
+    std::int64_t ngroups = 0;
+
+    // Query the R-tree around the point `current`, calling `add_friend` with every ungrouped friend;
+    // the labels are read atomically since other threads may be claiming points
+    auto search = [&](size_t current, bg::model::box<point_t> *boxes, std::uint64_t &ntested, auto add_friend) {
+        const point_t centre = getter(static_cast<Index>(current));
+
+        // Define a predicate to determine if points are within the linking length
+        auto within_ball = [&](Index v) {
+            double d2 = 0.;
+            bmpl::for_each<dim_range>(d2_calc<D>(centre, getter(v), d2, boxsize));
+            return sqrt(d2) < linking_length;
+        };
+
+        // Query the R-tree around the point, extending the search box by the linking length; the
+        // periodic boxes are disjoint, so no point can be reported twice
+        const size_t nbox = query_boxes<D>(data + current * D, linking_length, boxsize, boxes);
+        for (size_t k = 0; k < nbox; ++k) {
+            // The processed test comes first so that leaf values already grouped are dropped
+            // before their coordinates are loaded; the box still prunes the nodes
+            tree.query(bgi::satisfies([&](Index v) {
+                if (__atomic_load_n(labels + v, __ATOMIC_RELAXED) >= 0) {
+                    return false;
+                }
+                ++ntested;
+                return within_ball(v);
+            }) && bgi::intersects(boxes[k]), boost::make_function_output_iterator(add_friend));
         }
+    };
 
-        // Define a search box around the point, extending by the linking length in all dimensions
-        point_t lower, upper;
-        bmpl::for_each<dim_range>(point_setter_const<D>(lower, 0.0));
-        bmpl::for_each<dim_range>(point_setter_const<D>(upper, 1.0));
-        bg::model::box<point_t> box(lower, upper);
-
-        // Process all points that need to be grouped
-        for (auto to_add_i = size_t(0); to_add_i < to_add.size(); ++to_add_i) {
-            std::vector<value_t> added;
-            auto it = to_add.begin() + to_add_i;
-
-            // Define a predicate to determine if points are within the linking length
-            auto within_ball = [&it, linking_length](value_t const &v) {
-                double d2 = 0.;
-                bmpl::for_each<dim_range>(d2_calc<D>(it->first, v.first, d2, 1.0));
-                return sqrt(d2) < linking_length;
-            };
-
-            // Query the R-tree for points within the box and within the linking length
-            tree.query(bgi::within(box) && bgi::satisfies([&](value_t const &v) {
-                return !processed_points[v.second] && within_ball(v);
-            }), std::back_inserter(added));
-
-            // Add newly found points to the group
-            for (auto p : added) {
-                if (!processed_points[p.second]) {
-                    to_add.push_back(p);
-                    processed_points[p.second] = true; // Mark the point as processed
+    bg::model::box<point_t> boxes[size_t(1) << D];
+    // Loop until all points are grouped, seeding each group with the next unprocessed point
+    for (size_t seed = 0; seed < npts; ++seed) {
+        if (labels[seed] >= 0) {
+            continue;
+        }
+        catalog.members.push_back(seed);
+        labels[seed] = ngroups;
+
+        // Process the group one breadth-first level at a time
+        size_t head = catalog.offsets.back();
+        while (head < catalog.members.size()) {
+            const size_t level_end = catalog.members.size();
+
+            if (nthreads > 1 && level_end - head >= PARALLEL_LEVEL) {
+                std::uint64_t level_tested = 0, level_linked = 0, level_allocations = 0;
+                #pragma omp parallel num_threads(nthreads) reduction(+:level_tested, level_linked, level_allocations)
+                {
+                    int t = 0;
+#ifdef _OPENMP
+                    t = omp_get_thread_num();
+#endif
+                    std::vector<size_t> &mine = found[t];
+                    bg::model::box<point_t> thread_boxes[size_t(1) << D];
+                    #pragma omp for schedule(dynamic, PARALLEL_CHUNK)
+                    for (size_t k = head; k < level_end; ++k) {
+                        search(catalog.members[k], thread_boxes, level_tested, [&](Index v) {
+                            // Claim the point; only the thread that labels it adds it to the group
+                            std::int64_t unclaimed = -1;
+                            if (__atomic_compare_exchange_n(labels + v, &unclaimed, ngroups, false, __ATOMIC_RELAXED,
+                                                            __ATOMIC_RELAXED)) {
+                                push_back_counted(mine, static_cast<size_t>(v), level_allocations);
+                                ++level_linked;
+                            }
+                        });
+                    }
+                }
+                for (auto &mine : found) {
+                    catalog.members.insert(catalog.members.end(), mine.begin(), mine.end());
+                    mine.clear();
                 }
+                YGG_STATS(
+                    visited += level_end - head;
+                    tested += level_tested;
+                    linked += level_linked;
+                )
+                allocations += level_allocations;
+                head = level_end;
+                continue;
             }
-        }
 
-        // Compile the list of indices for the points in the current group
-        std::vector<size_t> group;
-        for (auto p : to_add) {
-            group.push_back(p.second);
+            // Small levels are expanded in place, the new friends going straight to the members
+            std::uint64_t level_tested = 0;
+            for (; head < level_end; ++head) {
+                YGG_STATS(++visited;)
+                search(catalog.members[head], boxes, level_tested, [&](Index v) {
+                    catalog.members.push_back(v);
+                    labels[v] = ngroups; // Mark the point as processed
+                    YGG_STATS(++linked;)
+                });
+            }
+            YGG_STATS(tested += level_tested;)
         }
-        groups.push_back(group); // Add the current group to the list of all groups
+
+        push_back_counted(catalog.offsets, catalog.members.size(), allocations);
+        ++ngroups;
     }
+    link_timer.stop();
+
+    YGG_STATS(
+        if (stats) {
+            stats->points_visited += visited;
+            stats->pairs_tested += tested;
+            stats->pairs_linked += linked;
+            stats->allocations += allocations;
+        }
+    )
+    (void)allocations;
 
-    t2 = high_resolution_clock::now();
-    BOOST_LOG_TRIVIAL(info) << "Groups built in " << duration_cast<seconds>(t2 - t1).count() << " s";
-    BOOST_LOG_TRIVIAL(info) << "Completed friends-of-friends grouping";
-    // Finalize logging before exiting the program
-    finalize_logging();
+    return catalog; // Return all the groups found
+}
 
-    return groups; // Return all the groups found
+/// Pick 32-bit tree values whenever every index fits, 64-bit ones otherwise.
+template <size_t D>
+group_catalog friends_of_friends_rtree(double *data, size_t npts, double linking_length, double boxsize, fof_stats *stats) {
+    if (npts <= std::numeric_limits<std::uint32_t>::max()) {
+        return friends_of_friends_rtree<D, std::uint32_t>(data, npts, linking_length, boxsize, stats);
+    }
+    return friends_of_friends_rtree<D, std::uint64_t>(data, npts, linking_length, boxsize, stats);
 }
 
 // General interface function to handle different dimensions
-std::vector<std::vector<size_t>> friends_of_friends(double *data, size_t npts, size_t ndim, double linking_length) {
+group_catalog friends_of_friends_catalog(double *data, size_t npts, size_t ndim, double linking_length, double boxsize,
+                                         fof_stats *stats) {
     switch (ndim) {
-        case 1: return friends_of_friends_rtree<1>(data, npts, linking_length);
-        case 2: return friends_of_friends_rtree<2>(data, npts, linking_length);
-        case 3: return friends_of_friends_rtree<3>(data, npts, linking_length);
-        case 4: return friends_of_friends_rtree<4>(data, npts, linking_length);
-        default: return friends_of_friends_brute(data, npts, ndim, linking_length);
+        case 1: return friends_of_friends_rtree<1>(data, npts, linking_length, boxsize, stats);
+        case 2: return friends_of_friends_rtree<2>(data, npts, linking_length, boxsize, stats);
+        case 3: return friends_of_friends_rtree<3>(data, npts, linking_length, boxsize, stats);
+        case 4: return friends_of_friends_rtree<4>(data, npts, linking_length, boxsize, stats);
+        default: return friends_of_friends_brute_catalog(data, npts, ndim, linking_length, boxsize, stats);
     }
 }
+
+std::vector<std::vector<size_t>> friends_of_friends(double *data, size_t npts, size_t ndim, double linking_length, double boxsize,
+                                                    fof_stats *stats) {
+    return catalog_groups(friends_of_friends_catalog(data, npts, ndim, linking_length, boxsize, stats));
+}
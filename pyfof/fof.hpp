@@ -2,6 +2,9 @@
 #include <cstdlib>
 #include <vector>
 
+#include "groups.hpp"
+#include "stats.hpp"
+
 /**
  * @brief Perform friends-of-friends clustering using an R-tree.
  *
@@ -10,10 +13,31 @@
  * that are within a specified linking length of each other. The function is generic and works
  * for any specified dimension D.
  *
+ * The tree stores only particle indices and reads the coordinates from `data` itself, which must
+ * therefore stay alive and unchanged during the call; the index costs a few bytes per particle on
+ * top of the input, and input that is already roughly spatially ordered (snapshots sorted along a
+ * space-filling curve, for instance) makes the queries more cache friendly.
+ *
+ * Breadth-first levels of a group with at least `PARALLEL_LEVEL` points are expanded by all OpenMP
+ * threads, so a percolating group does not leave the other threads idle.
+ *
  * @tparam D Dimensionality of the space in which the points exist.
  * @param data Pointer to the array of point coordinates, assumed to be contiguous in memory.
  * @param npts Number of points in the data array.
  * @param linking_length Maximum distance between points to be considered part of the same cluster.
+ * @param boxsize Side of the periodic box; non-positive values disable periodic boundaries.
+ * @param stats Optional statistics, receiving the "load", "index" and "link" phases and the work counters.
  * @return std::vector<std::vector<size_t>> A vector of clusters, each represented as a vector of point indices.
  */
-std::vector< std::vector<std::size_t> >  friends_of_friends(double* data, std::size_t npts, std::size_t ndim, double linking_length);
+std::vector< std::vector<std::size_t> >  friends_of_friends(double* data, std::size_t npts, std::size_t ndim, double linking_length, double boxsize = 0., fof_stats* stats = nullptr);
+
+/**
+ * @brief Friends-of-friends clustering returning a CSR catalog.
+ *
+ * Same engine as `friends_of_friends`, but the groups are written straight into one flat member
+ * array instead of one vector per group; the list-of-lists interface is a conversion of this one.
+ *
+ * @param stats Optional statistics, as for `friends_of_friends`, with the allocations of the linking loop.
+ * @return group_catalog The groups, with the labels of every particle.
+ */
+group_catalog friends_of_friends_catalog(double* data, std::size_t npts, std::size_t ndim, double linking_length, double boxsize = 0., fof_stats* stats = nullptr);
@@ -0,0 +1,98 @@
+#include "fof_batch.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <numeric>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Typedef for convenience
+typedef std::size_t size_t;
+
+namespace {
+
+/// Link set s with the engine of `config`, resolving "auto" on the set itself.
+group_catalog link_set(const engine_config &config, const double *data, const size_t *set_offsets, size_t s,
+                       size_t ndim, double linking_length, double boxsize) {
+    const size_t npts = set_offsets[s + 1] - set_offsets[s];
+    // The engines read the coordinates without modifying them
+    double *points = const_cast<double *>(data) + set_offsets[s] * ndim;
+    if (npts == 0) {
+        group_catalog empty;
+        empty.offsets.assign(1, 0);
+        return empty;
+    }
+    engine_config resolved = config;
+    if (resolved.engine == "auto") {
+        const engine_config selected = select_engine(sample_data_shape(points, npts, ndim, linking_length, boxsize));
+        resolved.engine = selected.engine;
+        if (resolved.leaf_size == 0) resolved.leaf_size = selected.leaf_size;
+    }
+    if (resolved.leaf_size == 0) resolved.leaf_size = 16;
+    return friends_of_friends_engine(resolved, points, npts, ndim, linking_length, boxsize);
+}
+
+} // End of anonymous namespace
+
+// Largest sets first: the big ones with the whole team, then the rest one per thread
+batch_catalog friends_of_friends_batch(const engine_config &config, const double *data, const size_t *set_offsets,
+                                       size_t nsets, size_t ndim, double linking_length, double boxsize) {
+    std::vector<size_t> order(nsets);
+    std::iota(order.begin(), order.end(), size_t(0));
+    auto set_size = [&](size_t s) { return set_offsets[s + 1] - set_offsets[s]; };
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return set_size(a) > set_size(b); });
+
+    int nthreads = 1;
+#ifdef _OPENMP
+    nthreads = omp_get_max_threads();
+#endif
+    const size_t total = nsets > 0 ? set_offsets[nsets] - set_offsets[0] : 0;
+    size_t nlarge = 0;
+    while (nlarge < nsets && nthreads > 1 && set_size(order[nlarge]) * nthreads >= total) {
+        ++nlarge;
+    }
+
+    std::vector<group_catalog> catalogs(nsets);
+    for (size_t i = 0; i < nlarge; ++i) {
+        catalogs[order[i]] = link_set(config, data, set_offsets, order[i], ndim, linking_length, boxsize);
+    }
+
+    // An exception cannot leave the parallel loop, so the first one is kept and rethrown after it
+    std::exception_ptr error;
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (long i = static_cast<long>(nlarge); i < static_cast<long>(nsets); ++i) {
+        const size_t s = order[i];
+        try {
+            catalogs[s] = link_set(config, data, set_offsets, s, ndim, linking_length, boxsize);
+        } catch (...) {
+            #pragma omp critical(fof_batch_error)
+            if (!error) error = std::current_exception();
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    batch_catalog out;
+    out.set_offsets.assign(nsets + 1, 0);
+    size_t nmembers = 0;
+    for (size_t s = 0; s < nsets; ++s) {
+        out.set_offsets[s + 1] = out.set_offsets[s] + catalogs[s].ngroups();
+        nmembers += catalogs[s].members.size();
+    }
+    out.offsets.reserve(out.set_offsets[nsets] + 1);
+    out.offsets.push_back(0);
+    out.members.reserve(nmembers);
+    for (size_t s = 0; s < nsets; ++s) {
+        group_catalog &catalog = catalogs[s];
+        const size_t base = out.members.size();
+        for (size_t g = 0; g < catalog.ngroups(); ++g) {
+            out.offsets.push_back(base + catalog.offsets[g + 1]);
+        }
+        out.members.insert(out.members.end(), catalog.members.begin(), catalog.members.end());
+        catalog = group_catalog();
+    }
+    return out;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdlib>
+#include <vector>
+
+#include "engine_select.hpp"
+
+/**
+ * @brief Friends-of-friends groups of many independent point sets, in one CSR catalog.
+ *
+ * The groups of set s are `set_offsets[s]` to `set_offsets[s + 1] - 1`, in the order the engine
+ * returns them for that set alone; group g has members `members[offsets[g]]` to
+ * `members[offsets[g + 1] - 1]`, indices of points within their own set.
+ */
+struct batch_catalog {
+    std::vector<std::size_t> set_offsets;  ///< First group of each set, with a trailing sentinel (size nsets + 1).
+    std::vector<std::size_t> offsets;      ///< Start of each group in `members`, with a trailing sentinel.
+    std::vector<std::size_t> members;      ///< Point indices within their set, grouped contiguously.
+
+    /// Number of point sets.
+    std::size_t nsets() const { return set_offsets.empty() ? 0 : set_offsets.size() - 1; }
+};
+
+/**
+ * @brief Run friends-of-friends on every point set of a concatenated buffer.
+ *
+ * Sets are processed largest first. A set holding at least a thread's share of all the points runs
+ * alone with every thread; the others are handed out one at a time to the threads of a single
+ * parallel loop, each linked by the engine on one thread, so thousands of small sets cost one call
+ * and keep every core busy.
+ *
+ * @param config Engine and leaf size used for every set; "auto" selects them set by set.
+ * @param data Coordinates of all the sets, `ndim` contiguous values per point; not modified.
+ * @param set_offsets First point of each set in `data`, with a trailing sentinel (nsets + 1 values).
+ * @param nsets Number of sets.
+ * @param ndim Dimensionality of the points.
+ * @param linking_length Maximum distance between points to be considered part of the same cluster.
+ * @param boxsize Side of the periodic box; non-positive values disable periodic boundaries.
+ * @return batch_catalog The groups of every set.
+ */
+batch_catalog friends_of_friends_batch(const engine_config &config, const double *data, const std::size_t *set_offsets,
+                                       std::size_t nsets, std::size_t ndim, double linking_length,
+                                       double boxsize = 0.);
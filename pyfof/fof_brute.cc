@@ -24,12 +24,15 @@ typedef std::pair<size_t, double*> Point;
  * @param p1 Pointer to the first point's coordinates.
  * @param p2 Pointer to the second point's coordinates.
  * @param ndim The number of dimensions in which the points exist.
+ * @param L Side of the periodic box; non-positive values disable the minimum-image convention.
  * @return double The Euclidean distance between the two points.
  */
-double dist(double *p1, double *p2, size_t ndim) {
+double dist(double *p1, double *p2, size_t ndim, double L) {
     double d2 = 0.; // Start with a squared distance of 0.
     for(size_t i = 0 ; i < ndim ; ++i) {
-        d2 += pow(p1[i] - p2[i], 2); // Sum up the squared differences of coordinates.
+        double di = std::fabs(p1[i] - p2[i]);
+        if (L > 0. && di > L/2) di = L - di; // Minimum image across the periodic boundary.
+        d2 += pow(di, 2); // Sum up the squared differences of coordinates.
     }
     return sqrt(d2); // Return the square root of the summed squares (Euclidean distance).
 }
@@ -37,38 +40,57 @@ double dist(double *p1, double *p2, size_t ndim) {
 } // End of anonymous namespace
 
 // Brute force implementation to find friends of friends clusters.
-std::vector< std::vector<size_t> > friends_of_friends_brute(
+group_catalog friends_of_friends_brute_catalog(
     double *data,           // Pointer to the data array.
     size_t npts,            // Number of points in the data.
     size_t ndim,            // Number of dimensions of each point.
-    double linking_length   // Maximum distance between points to be considered friends.
+    double linking_length,  // Maximum distance between points to be considered friends.
+    double boxsize,         // Side of the periodic box, non-positive for open boundaries.
+    fof_stats *stats        // Optional statistics, filled when not null.
 ) {
-    auto result = std::vector< std::vector<size_t> >(); // This will hold the final groups of friends.
+    group_catalog catalog; // This will hold the final groups of friends.
+    YGG_STATS(if (stats) stats->npts = npts;)
+    phase_timer timer(stats, "link");
+    YGG_STATS(std::uint64_t visited = 0, tested = 0, linked = 0;) // Work counters, added once at the end.
+
+    // Every point ends in exactly one group, so members and labels are allocated once up front.
+    catalog.labels.assign(npts, -1);
+    catalog.members.reserve(npts);
+    catalog.offsets.reserve(1);
+    catalog.offsets.push_back(0);
 
     // Create a list of points, each with an index and a pointer to its coordinates in 'data'.
     std::vector<Point> unused;
+    unused.reserve(npts);
     for(size_t i=0 ; i<npts ; ++i) {
         unused.push_back(std::make_pair(i, data + i*ndim));
     }
+    std::uint64_t allocations = 4; // Labels, members, offsets and the unused list.
+
+    // Points to be added to the current group, reused from one group to the next.
+    std::vector<Point> toadd;
 
     // Continue forming groups until no points remain ungrouped.
+    std::int64_t ngroups = 0;
     while( !unused.empty() ) {
-        auto group = std::vector<size_t>(); // This will hold the current group of friends.
-        auto toadd = std::vector<Point>();  // Points to be added to the group.
-        toadd.push_back(unused.back());     // Start the group with the last point in 'unused'.
-        unused.pop_back();                  // Remove that point from 'unused'.
+        const size_t first = catalog.members.size();               // The group starts at the end of the members.
+        push_back_counted(toadd, unused.back(), allocations);       // Start the group with the last point in 'unused'.
+        unused.pop_back();                                          // Remove that point from 'unused'.
 
         // Process all points to be added to the current group.
         while (!toadd.empty()) {
             auto point = toadd.back();
             toadd.pop_back();
-            group.push_back(point.first); // Add the point's index to the group.
+            catalog.members.push_back(point.first); // Add the point's index to the group.
+            catalog.labels[point.first] = ngroups;
+            YGG_STATS(++visited; tested += unused.size();)
 
             // Check all unused points to see if they are within the linking length from the current point.
             for (auto& unused_point : unused) {
-                if(dist(unused_point.second, point.second, ndim) < linking_length) {
-                    toadd.push_back(unused_point); // Add to the list to be added to the group.
+                if(dist(unused_point.second, point.second, ndim, boxsize) < linking_length) {
+                    push_back_counted(toadd, unused_point, allocations); // Add to the list to be added to the group.
                     unused_point.second = nullptr; // Mark the unused point as processed.
+                    YGG_STATS(++linked;)
                 }     
             }
 
@@ -78,8 +100,23 @@ std::vector< std::vector<size_t> > friends_of_friends_brute(
                 unused.end()
             );
         }
-        std::sort(group.begin(), group.end()); // Sort the group by indices for a consistent order.
-        result.push_back(group); // Add the completed group to the result.
+        std::sort(catalog.members.begin() + first, catalog.members.end()); // Sort the group by indices for a consistent order.
+        push_back_counted(catalog.offsets, catalog.members.size(), allocations); // Close the group.
+        ++ngroups;
     }
-    return result; // Return all groups found.
+    YGG_STATS(
+        if (stats) {
+            stats->points_visited += visited;
+            stats->pairs_tested += tested;
+            stats->pairs_linked += linked;
+            stats->allocations += allocations;
+        }
+    )
+    (void)allocations;
+    return catalog; // Return all groups found.
+}
+
+std::vector< std::vector<size_t> > friends_of_friends_brute(
+    double *data, size_t npts, size_t ndim, double linking_length, double boxsize, fof_stats *stats) {
+    return catalog_groups(friends_of_friends_brute_catalog(data, npts, ndim, linking_length, boxsize, stats));
 }
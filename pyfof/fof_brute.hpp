@@ -2,6 +2,9 @@
 
 #include <vector>
 
+#include "groups.hpp"
+#include "stats.hpp"
+
 /**
  * @brief Brute force implementation to find friends-of-friends clusters.
  *
@@ -14,7 +17,18 @@
  * @param npts The total number of points in the dataset.
  * @param ndim The number of dimensions each point has.
  * @param linking_length The maximum distance between two points to consider them as "friends".
+ * @param boxsize Side of the periodic box; non-positive values disable periodic boundaries.
+ * @param stats Optional statistics, receiving the "link" phase and the work counters.
  * @return std::vector<std::vector<size_t>> A list of clusters, with each cluster being a list
  *         of indices representing points that are grouped together.
  */
-std::vector< std::vector<std::size_t> > friends_of_friends_brute(double* data, std::size_t npts, std::size_t ndim, double linking_length);
+std::vector< std::vector<std::size_t> > friends_of_friends_brute(double* data, std::size_t npts, std::size_t ndim, double linking_length, double boxsize = 0., fof_stats* stats = nullptr);
+
+/**
+ * @brief Brute force friends-of-friends clustering returning a CSR catalog.
+ *
+ * Groups come in the same order as from `friends_of_friends_brute`, with sorted members.
+ *
+ * @return group_catalog The groups, with the labels of every particle.
+ */
+group_catalog friends_of_friends_brute_catalog(double* data, std::size_t npts, std::size_t ndim, double linking_length, double boxsize = 0., fof_stats* stats = nullptr);
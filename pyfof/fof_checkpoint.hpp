@@ -0,0 +1,319 @@
+#pragma once
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fof_kdtree.hpp"
+#include "kdtree_io.hpp"
+#include "pipeline.hpp"
+
+/**
+ * @file fof_checkpoint.hpp
+ * @brief Friends-of-friends runs of the kd-tree engine that resume after being killed.
+ *
+ * Between two groups, the state of `link_kdtree_groups` is the points reached so far, in order, the
+ * sizes of the groups they form and the next seed. The groups completed since the last checkpoint
+ * are appended to the checkpoint file as one record, by a thread of their own, so linking never
+ * waits for the disk. Every record ends with a hash of its contents: a record torn by a crash is
+ * dropped when the file is reopened, and the run resumes after the last complete one.
+ *
+ * The file starts with a header identifying the run, the hash of the tree and the linking length; a
+ * file of another run is replaced. Files are only read back on machines with the byte order they
+ * were written with.
+ */
+
+/// Version of the file layout written by `checkpoint_log`.
+const std::uint32_t FOF_CHECKPOINT_VERSION = 1;
+
+/// Where and how often a run saves its progress.
+struct checkpoint_config {
+    std::string path;            ///< Checkpoint file.
+    double interval = 60.;       ///< Seconds between two checkpoints; 0 saves every group.
+};
+
+/// Header at the start of a checkpoint file.
+struct checkpoint_file_header {
+    char magic[8];               ///< "YGGCKPNT".
+    std::uint32_t version;       ///< `FOF_CHECKPOINT_VERSION`.
+    std::uint32_t byte_order;    ///< 0x01020304 as written by the machine that saved the file.
+    std::uint64_t npts;          ///< Number of points.
+    double linking_length;       ///< Linking length of the run.
+    std::uint64_t tree_hash;     ///< `hash_kd_tree` of the tree being linked.
+};
+
+/**
+ * @brief Groups completed between two checkpoints.
+ *
+ * On disk, a record is its number of groups, number of members and cursor, the group sizes, the
+ * members and a hash of all of these.
+ */
+struct checkpoint_record {
+    std::vector<std::uint64_t> sizes;         ///< Size of every group.
+    const std::size_t *members = nullptr;     ///< Points reached by the groups, in order.
+    std::uint64_t nmembers = 0;               ///< Number of members.
+    std::uint64_t cursor = 0;                 ///< Next seed once the record is applied.
+};
+
+namespace fof_checkpoint {
+
+const char MAGIC[8] = {'Y', 'G', 'G', 'C', 'K', 'P', 'N', 'T'};
+
+inline std::uint64_t record_hash(std::uint64_t ngroups, std::uint64_t nmembers, std::uint64_t cursor,
+                                 const std::uint64_t *sizes, const std::size_t *members) {
+    const std::uint64_t fields[3] = {ngroups, nmembers, cursor};
+    std::uint64_t h = hash_bytes(fields, sizeof(fields));
+    h = hash_bytes(sizes, ngroups * sizeof(std::uint64_t), h);
+    return hash_bytes(members, nmembers * sizeof(std::size_t), h);
+}
+
+inline bool write_all(int fd, const void *data, std::size_t bytes) {
+    const char *p = static_cast<const char *>(data);
+    while (bytes > 0) {
+        const ssize_t n = ::write(fd, p, bytes);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        bytes -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+} // namespace fof_checkpoint
+
+/**
+ * @brief Append-only checkpoint file of a run, written by a background thread.
+ *
+ * Opening the log restores the groups of a matching file and starts a new file otherwise. Records
+ * passed to `append` are written and synced in order while the caller goes on linking; the members
+ * they point to must stay unchanged until `finish` returns. A failed write stops the checkpoints
+ * without failing the run, leaving the records written before it.
+ */
+class checkpoint_log {
+public:
+    /**
+     * @brief Open the checkpoint of a run and restore its groups.
+     *
+     * @param path Checkpoint file.
+     * @param run Header of the run, compared with the one of the file.
+     * @param label Group of every point in tree order, all -1 on input.
+     * @param order Points in the order they were reached, empty on input with room for every point.
+     * @param offsets Group offsets, `{0}` on input; the restored groups are appended.
+     * @param cursor Receives the next seed.
+     * @throws std::runtime_error If the file can be neither resumed nor created.
+     */
+    checkpoint_log(const std::string &path, const checkpoint_file_header &run, std::vector<std::int64_t> &label,
+                   std::vector<std::size_t> &order, std::vector<std::size_t> &offsets, std::size_t &cursor)
+        : queue_(2) {
+        const std::uint64_t resumed = restore(path, run, label, order, offsets, cursor);
+        if (resumed > 0) {
+            fd_ = ::open(path.c_str(), O_WRONLY);
+            if (fd_ < 0 || ::ftruncate(fd_, static_cast<off_t>(resumed)) != 0 ||
+                ::lseek(fd_, 0, SEEK_END) < 0) {
+                if (fd_ >= 0) ::close(fd_);
+                throw std::runtime_error("cannot resume " + path);
+            }
+        } else {
+            // The header is in place before the file replaces an older one
+            const std::string tmp = path + ".tmp";
+            fd_ = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd_ < 0 || !fof_checkpoint::write_all(fd_, &run, sizeof(run)) || ::fsync(fd_) != 0 ||
+                std::rename(tmp.c_str(), path.c_str()) != 0) {
+                if (fd_ >= 0) ::close(fd_);
+                std::remove(tmp.c_str());
+                throw std::runtime_error("cannot create " + path);
+            }
+        }
+        writer_ = std::thread([this] {
+            checkpoint_record record;
+            while (queue_.pop(record)) {
+                write(record);
+            }
+        });
+    }
+
+    ~checkpoint_log() {
+        finish();
+        ::close(fd_);
+    }
+
+    checkpoint_log(const checkpoint_log &) = delete;
+    checkpoint_log &operator=(const checkpoint_log &) = delete;
+
+    /// Queue a record, waiting only if two are already queued.
+    void append(checkpoint_record record) {
+        queue_.push(std::move(record));
+    }
+
+    /// Wait until every queued record is written.
+    void finish() {
+        queue_.close();
+        if (writer_.joinable()) {
+            writer_.join();
+        }
+    }
+
+private:
+    /// Restore the groups of a file matching `run`; returns the bytes of it to keep, 0 to start afresh.
+    static std::uint64_t restore(const std::string &path, const checkpoint_file_header &run,
+                                 std::vector<std::int64_t> &label, std::vector<std::size_t> &order,
+                                 std::vector<std::size_t> &offsets, std::size_t &cursor) {
+        cursor = 0;
+        std::ifstream in(path, std::ios::binary);
+        checkpoint_file_header header;
+        if (!in || !in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+            std::memcmp(&header, &run, sizeof(header)) != 0) {
+            return 0;
+        }
+
+        std::uint64_t kept = sizeof(header);
+        std::vector<std::uint64_t> sizes;
+        std::vector<std::size_t> members;
+        std::uint64_t fields[3];
+        while (in.read(reinterpret_cast<char *>(fields), sizeof(fields))) {
+            const std::uint64_t ngroups = fields[0], nmembers = fields[1], cursor_after = fields[2];
+            if (nmembers > label.size() - order.size() || ngroups > nmembers) {
+                break;
+            }
+            sizes.resize(ngroups);
+            members.resize(nmembers);
+            std::uint64_t hash;
+            in.read(reinterpret_cast<char *>(sizes.data()), ngroups * sizeof(std::uint64_t));
+            in.read(reinterpret_cast<char *>(members.data()), nmembers * sizeof(std::size_t));
+            in.read(reinterpret_cast<char *>(&hash), sizeof(hash));
+            if (!in ||
+                fof_checkpoint::record_hash(ngroups, nmembers, cursor_after, sizes.data(), members.data()) != hash) {
+                break;
+            }
+
+            std::uint64_t total = 0;
+            for (std::uint64_t size : sizes) total += size;
+            bool valid = total == nmembers;
+            for (std::size_t k = 0; valid && k < nmembers; ++k) valid = members[k] < label.size();
+            if (!valid) {
+                break;
+            }
+
+            std::size_t k = 0;
+            for (std::uint64_t size : sizes) {
+                const std::int64_t g = static_cast<std::int64_t>(offsets.size()) - 1;
+                for (std::uint64_t end = k + size; k < end; ++k) {
+                    label[members[k]] = g;
+                    order.push_back(members[k]);
+                }
+                offsets.push_back(order.size());
+            }
+            cursor = cursor_after;
+            kept += sizeof(fields) + (ngroups + nmembers + 1) * sizeof(std::uint64_t);
+        }
+        return kept;
+    }
+
+    void write(const checkpoint_record &record) {
+        if (failed_) {
+            return;
+        }
+        const std::uint64_t ngroups = record.sizes.size();
+        const std::uint64_t fields[3] = {ngroups, record.nmembers, record.cursor};
+        const std::uint64_t hash =
+            fof_checkpoint::record_hash(ngroups, record.nmembers, record.cursor, record.sizes.data(), record.members);
+        failed_ = !fof_checkpoint::write_all(fd_, fields, sizeof(fields)) ||
+                  !fof_checkpoint::write_all(fd_, record.sizes.data(), ngroups * sizeof(std::uint64_t)) ||
+                  !fof_checkpoint::write_all(fd_, record.members, record.nmembers * sizeof(std::size_t)) ||
+                  !fof_checkpoint::write_all(fd_, &hash, sizeof(hash)) || ::fdatasync(fd_) != 0;
+    }
+
+    int fd_ = -1;
+    bool failed_ = false;
+    bounded_queue<checkpoint_record> queue_;
+    std::thread writer_;
+};
+
+/// Header of the checkpoint of linking `tree` with `linking_length`.
+template <std::size_t D>
+checkpoint_file_header checkpoint_run(const kd_tree<D> &tree, double linking_length) {
+    checkpoint_file_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, fof_checkpoint::MAGIC, sizeof(header.magic));
+    header.version = FOF_CHECKPOINT_VERSION;
+    header.byte_order = kd_tree_io::ORDER_MARK;
+    header.npts = tree.size();
+    header.linking_length = linking_length;
+    header.tree_hash = hash_kd_tree(tree);
+    return header;
+}
+
+/**
+ * @brief `friends_of_friends_kdtree`, saving its progress to a checkpoint and resuming from it.
+ *
+ * If `checkpoint.path` holds a checkpoint of the same tree and linking length, its groups are
+ * restored and linking continues after them; the file is left complete at the end, so running again
+ * only restores it. The groups are those of an uninterrupted run. Only the points linked in this call
+ * count as visited in the statistics.
+ *
+ * @tparam D Dimensionality of the space in which the points exist.
+ * @param tree The spatial index, built with the periodic box size to use.
+ * @param linking_length Maximum distance between points to be considered part of the same cluster.
+ * @param checkpoint Checkpoint file and interval.
+ * @param stats Optional statistics, receiving the "link" and "label" phases and the work counters.
+ * @return group_catalog Groups with members given as indices into the array the tree was built from.
+ * @throws std::runtime_error If the checkpoint file can be neither resumed nor created.
+ */
+template <std::size_t D>
+group_catalog friends_of_friends_kdtree_checkpointed(const kd_tree<D> &tree, double linking_length,
+                                                     const checkpoint_config &checkpoint,
+                                                     fof_stats *stats = nullptr) {
+    phase_timer link_timer(stats, "link");
+
+    // Groups are handed to the writer as slices of `order`, which is filled once and never moves
+    std::vector<std::int64_t> label(tree.size(), -1);
+    std::vector<std::size_t> order;
+    order.reserve(tree.size());
+    group_catalog catalog;
+    catalog.offsets.push_back(0);
+    std::size_t cursor = 0;
+    checkpoint_log log(checkpoint.path, checkpoint_run(tree, linking_length), label, order, catalog.offsets, cursor);
+
+    checkpoint_record pending;
+    pending.members = order.data() + order.size();
+    auto last = std::chrono::steady_clock::now();
+    resume_kdtree_groups(tree, linking_length, label, order, catalog.ngroups(), cursor,
+                         [&](std::size_t begin, std::size_t end) {
+        catalog.offsets.push_back(end);
+        pending.sizes.push_back(end - begin);
+        pending.nmembers += end - begin;
+        pending.cursor = order[begin] + 1;
+        const auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration<double>(now - last).count() >= checkpoint.interval) {
+            log.append(std::move(pending));
+            pending = checkpoint_record();
+            pending.members = order.data() + end;
+            last = now;
+        }
+        return true;
+    }, stats);
+    if (!pending.sizes.empty()) {
+        log.append(std::move(pending));
+    }
+    log.finish();
+    link_timer.stop();
+
+    label_kdtree_catalog(tree, label, order, catalog, stats);
+    return catalog;
+}
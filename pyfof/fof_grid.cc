@@ -0,0 +1,242 @@
+#include "fof_grid.hpp"
+#include "fixed_point.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+// Typedef for convenience
+typedef std::size_t size_t;
+
+namespace {
+
+/// Number of candidates whose distances are computed in one vectorised pass.
+const size_t GRID_CHUNK = 64;
+
+/**
+ * @brief Squared fixed-point distances from one point to a run of consecutive points.
+ *
+ * The coordinates are stored one dimension after the other, so every inner loop reads contiguous
+ * 32-bit integers; the difference is taken modulo 2^32 and read as a signed value, which is the
+ * minimum image in a periodic box and the plain difference otherwise. Each squared term is below
+ * 2^62, so the sum over at most three dimensions fits an unsigned 64-bit integer.
+ */
+template <size_t D>
+inline void squared_distances(const std::uint32_t *xq, size_t stride, size_t begin, size_t n, const std::uint32_t *p,
+                              std::uint64_t *out) {
+    for (size_t j = 0; j < n; ++j) out[j] = 0;
+    for (size_t d = 0; d < D; ++d) {
+        const std::uint32_t *x = xq + d * stride + begin;
+        const std::uint32_t c = p[d];
+        for (size_t j = 0; j < n; ++j) {
+            const std::int64_t di = static_cast<std::int32_t>(x[j] - c);
+            out[j] += static_cast<std::uint64_t>(di * di);
+        }
+    }
+}
+
+/**
+ * @tparam Index Unsigned type of the cell offsets, permutation, labels and order: 32 bits when the
+ *               points fit, so that every per-point array but the coordinates takes 4 bytes.
+ */
+template <size_t D, typename Index>
+group_catalog grid_friends_of_friends(const double *data, size_t npts, double linking_length, double boxsize,
+                                      unsigned bits, fof_stats *stats) {
+    YGG_STATS(if (stats) stats->npts = npts;)
+    YGG_STATS(std::uint64_t tested = 0, linked = 0;)
+    group_catalog catalog;
+    catalog.offsets.reserve(1);
+    catalog.offsets.push_back(0);
+    std::uint64_t allocations = 1;
+
+    phase_timer index_timer(stats, "index");
+    const fixed_point_frame frame(data, npts, D, boxsize, bits);
+    const unsigned range_bits = frame.range_bits();
+
+    // Cells at least one linking length wide, but no more cells than points
+    const double range = std::ldexp(frame.unit, static_cast<int>(range_bits));
+    double side = linking_length > 0. ? std::floor(range / linking_length) : 1.;
+    side = std::min(side, std::max(1., std::floor(std::pow(static_cast<double>(npts), 1. / D) * (1. + 1e-12))));
+    const size_t ncell = static_cast<size_t>(std::max(1., std::min(side, 1048576.)));
+    size_t ncells = 1, nneighbours = 1;
+    for (size_t d = 0; d < D; ++d) {
+        ncells *= ncell;
+        nneighbours *= 3;
+    }
+
+    // Cell of a fixed-point coordinate, by a multiply and a shift, and the lowest coordinate of a cell
+    auto cell_of = [&](std::uint32_t q) { return static_cast<size_t>((static_cast<std::uint64_t>(q) * ncell) >> range_bits); };
+    auto cell_low = [&](size_t c) { return ((static_cast<std::uint64_t>(c) << range_bits) + ncell - 1) / ncell; };
+
+    // Cell of a point and its fixed-point coordinates, recomputed rather than stored between the passes
+    auto quantize = [&](size_t i, std::uint32_t *q) {
+        size_t c = 0;
+        for (size_t d = D; d-- > 0;) {
+            q[d] = frame.quantize(data[i * D + d], d);
+            c = c * ncell + cell_of(q[d]);
+        }
+        return c;
+    };
+
+    // Counting sort of the points by cell, with the coordinates stored one dimension after the other.
+    // The starts of the cells serve as the cursors of the scatter, after which each holds the start of
+    // the next cell and the array is shifted back by one
+    std::vector<Index> cell_start(ncells + 1, 0);
+    std::vector<std::uint32_t> xq(D * npts);
+    std::vector<Index> perm(npts);
+    allocations += 3;
+    std::uint32_t q[D];
+    for (size_t i = 0; i < npts; ++i) {
+        ++cell_start[quantize(i, q) + 1];
+    }
+    for (size_t c = 0; c < ncells; ++c) cell_start[c + 1] += cell_start[c];
+    for (size_t i = 0; i < npts; ++i) {
+        const size_t k = cell_start[quantize(i, q)]++;
+        perm[k] = static_cast<Index>(i);
+        for (size_t d = 0; d < D; ++d) xq[d * npts + k] = q[d];
+    }
+    for (size_t c = ncells; c > 0; --c) cell_start[c] = cell_start[c - 1];
+    cell_start[0] = 0;
+    index_timer.stop();
+
+    phase_timer link_timer(stats, "link");
+    const double bq = linking_length / frame.unit;
+    const std::uint64_t threshold = bq * bq >= 1.8e19 ? std::numeric_limits<std::uint64_t>::max()
+                                                      : static_cast<std::uint64_t>(std::ceil(bq * bq));
+
+    // Group of every point in cell order, `unset` until reached, and the points in the order they were reached
+    const Index unset = std::numeric_limits<Index>::max();
+    std::vector<Index> label(npts, unset);
+    std::vector<Index> order;
+    order.reserve(npts);
+    allocations += 2;
+
+    std::uint64_t d2[GRID_CHUNK];
+    size_t neighbours[27];
+    Index ngroups = 0;
+    for (size_t seed = 0; seed < npts; ++seed) {
+        if (label[seed] != unset) {
+            continue;
+        }
+        label[seed] = ngroups;
+        size_t head = order.size();
+        order.push_back(static_cast<Index>(seed));
+
+        // Expand the frontier until no new friends are found
+        while (head < order.size()) {
+            const size_t k = order[head++];
+            std::uint32_t p[D];
+            size_t c[D];
+            bool below[D], above[D];
+            for (size_t d = 0; d < D; ++d) {
+                p[d] = xq[d * npts + k];
+                c[d] = cell_of(p[d]);
+                // Cells are several linking lengths wide, so most points are too far from a face for the
+                // cell beyond it to hold friends; with fewer than three cells the neighbours overlap
+                const std::uint64_t dlo = static_cast<std::uint64_t>(p[d]) + 1 - cell_low(c[d]);
+                const std::uint64_t dhi = cell_low(c[d] + 1) - p[d];
+                below[d] = ncell < 3 || dlo * dlo < threshold;
+                above[d] = ncell < 3 || dhi * dhi < threshold;
+            }
+
+            // The 3^D cells around the point, wrapped in a periodic box and clipped otherwise
+            size_t nn = 0;
+            for (size_t o = 0; o < nneighbours; ++o) {
+                size_t id = 0, r = o, stride = 1;
+                bool inside = true;
+                for (size_t d = 0; d < D; ++d, r /= 3, stride *= ncell) {
+                    if ((r % 3 == 0 && !below[d]) || (r % 3 == 2 && !above[d])) {
+                        inside = false;
+                        break;
+                    }
+                    long cd = static_cast<long>(c[d]) + static_cast<long>(r % 3) - 1;
+                    if (cd < 0 || cd >= static_cast<long>(ncell)) {
+                        if (!frame.periodic) {
+                            inside = false;
+                            break;
+                        }
+                        cd = (cd + static_cast<long>(ncell)) % static_cast<long>(ncell);
+                    }
+                    id += static_cast<size_t>(cd) * stride;
+                }
+                if (inside) neighbours[nn++] = id;
+            }
+            // With fewer than three cells per side the wrapped neighbours repeat
+            if (ncell < 3) {
+                std::sort(neighbours, neighbours + nn);
+                nn = std::unique(neighbours, neighbours + nn) - neighbours;
+            }
+
+            for (size_t n = 0; n < nn; ++n) {
+                const size_t end = cell_start[neighbours[n] + 1];
+                for (size_t begin = cell_start[neighbours[n]]; begin < end; begin += GRID_CHUNK) {
+                    const size_t len = std::min(GRID_CHUNK, end - begin);
+                    squared_distances<D>(xq.data(), npts, begin, len, p, d2);
+                    YGG_STATS(tested += len;)
+                    for (size_t j = 0; j < len; ++j) {
+                        if (d2[j] < threshold && label[begin + j] == unset) {
+                            label[begin + j] = ngroups;
+                            order.push_back(static_cast<Index>(begin + j));
+                            YGG_STATS(++linked;)
+                        }
+                    }
+                }
+            }
+        }
+
+        push_back_counted(catalog.offsets, order.size(), allocations);
+        ++ngroups;
+    }
+    link_timer.stop();
+
+    phase_timer label_timer(stats, "label");
+    catalog.members.resize(npts);
+    catalog.labels.resize(npts);
+    allocations += 2;
+    #pragma omp parallel for schedule(static)
+    for (long k = 0; k < static_cast<long>(npts); ++k) {
+        catalog.members[k] = perm[order[k]];
+        catalog.labels[perm[k]] = label[k];
+    }
+    // Reads of the order, permutation (twice) and labels, writes of the members and labels
+    label_timer.add_bytes(npts * (4 * sizeof(Index) + sizeof(size_t) + sizeof(std::int64_t)));
+    label_timer.stop();
+
+    YGG_STATS(
+        if (stats) {
+            stats->points_visited += npts;
+            stats->pairs_tested += tested;
+            stats->pairs_linked += linked;
+            stats->allocations += allocations;
+            stats->resolution_error = frame.resolution_error(D, linking_length);
+        }
+    )
+    (void)allocations;
+
+    return catalog;
+}
+
+} // End of anonymous namespace
+
+// Dispatch on the dimension, and on the index width; the integer kernel needs D <= 3 for its 64-bit sums
+group_catalog friends_of_friends_grid(const double *data, size_t npts, size_t ndim, double linking_length, double boxsize,
+                                      unsigned bits, fof_stats *stats) {
+    // One value of the 32-bit indices is kept for unreached points
+    if (npts < std::numeric_limits<std::uint32_t>::max()) {
+        switch (ndim) {
+            case 1: return grid_friends_of_friends<1, std::uint32_t>(data, npts, linking_length, boxsize, bits, stats);
+            case 2: return grid_friends_of_friends<2, std::uint32_t>(data, npts, linking_length, boxsize, bits, stats);
+            case 3: return grid_friends_of_friends<3, std::uint32_t>(data, npts, linking_length, boxsize, bits, stats);
+            default: throw std::invalid_argument("the grid engine supports 1 to 3 dimensions");
+        }
+    }
+    switch (ndim) {
+        case 1: return grid_friends_of_friends<1, std::uint64_t>(data, npts, linking_length, boxsize, bits, stats);
+        case 2: return grid_friends_of_friends<2, std::uint64_t>(data, npts, linking_length, boxsize, bits, stats);
+        case 3: return grid_friends_of_friends<3, std::uint64_t>(data, npts, linking_length, boxsize, bits, stats);
+        default: throw std::invalid_argument("the grid engine supports 1 to 3 dimensions");
+    }
+}
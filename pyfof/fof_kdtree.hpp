@@ -0,0 +1,156 @@
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+
+#include "groups.hpp"
+#include "kdtree.hpp"
+#include "stats.hpp"
+
+/**
+ * @brief Continue the linking of `link_kdtree_groups` from the state it had after `ngroups` groups.
+ *
+ * `label` and `order` must hold that state, with room reserved in `order` for every point, and every
+ * point before `first_seed` in tree order must already be assigned. The seed of a group is the first
+ * point it reached, so after group g the linking resumes from `order[begin_g] + 1`.
+ *
+ * @return std::int64_t Number of groups found, including the first `ngroups`.
+ */
+template <std::size_t D, typename OnGroup>
+std::int64_t resume_kdtree_groups(const kd_tree<D> &tree, double linking_length, std::vector<std::int64_t> &label,
+                                  std::vector<std::size_t> &order, std::int64_t ngroups, std::size_t first_seed,
+                                  OnGroup &&on_group, fof_stats *stats) {
+    const std::size_t npts = tree.size();
+    const double b2 = linking_length * linking_length;
+    const std::size_t reached = order.size();
+    YGG_STATS(std::uint64_t nodes = 0, tested = 0, linked = 0;)
+
+    for (std::size_t seed = first_seed; seed < npts; ++seed) {
+        if (label[seed] >= 0) {
+            continue;
+        }
+        label[seed] = ngroups;
+        const std::size_t begin = order.size();
+        std::size_t head = begin;
+        order.push_back(seed);
+
+        // Expand the frontier until no new friends are found
+        while (head < order.size()) {
+            const std::size_t k = order[head++];
+            const auto cost = tree.ball_query(tree.point(k), linking_length, [&](std::size_t j, double d2) {
+                if (label[j] < 0 && d2 < b2) {
+                    label[j] = ngroups;
+                    order.push_back(j);
+                    YGG_STATS(++linked;)
+                }
+            });
+            YGG_STATS(nodes += cost.nodes; tested += cost.distances;)
+            (void)cost;
+        }
+
+        ++ngroups;
+        if (!on_group(begin, order.size())) {
+            break;
+        }
+    }
+
+    YGG_STATS(
+        if (stats) {
+            stats->npts = npts;
+            stats->points_visited += order.size() - reached;
+            stats->pairs_tested += tested;
+            stats->pairs_linked += linked;
+            stats->nodes_touched += nodes;
+        }
+    )
+    (void)reached;
+    return ngroups;
+}
+
+/**
+ * @brief Grow the friends-of-friends groups of a kd-tree one after the other.
+ *
+ * Groups are grown breadth-first from the next unassigned point in tree order, so neighbouring
+ * queries touch neighbouring memory. `label` receives the group of every point in tree order and
+ * `order` the points in the order they were reached, so group g is `order[begin_g, end_g)`; each
+ * group is handed to `on_group(begin, end)` as soon as it is complete, and linking stops early if
+ * it returns false.
+ *
+ * @return std::int64_t Number of groups found.
+ */
+template <std::size_t D, typename OnGroup>
+std::int64_t link_kdtree_groups(const kd_tree<D> &tree, double linking_length, std::vector<std::int64_t> &label,
+                                std::vector<std::size_t> &order, OnGroup &&on_group, fof_stats *stats) {
+    label.assign(tree.size(), -1);
+    order.clear();
+    order.reserve(tree.size());
+    return resume_kdtree_groups(tree, linking_length, label, order, 0, 0, std::forward<OnGroup>(on_group), stats);
+}
+
+/**
+ * @brief Fill the members and labels of a catalog from the state left by `link_kdtree_groups`.
+ *
+ * Runs as the "label" phase; the offsets must already be in the catalog.
+ */
+template <std::size_t D>
+void label_kdtree_catalog(const kd_tree<D> &tree, const std::vector<std::int64_t> &label,
+                          const std::vector<std::size_t> &order, group_catalog &catalog, fof_stats *stats) {
+    const std::size_t npts = tree.size();
+
+    // Both outputs are left untouched by the resize and first written by the static loop
+    phase_timer label_timer(stats, "label");
+    catalog.members.resize(npts);
+    catalog.labels.resize(npts);
+    #pragma omp parallel for schedule(static)
+    for (long k = 0; k < static_cast<long>(npts); ++k) {
+        catalog.members[k] = tree.index(order[k]);
+        catalog.labels[tree.index(k)] = label[k];
+    }
+    // Reads of the order, permutation (twice) and labels, writes of the members and labels
+    label_timer.add_bytes(npts * (4 * sizeof(std::size_t) + 2 * sizeof(std::int64_t)));
+}
+
+/**
+ * @brief Perform friends-of-friends clustering on a prebuilt kd-tree.
+ *
+ * The groups are those of `link_kdtree_groups`. Because the tree is not modified, the same index can
+ * be reused afterwards by the per-group stages, and the result is a CSR catalog rather than one
+ * vector per group.
+ *
+ * @tparam D Dimensionality of the space in which the points exist.
+ * @param tree The spatial index, built with the periodic box size to use.
+ * @param linking_length Maximum distance between points to be considered part of the same cluster.
+ * @param stats Optional statistics, receiving the "link" and "label" phases and the work counters.
+ * @return group_catalog Groups with members given as indices into the array the tree was built from.
+ */
+template <std::size_t D>
+group_catalog friends_of_friends_kdtree(const kd_tree<D> &tree, double linking_length, fof_stats *stats = nullptr) {
+    phase_timer link_timer(stats, "link");
+
+    // Group of every point in tree order, and the points in the order they were reached
+    std::vector<std::int64_t> label;
+    std::vector<std::size_t> order;
+
+    group_catalog catalog;
+    catalog.offsets.reserve(1);
+    catalog.offsets.push_back(0);
+    std::uint64_t allocations = 3;
+
+    link_kdtree_groups(tree, linking_length, label, order, [&](std::size_t, std::size_t end) {
+        push_back_counted(catalog.offsets, end, allocations);
+        return true;
+    }, stats);
+
+    link_timer.stop();
+    label_kdtree_catalog(tree, label, order, catalog, stats);
+
+    YGG_STATS(
+        if (stats) {
+            stats->allocations += allocations + 2;  // Members and labels of the catalog
+        }
+    )
+    (void)allocations;
+
+    return catalog;
+}
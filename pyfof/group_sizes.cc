@@ -0,0 +1,31 @@
+#include "group_sizes.hpp"
+
+#include <stdexcept>
+
+// Typedef for convenience
+typedef std::size_t size_t;
+
+namespace {
+
+template <size_t D>
+group_size_summary tree_group_sizes(const double *data, size_t npts, double linking_length, double boxsize,
+                                    const std::vector<size_t> &edges, size_t top_k, bool keep_sizes,
+                                    fof_stats *stats) {
+    const kd_tree<D> tree(data, npts, boxsize, 16, stats);
+    return kdtree_group_sizes(tree, linking_length, edges, top_k, keep_sizes, stats);
+}
+
+} // End of anonymous namespace
+
+group_size_summary group_sizes(const double *data, size_t npts, size_t ndim, double linking_length, double boxsize,
+                               const std::vector<size_t> &edges, size_t top_k, bool keep_sizes, fof_stats *stats) {
+    switch (ndim) {
+        case 1: return tree_group_sizes<1>(data, npts, linking_length, boxsize, edges, top_k, keep_sizes, stats);
+        case 2: return tree_group_sizes<2>(data, npts, linking_length, boxsize, edges, top_k, keep_sizes, stats);
+        case 3: return tree_group_sizes<3>(data, npts, linking_length, boxsize, edges, top_k, keep_sizes, stats);
+        case 4: return tree_group_sizes<4>(data, npts, linking_length, boxsize, edges, top_k, keep_sizes, stats);
+        case 5: return tree_group_sizes<5>(data, npts, linking_length, boxsize, edges, top_k, keep_sizes, stats);
+        case 6: return tree_group_sizes<6>(data, npts, linking_length, boxsize, edges, top_k, keep_sizes, stats);
+        default: throw std::invalid_argument("the kd-tree engine supports 1 to 6 dimensions");
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "fof_kdtree.hpp"
+#include "kdtree.hpp"
+#include "stats.hpp"
+
+/**
+ * @brief Group multiplicity of a friends-of-friends run, without the member lists.
+ *
+ * Groups are numbered as in the catalog of `friends_of_friends_kdtree` on the same tree, so a group
+ * of interest can be looked up in a full run afterwards.
+ */
+struct group_size_summary {
+    std::size_t ngroups = 0;              ///< Number of groups, isolated points included.
+    std::vector<std::size_t> edges;       ///< Bin edges in members, increasing.
+    std::vector<std::size_t> counts;      ///< Groups with `edges[i] <= size < edges[i + 1]` (edges.size() - 1 bins).
+    std::vector<std::size_t> top_groups;  ///< The largest groups, by decreasing size then increasing index.
+    std::vector<std::size_t> top_sizes;   ///< Members of each of the largest groups.
+    std::vector<std::size_t> top_seeds;   ///< A member of each of the largest groups, the point it was grown from.
+    std::vector<std::size_t> sizes;       ///< Members of every group, when requested.
+};
+
+/**
+ * @brief Link a kd-tree and keep only the size of every group.
+ *
+ * Each group is reduced to its size as soon as `link_kdtree_groups` completes it: binned, compared
+ * with the `top_k` largest so far (held in a heap) and optionally appended to `sizes`. Beyond the
+ * label and order arrays of the linking no per-point memory is used, and neither the members nor
+ * the labels of the catalog are written, which saves the "label" pass of a full run.
+ *
+ * @tparam D Dimensionality of the space in which the points exist.
+ * @param tree The spatial index, built with the periodic box size to use.
+ * @param linking_length Maximum distance between points to be considered part of the same cluster.
+ * @param edges Bin edges of the histogram, increasing; groups outside them are not binned.
+ * @param top_k Number of largest groups to report.
+ * @param keep_sizes Whether to return the size of every group.
+ * @param stats Optional statistics, receiving the "link" phase and the work counters.
+ * @return group_size_summary The histogram, the largest groups and the sizes.
+ */
+template <std::size_t D>
+group_size_summary kdtree_group_sizes(const kd_tree<D> &tree, double linking_length,
+                                      const std::vector<std::size_t> &edges, std::size_t top_k, bool keep_sizes,
+                                      fof_stats *stats = nullptr) {
+    phase_timer link_timer(stats, "link");
+    group_size_summary summary;
+    summary.edges = edges;
+    summary.counts.assign(edges.size() > 1 ? edges.size() - 1 : 0, 0);
+
+    // Min-heap of the largest groups, the smallest (then latest) one on top
+    struct sized_group {
+        std::size_t size, group, seed;
+    };
+    auto larger = [](const sized_group &a, const sized_group &b) {
+        return a.size > b.size || (a.size == b.size && a.group < b.group);
+    };
+    std::vector<sized_group> top;
+    top.reserve(top_k);
+
+    std::vector<std::int64_t> label;
+    std::vector<std::size_t> order;
+    summary.ngroups = link_kdtree_groups(tree, linking_length, label, order, [&](std::size_t begin, std::size_t end) {
+        const sized_group g = {end - begin, static_cast<std::size_t>(label[order[begin]]), tree.index(order[begin])};
+        const auto bin = std::upper_bound(edges.begin(), edges.end(), g.size);
+        if (bin != edges.begin() && bin != edges.end()) {
+            ++summary.counts[bin - edges.begin() - 1];
+        }
+        if (top.size() < top_k) {
+            top.push_back(g);
+            std::push_heap(top.begin(), top.end(), larger);
+        } else if (top_k > 0 && larger(g, top.front())) {
+            std::pop_heap(top.begin(), top.end(), larger);
+            top.back() = g;
+            std::push_heap(top.begin(), top.end(), larger);
+        }
+        if (keep_sizes) {
+            summary.sizes.push_back(g.size);
+        }
+        return true;
+    }, stats);
+
+    std::sort_heap(top.begin(), top.end(), larger);
+    for (auto const &g : top) {
+        summary.top_groups.push_back(g.group);
+        summary.top_sizes.push_back(g.size);
+        summary.top_seeds.push_back(g.seed);
+    }
+    return summary;
+}
+
+/**
+ * @brief Group multiplicity of a point set, linked with a kd-tree built for the call.
+ *
+ * @param data Pointer to the coordinates, `ndim` contiguous values per point.
+ * @param npts Number of points.
+ * @param ndim Dimensionality of the points, 1 to 6.
+ * @param linking_length Maximum distance between points to be considered part of the same cluster.
+ * @param boxsize Side of the periodic box; non-positive values disable periodic boundaries.
+ * @param edges Bin edges of the histogram, increasing.
+ * @param top_k Number of largest groups to report.
+ * @param keep_sizes Whether to return the size of every group.
+ * @param stats Optional statistics, receiving the "index" and "link" phases.
+ * @return group_size_summary The histogram, the largest groups and the sizes.
+ */
+group_size_summary group_sizes(const double *data, std::size_t npts, std::size_t ndim, double linking_length,
+                               double boxsize, const std::vector<std::size_t> &edges, std::size_t top_k,
+                               bool keep_sizes, fof_stats *stats = nullptr);
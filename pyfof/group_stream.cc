@@ -0,0 +1,110 @@
+#include "group_stream.hpp"
+#include "fof_kdtree.hpp"
+
+#include <stdexcept>
+
+// Typedef for convenience
+typedef std::size_t size_t;
+
+namespace {
+
+/// Build the tree of the points' dimension and run `f` on it.
+template <typename F>
+void with_kd_tree(const double *data, size_t npts, size_t ndim, double boxsize, F &&f) {
+    switch (ndim) {
+        case 1: f(kd_tree<1>(data, npts, boxsize)); break;
+        case 2: f(kd_tree<2>(data, npts, boxsize)); break;
+        case 3: f(kd_tree<3>(data, npts, boxsize)); break;
+        case 4: f(kd_tree<4>(data, npts, boxsize)); break;
+        case 5: f(kd_tree<5>(data, npts, boxsize)); break;
+        case 6: f(kd_tree<6>(data, npts, boxsize)); break;
+        default: throw std::invalid_argument("the kd-tree engine supports 1 to 6 dimensions");
+    }
+}
+
+} // End of anonymous namespace
+
+group_stream::group_stream(const double *data, size_t npts, size_t ndim, double linking_length, double boxsize,
+                           size_t batch_groups, size_t capacity, size_t batch_members)
+    : linking_length_(linking_length), batch_groups_(batch_groups > 0 ? batch_groups : 1),
+      batch_members_(batch_members), queue_(capacity) {
+    if (ndim < 1 || ndim > 6) {
+        throw std::invalid_argument("the kd-tree engine supports 1 to 6 dimensions");
+    }
+    worker_ = std::thread([=] {
+        try {
+            with_kd_tree(data, npts, ndim, boxsize, [this](const auto &tree) { produce(tree); });
+        } catch (...) {
+            error_ = std::current_exception();
+        }
+        queue_.close();
+    });
+}
+
+group_stream::group_stream(const kd_tree3 &tree, double linking_length, size_t batch_groups, size_t capacity,
+                           size_t batch_members)
+    : linking_length_(linking_length), batch_groups_(batch_groups > 0 ? batch_groups : 1),
+      batch_members_(batch_members), queue_(capacity) {
+    worker_ = std::thread([this, &tree] {
+        try {
+            produce(tree);
+        } catch (...) {
+            error_ = std::current_exception();
+        }
+        queue_.close();
+    });
+}
+
+group_stream::~group_stream() {
+    cancel();
+}
+
+// Batches are filled as the groups complete and pushed once full; a refused push means the
+// consumer went away, which stops the linking
+template <size_t D>
+void group_stream::produce(const kd_tree<D> &tree) {
+    std::vector<std::int64_t> label;
+    std::vector<size_t> order;
+    group_batch batch;
+    batch.offsets.push_back(0);
+
+    bool open = true;
+    link_kdtree_groups(tree, linking_length_, label, order, [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            batch.members.push_back(tree.index(order[k]));
+        }
+        batch.offsets.push_back(batch.members.size());
+        if (batch.offsets.size() > batch_groups_ || batch.members.size() >= batch_members_) {
+            open = queue_.push(std::move(batch));
+            batch = group_batch();
+            batch.offsets.push_back(0);
+        }
+        return open;
+    }, nullptr);
+
+    if (open && batch.offsets.size() > 1) {
+        queue_.push(std::move(batch));
+    }
+}
+
+bool group_stream::next(group_batch &batch) {
+    if (queue_.pop(batch)) {
+        return true;
+    }
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+    if (error_) {
+        std::exception_ptr error = error_;
+        error_ = nullptr;
+        std::rethrow_exception(error);
+    }
+    return false;
+}
+
+void group_stream::cancel() {
+    queue_.close();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
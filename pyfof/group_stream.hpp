@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "kdtree.hpp"
+#include "pipeline.hpp"
+
+/// A run of consecutive groups, in CSR form.
+struct group_batch {
+    std::vector<std::size_t> offsets;  ///< Start of each group in `members`, with a trailing sentinel.
+    std::vector<std::size_t> members;  ///< Particle indices, grouped contiguously.
+};
+
+/**
+ * @brief Friends-of-friends groups produced on a worker thread and consumed while it runs.
+ *
+ * The worker builds a kd-tree over the points (or uses one given by the caller) and links it with
+ * `link_kdtree_groups`, handing every completed group over in batches of at least `batch_groups`
+ * groups, or fewer if they already hold `batch_members` members. Batches go through a
+ * `bounded_queue` of `capacity` entries, so the worker waits while the consumer is that many
+ * batches behind, and no more than the queued batches are ever held. Groups come out in the order
+ * and with the members of `friends_of_friends_kdtree`.
+ *
+ * Destroying the stream, or calling `cancel`, stops the worker at the next completed group.
+ */
+class group_stream {
+public:
+    /**
+     * @brief Start linking a point set on a new thread.
+     *
+     * @param data Coordinates, `ndim` contiguous values per point; must stay alive until the tree is built.
+     * @param npts Number of points.
+     * @param ndim Dimensionality of the points, 1 to 6.
+     * @param linking_length Maximum distance between points to be considered part of the same cluster.
+     * @param boxsize Side of the periodic box; non-positive values disable periodic boundaries.
+     * @param batch_groups Groups per batch.
+     * @param capacity Batches queued at most.
+     * @param batch_members Members after which a batch is handed over even if short of groups.
+     */
+    group_stream(const double *data, std::size_t npts, std::size_t ndim, double linking_length, double boxsize,
+                 std::size_t batch_groups, std::size_t capacity, std::size_t batch_members = 1 << 20);
+
+    /// Start linking the points of an existing tree, which must outlive the stream.
+    group_stream(const kd_tree3 &tree, double linking_length, std::size_t batch_groups, std::size_t capacity,
+                 std::size_t batch_members = 1 << 20);
+
+    ~group_stream();
+
+    group_stream(const group_stream &) = delete;
+    group_stream &operator=(const group_stream &) = delete;
+
+    /**
+     * @brief Wait for the next batch.
+     *
+     * @return bool False once every group was returned; an exception of the worker is rethrown here.
+     */
+    bool next(group_batch &batch);
+
+    /// Ask the worker to stop and wait until it did.
+    void cancel();
+
+private:
+    template <std::size_t D>
+    void produce(const kd_tree<D> &tree);
+
+    double linking_length_;
+    std::size_t batch_groups_;
+    std::size_t batch_members_;
+    bounded_queue<group_batch> queue_;
+    std::exception_ptr error_;
+    std::thread worker_;
+};
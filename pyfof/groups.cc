@@ -0,0 +1,47 @@
+#include "groups.hpp"
+
+#include <stdexcept>
+#include <string>
+
+// Typedef for convenience
+typedef std::size_t size_t;
+
+// Flatten the groups into offsets/members and scatter the group index into the label array
+group_catalog make_group_catalog(const std::vector<std::vector<size_t>> &groups, size_t npts) {
+    group_catalog catalog;
+    catalog.offsets.resize(groups.size() + 1);
+    catalog.labels.assign(npts, -1);
+
+    catalog.offsets[0] = 0;
+    for (size_t g = 0; g < groups.size(); ++g) {
+        catalog.offsets[g + 1] = catalog.offsets[g] + groups[g].size();
+    }
+
+    catalog.members.resize(catalog.offsets.back());
+    for (size_t g = 0; g < groups.size(); ++g) {
+        size_t k = catalog.offsets[g];
+        for (auto i : groups[g]) {
+            if (i >= npts) {
+                throw std::invalid_argument("group " + std::to_string(g) + " refers to particle " + std::to_string(i) +
+                                            " of " + std::to_string(npts));
+            }
+            if (catalog.labels[i] >= 0) {
+                throw std::invalid_argument("particle " + std::to_string(i) + " is in groups " +
+                                            std::to_string(catalog.labels[i]) + " and " + std::to_string(g));
+            }
+            catalog.members[k++] = i;
+            catalog.labels[i] = static_cast<std::int64_t>(g);
+        }
+    }
+
+    return catalog;
+}
+
+// One vector per group, copied from the member ranges
+std::vector<std::vector<size_t>> catalog_groups(const group_catalog &catalog) {
+    std::vector<std::vector<size_t>> groups(catalog.ngroups());
+    for (size_t g = 0; g < groups.size(); ++g) {
+        groups[g].assign(catalog.members.begin() + catalog.offsets[g], catalog.members.begin() + catalog.offsets[g + 1]);
+    }
+    return groups;
+}
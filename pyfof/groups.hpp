@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "memory.hpp"
+
+/**
+ * @brief Compressed (CSR) representation of a friends-of-friends group catalog.
+ *
+ * The members of group g are `members[offsets[g]]` to `members[offsets[g + 1] - 1]`, so the whole
+ * catalog lives in two flat arrays instead of one allocation per group. `labels` is the inverse map,
+ * holding for every particle the index of the group it belongs to, or -1 if it is not in any group.
+ * Both per-particle arrays are `first_touch_vector`s, so the engines place their pages by filling them
+ * in parallel.
+ */
+struct group_catalog {
+    std::vector<std::size_t> offsets;  ///< Start of each group in `members`, with a trailing sentinel (size ngroups + 1).
+    first_touch_vector<std::size_t> members;  ///< Particle indices, grouped contiguously.
+    first_touch_vector<std::int64_t> labels;  ///< Group index of every particle, -1 when unassigned.
+
+    /// Number of groups in the catalog.
+    std::size_t ngroups() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+
+    /// Number of members of group g.
+    std::size_t size(std::size_t g) const { return offsets[g + 1] - offsets[g]; }
+};
+
+/**
+ * @brief Build a CSR group catalog from the list-of-lists output of the FoF engines.
+ *
+ * @param groups Groups of particle indices, as returned by `friends_of_friends`.
+ * @param npts Total number of particles, used to size the label array.
+ * @return group_catalog The catalog with offsets, members and per-particle labels filled.
+ * @throws std::invalid_argument If an index is not below `npts` or appears in two groups.
+ */
+group_catalog make_group_catalog(const std::vector<std::vector<std::size_t>> &groups, std::size_t npts);
+
+/**
+ * @brief Expand a CSR group catalog into one vector of particle indices per group.
+ *
+ * @param catalog The catalog to convert.
+ * @return std::vector<std::vector<size_t>> The groups, in catalog order.
+ */
+std::vector<std::vector<std::size_t>> catalog_groups(const group_catalog &catalog);
@@ -0,0 +1,94 @@
+#include "halo_properties.hpp"
+#include "periodic.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// Typedef for convenience
+typedef std::size_t size_t;
+
+// Parallel per-group reduction over the CSR catalog
+halo_properties compute_halo_properties(const group_catalog &catalog, const double *pos, const double *vel,
+                                        const double *mass, size_t ndim, double particle_mass, double boxsize) {
+    const size_t ngroups = catalog.ngroups();
+
+    halo_properties props;
+    props.ndim = ndim;
+    props.npart.resize(ngroups);
+    props.mass.assign(ngroups, 0.);
+    props.com.assign(ngroups * ndim, 0.);
+    props.extent.assign(ngroups, 0.);
+    if (vel != nullptr) {
+        props.vel.assign(ngroups * ndim, 0.);
+        props.sigma_v.assign(ngroups, 0.);
+    }
+
+    const size_t *members = catalog.members.data();
+    const size_t *offsets = catalog.offsets.data();
+
+    // Groups differ in size by orders of magnitude, so hand them out dynamically
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (long g = 0; g < static_cast<long>(ngroups); ++g) {
+        const size_t begin = offsets[g], end = offsets[g + 1];
+        double *com = &props.com[g * ndim];
+        double *vbulk = vel != nullptr ? &props.vel[g * ndim] : nullptr;
+
+        props.npart[g] = end - begin;
+        if (begin == end) {
+            continue;
+        }
+
+        // First member is the reference for unwrapping positions and for offsetting velocities,
+        // which keeps the second moment well conditioned for fast-moving groups
+        const size_t ref = members[begin];
+        const double *xref = pos + ref * ndim;
+        const double *vref = vel != nullptr ? vel + ref * ndim : nullptr;
+
+        double mtot = 0., v2 = 0.;
+        for (size_t k = begin; k < end; ++k) {
+            const size_t i = members[k];
+            const double m = mass != nullptr ? mass[i] : particle_mass;
+            mtot += m;
+            for (size_t d = 0; d < ndim; ++d) {
+                com[d] += m * periodic_delta(pos[i * ndim + d] - xref[d], boxsize);
+            }
+            if (vbulk != nullptr) {
+                for (size_t d = 0; d < ndim; ++d) {
+                    double dv = vel[i * ndim + d] - vref[d];
+                    vbulk[d] += m * dv;
+                    v2 += m * dv * dv;
+                }
+            }
+        }
+        props.mass[g] = mtot;
+
+        const double inv_m = mtot > 0. ? 1. / mtot : 0.;
+        for (size_t d = 0; d < ndim; ++d) {
+            com[d] = periodic_wrap(xref[d] + com[d] * inv_m, boxsize);
+        }
+        if (vbulk != nullptr) {
+            double vmean2 = 0.;
+            for (size_t d = 0; d < ndim; ++d) {
+                vbulk[d] *= inv_m;
+                vmean2 += vbulk[d] * vbulk[d];
+                vbulk[d] += vref[d];
+            }
+            props.sigma_v[g] = std::sqrt(std::max(0., v2 * inv_m - vmean2) / ndim);
+        }
+
+        // Second sweep over the (now cache-resident) members for the extent around the centre of mass
+        double r2max = 0.;
+        for (size_t k = begin; k < end; ++k) {
+            const size_t i = members[k];
+            double r2 = 0.;
+            for (size_t d = 0; d < ndim; ++d) {
+                double dx = periodic_delta(pos[i * ndim + d] - com[d], boxsize);
+                r2 += dx * dx;
+            }
+            r2max = std::max(r2max, r2);
+        }
+        props.extent[g] = std::sqrt(r2max);
+    }
+
+    return props;
+}
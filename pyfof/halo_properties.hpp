@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdlib>
+#include <vector>
+
+#include "groups.hpp"
+
+/**
+ * @brief Per-group properties measured on a friends-of-friends catalog.
+ *
+ * Vector quantities are stored row-major, `ndim` values per group. The velocity fields are left
+ * empty when no velocities are supplied.
+ */
+struct halo_properties {
+    std::size_t ndim = 0;              ///< Dimensionality of the positions and velocities.
+    std::vector<std::size_t> npart;    ///< Number of members of each group.
+    std::vector<double> mass;          ///< Total mass of each group.
+    std::vector<double> com;           ///< Centre of mass, wrapped back into the box when periodic.
+    std::vector<double> vel;           ///< Mass-weighted bulk velocity.
+    std::vector<double> sigma_v;       ///< One-dimensional mass-weighted velocity dispersion.
+    std::vector<double> extent;        ///< Distance from the centre of mass to the farthest member.
+};
+
+/**
+ * @brief Compute mass, centre of mass, bulk velocity, velocity dispersion and extent of every group.
+ *
+ * Groups are processed in parallel with OpenMP; each thread streams over the contiguous members of
+ * its groups and accumulates directly into the output arrays, so no per-group memory is allocated.
+ * In a periodic box, member positions are unwrapped relative to the first member of the group before
+ * averaging, which keeps the centre of mass of groups straddling the boundary inside the group.
+ *
+ * @param catalog CSR group catalog, as built by `make_group_catalog`.
+ * @param pos Pointer to the particle positions, `ndim` contiguous values per particle.
+ * @param vel Pointer to the particle velocities with the same layout, or nullptr to skip the velocity fields.
+ * @param mass Pointer to the per-particle masses (e.g. the Gadget MASS block), or nullptr to use `particle_mass`.
+ * @param ndim Number of dimensions of positions and velocities.
+ * @param particle_mass Mass assigned to every particle when `mass` is nullptr (e.g. `Header::massarr[1]`).
+ * @param boxsize Side of the periodic box; non-positive values disable periodic unwrapping.
+ * @return halo_properties The per-group properties, indexed like the catalog.
+ */
+halo_properties compute_halo_properties(const group_catalog &catalog, const double *pos, const double *vel,
+                                        const double *mass, std::size_t ndim, double particle_mass, double boxsize);
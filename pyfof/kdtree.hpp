@@ -0,0 +1,514 @@
+#pragma once
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "memory.hpp"
+#include "periodic.hpp"
+#include "stats.hpp"
+
+/**
+ * @brief Persistent kd-tree over a D-dimensional point set, optionally in a periodic box.
+ *
+ * The tree keeps its own copy of the coordinates reordered so that every node covers a contiguous
+ * range of points, which makes leaf scans sequential in memory. Nodes are stored in a flat array in
+ * depth-first order: the left child of node `n` is `n + 1`, the right child is `nodes()[n].right`.
+ * Indices returned by the queries are positions in tree order; `index(k)` maps them back to the
+ * index of the point in the array the tree was built from.
+ *
+ * Once built, the tree is read-only, so any number of threads may query it concurrently. This is
+ * what lets the FoF pass and the later per-group stages (spherical overdensity, ...) share one index.
+ * Between snapshots of a time series the same tree can be refitted to the moved particles with
+ * `update_positions`, which must not run concurrently with queries.
+ *
+ * A tree may also wrap arrays it does not own, such as those of a file written by `save_kd_tree` and
+ * mapped back by `open_kd_tree` (kdtree_io.hpp); the queries read them in place, and the first
+ * `update_positions` copies them into memory of the tree.
+ *
+ * @tparam D Dimensionality of the space in which the points exist.
+ */
+template <std::size_t D>
+class kd_tree {
+public:
+    /// Node of the tree: bounding box of its points and the range they occupy in tree order.
+    struct node {
+        double lo[D];            ///< Lower corner of the bounding box.
+        double hi[D];            ///< Upper corner of the bounding box.
+        std::size_t begin;       ///< First point of the node, in tree order.
+        std::size_t end;         ///< One past the last point of the node.
+        std::size_t right;       ///< Index of the right child, 0 for leaves (the left child is the next node).
+
+        /// True if the node has no children.
+        bool leaf() const { return right == 0; }
+    };
+
+    /// Work done by one query, for the statistics of the engines.
+    struct query_cost {
+        std::size_t nodes;       ///< Nodes visited.
+        std::size_t distances;   ///< Point distances computed.
+    };
+
+    /**
+     * @brief Build the tree.
+     *
+     * Each node is split at the median of its widest dimension. Subtrees above a size threshold are
+     * built as OpenMP tasks.
+     *
+     * @param data Pointer to the point coordinates, D contiguous values per point.
+     * @param npts Number of points.
+     * @param boxsize Side of the periodic box; non-positive values disable periodic boundaries.
+     * @param leaf_size Maximum number of points in a leaf.
+     * @param stats Optional statistics, receiving the "index" phase.
+     */
+    kd_tree(const double *data, std::size_t npts, double boxsize = 0., std::size_t leaf_size = 16,
+            fof_stats *stats = nullptr)
+        : npts_(npts), boxsize_(boxsize), leaf_size_(std::max<std::size_t>(leaf_size, 1)) {
+        YGG_STATS(if (stats) stats->npts = npts_;)
+        phase_timer timer(stats, "index");
+        // The permutation and the coordinates are first touched by the static loops that own their pages
+        perm_.resize(npts_);
+        #pragma omp parallel for schedule(static)
+        for (long k = 0; k < static_cast<long>(npts_); ++k) {
+            perm_[k] = k;
+        }
+        if (npts_ == 0) {
+            own_views();
+            return;
+        }
+
+        nodes_.resize(count_nodes(npts_));
+        #pragma omp parallel
+        #pragma omp single
+        build(data, 0, 0, npts_);
+
+        pos_.resize(npts_ * D);
+        #pragma omp parallel for schedule(static)
+        for (long k = 0; k < static_cast<long>(npts_); ++k) {
+            for (std::size_t d = 0; d < D; ++d) {
+                pos_[k * D + d] = data[perm_[k] * D + d];
+            }
+        }
+        own_views();
+    }
+
+    /**
+     * @brief Wrap the arrays of a tree built earlier, without copying them.
+     *
+     * @param npts Number of points.
+     * @param boxsize Side of the periodic box the tree was built with.
+     * @param leaf_size Maximum number of points in a leaf.
+     * @param pos Coordinates in tree order, D contiguous values per point.
+     * @param perm Map from tree order to input order.
+     * @param nodes Flat node array, root first.
+     * @param nnodes Number of nodes.
+     * @param storage Owner of the arrays, kept alive by the tree and its copies.
+     */
+    kd_tree(std::size_t npts, double boxsize, std::size_t leaf_size, const double *pos, const std::size_t *perm,
+            const node *nodes, std::size_t nnodes, std::shared_ptr<const void> storage)
+        : npts_(npts), boxsize_(boxsize), leaf_size_(std::max<std::size_t>(leaf_size, 1)), storage_(std::move(storage)),
+          pos_view_(pos), perm_view_(perm), nodes_view_(nodes), nnodes_(nnodes) {}
+
+    kd_tree(const kd_tree &other)
+        : npts_(other.npts_), boxsize_(other.boxsize_), leaf_size_(other.leaf_size_), pos_(other.pos_),
+          perm_(other.perm_), nodes_(other.nodes_), storage_(other.storage_), pos_view_(other.pos_view_),
+          perm_view_(other.perm_view_), nodes_view_(other.nodes_view_), nnodes_(other.nnodes_) {
+        if (!storage_) {
+            own_views();
+        }
+    }
+
+    // Moving keeps the buffers, so the views stay valid
+    kd_tree(kd_tree &&) noexcept = default;
+    kd_tree &operator=(kd_tree &&) noexcept = default;
+    kd_tree &operator=(const kd_tree &other) { return *this = kd_tree(other); }
+
+    /**
+     * @brief Move the points to new coordinates, keeping the tree topology where it is still good.
+     *
+     * Coordinates are reloaded in tree order and every bounding box is tightened bottom-up, with large
+     * subtrees refitted as OpenMP tasks. A node whose children now overlap by more than `max_overlap`
+     * of its extent in every dimension no longer lets queries prune either side, so the highest such
+     * nodes have their subtree rebuilt from scratch over the same points. A subtree keeps the same
+     * number of nodes and the same bounding box when rebuilt, so the rest of the tree is unaffected.
+     *
+     * @param data Pointer to the new coordinates, indexed like the array the tree was built from.
+     * @param max_overlap Largest tolerated overlap of sibling boxes, as a fraction of the parent extent.
+     * @return std::size_t Number of points whose subtree was rebuilt.
+     */
+    std::size_t update_positions(const double *data, double max_overlap = 0.25) {
+        if (npts_ == 0) {
+            return 0;
+        }
+        if (storage_) {
+            detach();
+        }
+        // In a periodic box, points that crossed a boundary are kept next to their previous image so
+        // that their leaf does not suddenly span the whole box; they are only wrapped back once far out
+        #pragma omp parallel for schedule(static)
+        for (long k = 0; k < static_cast<long>(npts_); ++k) {
+            for (std::size_t d = 0; d < D; ++d) {
+                double x = data[perm_[k] * D + d];
+                if (boxsize_ > 0.) {
+                    const double u = pos_[k * D + d] + periodic_delta(x - pos_[k * D + d], boxsize_);
+                    x = u >= -0.5 * boxsize_ && u < 1.5 * boxsize_ ? u : periodic_wrap(x, boxsize_);
+                }
+                pos_[k * D + d] = x;
+            }
+        }
+
+        std::vector<std::size_t> degraded;
+        #pragma omp parallel
+        #pragma omp single
+        {
+            refit(0);
+            collect_degraded(0, max_overlap, degraded);
+            for (std::size_t id : degraded) {
+                #pragma omp task firstprivate(id)
+                rebuild(data, id);
+            }
+            #pragma omp taskwait
+        }
+        // Rebuilt subtrees hold the wrapped coordinates, so their ancestors are merged again
+        if (!degraded.empty() && boxsize_ > 0.) {
+            merge_boxes(0);
+        }
+
+        std::size_t rebuilt = 0;
+        for (std::size_t id : degraded) {
+            rebuilt += nodes_[id].end - nodes_[id].begin;
+        }
+        return rebuilt;
+    }
+
+    /// Number of points in the tree.
+    std::size_t size() const { return npts_; }
+
+    /// Side of the periodic box, non-positive if the boundaries are open.
+    double boxsize() const { return boxsize_; }
+
+    /// Maximum number of points in a leaf.
+    std::size_t leaf_size() const { return leaf_size_; }
+
+    /// Coordinates of the k-th point in tree order.
+    const double *point(std::size_t k) const { return pos_view_ + k * D; }
+
+    /// Index in the input array of the k-th point in tree order.
+    std::size_t index(std::size_t k) const { return perm_view_[k]; }
+
+    /// Map from tree order to input order (size() values).
+    const std::size_t *permutation() const { return perm_view_; }
+
+    /// Flat node array, root first (nnodes() values).
+    const node *nodes() const { return nodes_view_; }
+
+    /// Number of nodes.
+    std::size_t nnodes() const { return nnodes_; }
+
+    /// True if the arrays are not owned by the tree, e.g. mapped from a file.
+    bool mapped() const { return static_cast<bool>(storage_); }
+
+    /**
+     * @brief Squared (minimum-image) distance between a point and the k-th point in tree order.
+     */
+    double distance2(const double *x, std::size_t k) const {
+        const double *y = point(k);
+        double d2 = 0.;
+        for (std::size_t d = 0; d < D; ++d) {
+            double dx = periodic_delta(x[d] - y[d], boxsize_);
+            d2 += dx * dx;
+        }
+        return d2;
+    }
+
+    /**
+     * @brief Visit every point within distance r of x.
+     *
+     * @tparam F Callable as `f(std::size_t k, double d2)`, with k in tree order.
+     * @param x Pointer to the D coordinates of the query point.
+     * @param r Radius of the ball; points with d2 <= r^2 are visited.
+     * @param f Visitor.
+     * @return query_cost Nodes visited and distances computed.
+     */
+    template <typename F>
+    query_cost ball_query(const double *x, double r, F &&f) const {
+        query_cost cost = {0, 0};
+        if (nnodes_ == 0) {
+            return cost;
+        }
+        const double r2 = r * r;
+        std::size_t stack[128];
+        std::size_t top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const node &n = nodes_view_[stack[--top]];
+            ++cost.nodes;
+            if (box_distance2(x, n) > r2) {
+                continue;
+            }
+            if (n.leaf()) {
+                cost.distances += n.end - n.begin;
+                for (std::size_t k = n.begin; k < n.end; ++k) {
+                    double d2 = distance2(x, k);
+                    if (d2 <= r2) {
+                        f(k, d2);
+                    }
+                }
+            } else {
+                stack[top++] = n.right;
+                stack[top++] = &n - nodes_view_ + 1;
+            }
+        }
+        return cost;
+    }
+
+    /**
+     * @brief Find the point closest to x.
+     *
+     * A hint, typically the answer to the previous query of a spatially coherent batch, starts the
+     * search with a tight bound so that most of the tree is pruned immediately.
+     *
+     * @param x Pointer to the D coordinates of the query point.
+     * @param d2 Set to the squared distance of the nearest point.
+     * @param hint Tree-order index of a point believed to be close to x, or size() for none.
+     * @return std::size_t Tree-order index of the nearest point, or size() if the tree is empty.
+     */
+    std::size_t nearest(const double *x, double &d2, std::size_t hint) const {
+        std::size_t best = npts_;
+        d2 = std::numeric_limits<double>::infinity();
+        if (nnodes_ == 0) {
+            return best;
+        }
+        if (hint < npts_) {
+            best = hint;
+            d2 = distance2(x, hint);
+        }
+        std::size_t stack[128];
+        std::size_t top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const std::size_t id = stack[--top];
+            const node &n = nodes_view_[id];
+            if (box_distance2(x, n) >= d2) {
+                continue;
+            }
+            if (n.leaf()) {
+                for (std::size_t k = n.begin; k < n.end; ++k) {
+                    double dk = distance2(x, k);
+                    if (dk < d2) {
+                        d2 = dk;
+                        best = k;
+                    }
+                }
+            } else {
+                // Push the farther child first so the closer one is searched first and tightens the bound
+                const std::size_t left = id + 1, right = n.right;
+                if (box_distance2(x, nodes_view_[left]) < box_distance2(x, nodes_view_[right])) {
+                    stack[top++] = right;
+                    stack[top++] = left;
+                } else {
+                    stack[top++] = left;
+                    stack[top++] = right;
+                }
+            }
+        }
+        return best;
+    }
+
+    /// Nearest point without a hint.
+    std::size_t nearest(const double *x, double &d2) const { return nearest(x, d2, npts_); }
+
+    /**
+     * @brief Squared (minimum-image) distance between a point and the bounding box of a node.
+     */
+    double box_distance2(const double *x, const node &n) const {
+        double d2 = 0.;
+        for (std::size_t d = 0; d < D; ++d) {
+            double dx = 0.;
+            if (x[d] < n.lo[d]) {
+                dx = n.lo[d] - x[d];
+                if (boxsize_ > 0.) dx = std::min(dx, std::max(0., x[d] + boxsize_ - n.hi[d]));
+            } else if (x[d] > n.hi[d]) {
+                dx = x[d] - n.hi[d];
+                if (boxsize_ > 0.) dx = std::min(dx, std::max(0., n.lo[d] - x[d] + boxsize_));
+            }
+            d2 += dx * dx;
+        }
+        return d2;
+    }
+
+private:
+    /// Point the views at the arrays owned by the tree.
+    void own_views() {
+        pos_view_ = pos_.data();
+        perm_view_ = perm_.data();
+        nodes_view_ = nodes_.data();
+        nnodes_ = nodes_.size();
+    }
+
+    /// Copy wrapped arrays into memory of the tree, so that they can be modified.
+    void detach() {
+        pos_.assign(pos_view_, pos_view_ + npts_ * D);
+        perm_.assign(perm_view_, perm_view_ + npts_);
+        nodes_.assign(nodes_view_, nodes_view_ + nnodes_);
+        storage_.reset();
+        own_views();
+    }
+
+    /// Number of nodes of a subtree holding n points.
+    std::size_t count_nodes(std::size_t n) const {
+        if (n <= leaf_size_) {
+            return 1;
+        }
+        return 1 + count_nodes(n / 2) + count_nodes(n - n / 2);
+    }
+
+    /// Recursively build the subtree of node `id` over the points [begin, end) of the permutation.
+    void build(const double *data, std::size_t id, std::size_t begin, std::size_t end) {
+        node &n = nodes_[id];
+        n.begin = begin;
+        n.end = end;
+        n.right = 0;
+
+        for (std::size_t d = 0; d < D; ++d) {
+            n.lo[d] = std::numeric_limits<double>::infinity();
+            n.hi[d] = -std::numeric_limits<double>::infinity();
+        }
+        for (std::size_t k = begin; k < end; ++k) {
+            const double *x = data + perm_[k] * D;
+            for (std::size_t d = 0; d < D; ++d) {
+                n.lo[d] = std::min(n.lo[d], x[d]);
+                n.hi[d] = std::max(n.hi[d], x[d]);
+            }
+        }
+        if (end - begin <= leaf_size_) {
+            return;
+        }
+
+        std::size_t axis = 0;
+        for (std::size_t d = 1; d < D; ++d) {
+            if (n.hi[d] - n.lo[d] > n.hi[axis] - n.lo[axis]) axis = d;
+        }
+
+        const std::size_t mid = begin + (end - begin) / 2;
+        std::nth_element(perm_.begin() + begin, perm_.begin() + mid, perm_.begin() + end,
+                         [data, axis](std::size_t a, std::size_t b) { return data[a * D + axis] < data[b * D + axis]; });
+
+        const std::size_t left = id + 1;
+        const std::size_t right = left + count_nodes(mid - begin);
+        n.right = right;
+
+        #pragma omp task if (end - begin > 65536)
+        build(data, left, begin, mid);
+        build(data, right, mid, end);
+        #pragma omp taskwait
+    }
+
+    /// Recompute the bounding boxes of the subtree of node `id` from the current coordinates.
+    void refit(std::size_t id) {
+        node &n = nodes_[id];
+        if (n.leaf()) {
+            for (std::size_t d = 0; d < D; ++d) {
+                n.lo[d] = std::numeric_limits<double>::infinity();
+                n.hi[d] = -std::numeric_limits<double>::infinity();
+            }
+            for (std::size_t k = n.begin; k < n.end; ++k) {
+                const double *x = point(k);
+                for (std::size_t d = 0; d < D; ++d) {
+                    n.lo[d] = std::min(n.lo[d], x[d]);
+                    n.hi[d] = std::max(n.hi[d], x[d]);
+                }
+            }
+            return;
+        }
+
+        #pragma omp task if (n.end - n.begin > 65536)
+        refit(id + 1);
+        refit(n.right);
+        #pragma omp taskwait
+
+        merge_children(n, nodes_[id + 1], nodes_[n.right]);
+    }
+
+    /// Recompute the bounding boxes of the internal nodes of the subtree of node `id` from their children.
+    void merge_boxes(std::size_t id) {
+        node &n = nodes_[id];
+        if (n.leaf()) {
+            return;
+        }
+        merge_boxes(id + 1);
+        merge_boxes(n.right);
+        merge_children(n, nodes_[id + 1], nodes_[n.right]);
+    }
+
+    /// Set the bounding box of `n` to the union of the boxes of its children.
+    static void merge_children(node &n, const node &l, const node &r) {
+        for (std::size_t d = 0; d < D; ++d) {
+            n.lo[d] = std::min(l.lo[d], r.lo[d]);
+            n.hi[d] = std::max(l.hi[d], r.hi[d]);
+        }
+    }
+
+    /// True if the children of internal node `n` overlap by more than `max_overlap` in every dimension.
+    bool degraded(const node &n, double max_overlap) const {
+        const node &l = nodes_[&n - nodes_.data() + 1], &r = nodes_[n.right];
+        bool spread = false;
+        for (std::size_t d = 0; d < D; ++d) {
+            const double extent = n.hi[d] - n.lo[d];
+            if (extent <= 0.) {
+                continue;
+            }
+            const double overlap = std::max(0., std::min(l.hi[d], r.hi[d]) - std::max(l.lo[d], r.lo[d]));
+            if (overlap <= max_overlap * extent) {
+                return false;
+            }
+            spread = true;
+        }
+        // Coincident points cannot be split any better
+        return spread;
+    }
+
+    /// Append to `out` the highest degraded nodes of the subtree of node `id`.
+    void collect_degraded(std::size_t id, double max_overlap, std::vector<std::size_t> &out) const {
+        const node &n = nodes_[id];
+        if (n.leaf()) {
+            return;
+        }
+        if (degraded(n, max_overlap)) {
+            out.push_back(id);
+            return;
+        }
+        collect_degraded(id + 1, max_overlap, out);
+        collect_degraded(n.right, max_overlap, out);
+    }
+
+    /// Rebuild the subtree of node `id` over the same points and reload their coordinates.
+    void rebuild(const double *data, std::size_t id) {
+        const std::size_t begin = nodes_[id].begin, end = nodes_[id].end;
+        build(data, id, begin, end);
+        for (std::size_t k = begin; k < end; ++k) {
+            for (std::size_t d = 0; d < D; ++d) {
+                pos_[k * D + d] = data[perm_[k] * D + d];
+            }
+        }
+    }
+
+    std::size_t npts_;
+    double boxsize_;
+    std::size_t leaf_size_;
+    first_touch_vector<double> pos_;
+    first_touch_vector<std::size_t> perm_;
+    std::vector<node> nodes_;
+    std::shared_ptr<const void> storage_;  ///< Owner of wrapped arrays, null when the tree owns them.
+
+    // Arrays read by the queries: those above, or wrapped ones
+    const double *pos_view_ = nullptr;
+    const std::size_t *perm_view_ = nullptr;
+    const node *nodes_view_ = nullptr;
+    std::size_t nnodes_ = 0;
+};
+
+/// Three-dimensional tree, the common case for cosmological snapshots.
+typedef kd_tree<3> kd_tree3;
@@ -0,0 +1,246 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "kdtree.hpp"
+
+/**
+ * @file kdtree_io.hpp
+ * @brief Built kd-trees saved to disk and mapped back in place.
+ *
+ * A file holds a header followed by the coordinates in tree order, the permutation and the flat node
+ * array, each starting on a `KD_TREE_FILE_ALIGN` boundary. Reopening it maps the file read-only:
+ * nothing is read or copied until the queries touch it, and every process that maps the same file
+ * on a node shares its pages through the page cache. Files are only read back on machines with the
+ * byte order and node layout they were written with.
+ */
+
+/// Version of the file layout written by `save_kd_tree`.
+const std::uint32_t KD_TREE_FILE_VERSION = 1;
+
+/// Alignment of the sections of a file, a page.
+const std::size_t KD_TREE_FILE_ALIGN = 4096;
+
+/// Header at the start of a kd-tree file.
+struct kd_tree_file_header {
+    char magic[8];               ///< "YGGKDTRE".
+    std::uint32_t version;       ///< `KD_TREE_FILE_VERSION`.
+    std::uint32_t byte_order;    ///< 0x01020304 as written by the machine that saved the file.
+    std::uint64_t dimension;     ///< Dimensionality of the points.
+    std::uint64_t npts;          ///< Number of points.
+    double boxsize;              ///< Side of the periodic box, non-positive if the boundaries are open.
+    std::uint64_t leaf_size;     ///< Maximum number of points in a leaf.
+    std::uint64_t nnodes;        ///< Number of nodes.
+    std::uint64_t node_bytes;    ///< Size of a node, which fixes its layout.
+    std::uint64_t checksum;      ///< Identifies the data the tree was built from, as given by the writer.
+    std::uint64_t data_hash;     ///< Hash of the three sections, checked on request.
+    std::uint64_t pos_offset;    ///< Offset of the coordinates.
+    std::uint64_t perm_offset;   ///< Offset of the permutation.
+    std::uint64_t nodes_offset;  ///< Offset of the nodes.
+    std::uint64_t file_bytes;    ///< Size of the whole file.
+};
+
+/// Data a file is expected to index, compared with its header when it is opened.
+struct kd_tree_source {
+    std::size_t npts;            ///< Number of points.
+    double boxsize;              ///< Side of the periodic box.
+    std::uint64_t checksum;      ///< Identifier of the data, e.g. a hash of the snapshot header.
+};
+
+/**
+ * @brief 64-bit hash of a buffer, eight bytes at a time.
+ *
+ * @param h Seed, or the hash of the preceding buffers to chain them.
+ */
+inline std::uint64_t hash_bytes(const void *data, std::size_t bytes, std::uint64_t h = 1469598103934665603ull) {
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    for (; bytes >= 8; bytes -= 8, p += 8) {
+        std::uint64_t w;
+        std::memcpy(&w, p, 8);
+        h = (h ^ w) * 1099511628211ull;
+        h ^= h >> 29;
+    }
+    for (; bytes > 0; --bytes, ++p) {
+        h = (h ^ *p) * 1099511628211ull;
+    }
+    return h;
+}
+
+namespace kd_tree_io {
+
+const char MAGIC[8] = {'Y', 'G', 'G', 'K', 'D', 'T', 'R', 'E'};
+const std::uint32_t ORDER_MARK = 0x01020304;
+
+inline std::uint64_t aligned(std::uint64_t offset) {
+    return (offset + KD_TREE_FILE_ALIGN - 1) / KD_TREE_FILE_ALIGN * KD_TREE_FILE_ALIGN;
+}
+
+/// Set the section offsets and file size of a header from its number of points, dimension and nodes.
+inline void lay_out(kd_tree_file_header &header) {
+    header.pos_offset = aligned(sizeof(header));
+    header.perm_offset = aligned(header.pos_offset + header.npts * header.dimension * sizeof(double));
+    header.nodes_offset = aligned(header.perm_offset + header.npts * sizeof(std::size_t));
+    header.file_bytes = header.nodes_offset + header.nnodes * header.node_bytes;
+}
+
+inline std::uint64_t sections_hash(const char *base, const kd_tree_file_header &header) {
+    std::uint64_t h = hash_bytes(base + header.pos_offset, header.npts * header.dimension * sizeof(double));
+    h = hash_bytes(base + header.perm_offset, header.npts * sizeof(std::size_t), h);
+    return hash_bytes(base + header.nodes_offset, header.nnodes * header.node_bytes, h);
+}
+
+} // namespace kd_tree_io
+
+/// Hash of the coordinates, permutation and nodes of a tree, as stored by `save_kd_tree`.
+template <std::size_t D>
+std::uint64_t hash_kd_tree(const kd_tree<D> &tree) {
+    std::uint64_t h = hash_bytes(tree.point(0), tree.size() * D * sizeof(double));
+    h = hash_bytes(tree.permutation(), tree.size() * sizeof(std::size_t), h);
+    return hash_bytes(tree.nodes(), tree.nnodes() * sizeof(typename kd_tree<D>::node), h);
+}
+
+/**
+ * @brief Save a tree, replacing the file atomically so that readers never see it half written.
+ *
+ * @param tree The tree.
+ * @param path File to write.
+ * @param checksum Identifier of the data the tree was built from, checked when it is opened.
+ */
+template <std::size_t D>
+void save_kd_tree(const kd_tree<D> &tree, const std::string &path, std::uint64_t checksum) {
+    typedef typename kd_tree<D>::node node;
+    kd_tree_file_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kd_tree_io::MAGIC, sizeof(header.magic));
+    header.version = KD_TREE_FILE_VERSION;
+    header.byte_order = kd_tree_io::ORDER_MARK;
+    header.dimension = D;
+    header.npts = tree.size();
+    header.boxsize = tree.boxsize();
+    header.leaf_size = tree.leaf_size();
+    header.nnodes = tree.nnodes();
+    header.node_bytes = sizeof(node);
+    header.checksum = checksum;
+
+    const std::uint64_t pos_bytes = header.npts * D * sizeof(double);
+    const std::uint64_t perm_bytes = header.npts * sizeof(std::size_t);
+    const std::uint64_t nodes_bytes = header.nnodes * sizeof(node);
+    kd_tree_io::lay_out(header);
+
+    header.data_hash = hash_kd_tree(tree);
+
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        const std::string padding(KD_TREE_FILE_ALIGN, '\0');
+        auto section = [&](std::uint64_t offset, const void *data, std::uint64_t bytes) {
+            const std::uint64_t at = static_cast<std::uint64_t>(out.tellp());
+            out.write(padding.data(), static_cast<std::streamsize>(offset - at));
+            out.write(static_cast<const char *>(data), static_cast<std::streamsize>(bytes));
+        };
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        section(header.pos_offset, tree.point(0), pos_bytes);
+        section(header.perm_offset, tree.permutation(), perm_bytes);
+        section(header.nodes_offset, tree.nodes(), nodes_bytes);
+        if (!out.flush()) {
+            std::remove(tmp.c_str());
+            throw std::runtime_error("cannot write " + tmp);
+        }
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("cannot replace " + path);
+    }
+}
+
+/**
+ * @brief Read and check the header of a kd-tree file.
+ *
+ * @throws std::invalid_argument If the file is not a kd-tree file readable on this machine.
+ */
+inline kd_tree_file_header read_kd_tree_header(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::invalid_argument("cannot open " + path);
+    }
+    kd_tree_file_header header;
+    in.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!in || std::memcmp(header.magic, kd_tree_io::MAGIC, sizeof(header.magic)) != 0) {
+        throw std::invalid_argument(path + " is not a kd-tree file");
+    }
+    if (header.version != KD_TREE_FILE_VERSION || header.byte_order != kd_tree_io::ORDER_MARK) {
+        throw std::invalid_argument(path + " was written by another version or on another machine");
+    }
+    return header;
+}
+
+/**
+ * @brief Map a tree saved by `save_kd_tree`, after checking that it indexes the expected data.
+ *
+ * @param path File to open.
+ * @param expected Number of points, box size and checksum the file must have been saved with.
+ * @param verify Also hash the whole file against the hash stored when it was saved, which reads it.
+ * @return kd_tree<D> The tree, reading the mapped file in place.
+ * @throws std::invalid_argument If the file does not match or is damaged.
+ */
+template <std::size_t D>
+kd_tree<D> open_kd_tree(const std::string &path, const kd_tree_source &expected, bool verify = false) {
+    typedef typename kd_tree<D>::node node;
+    const kd_tree_file_header header = read_kd_tree_header(path);
+    if (header.dimension != D || header.node_bytes != sizeof(node)) {
+        throw std::invalid_argument(path + " holds a tree of another dimension or layout");
+    }
+    if (header.npts != expected.npts || header.boxsize != expected.boxsize || header.checksum != expected.checksum) {
+        throw std::invalid_argument(path + " was built from other data: the number of points, box size or "
+                                           "checksum differ");
+    }
+    // A tree has no node without points and at most 2 npts - 1 nodes, which also bounds the node section
+    kd_tree_file_header layout = header;
+    kd_tree_io::lay_out(layout);
+    if ((header.nnodes == 0) != (header.npts == 0) || header.nnodes > 2 * header.npts
+        || header.pos_offset != layout.pos_offset || header.perm_offset != layout.perm_offset
+        || header.nodes_offset != layout.nodes_offset || header.file_bytes != layout.file_bytes) {
+        throw std::invalid_argument(path + " is damaged: its sections are not where its header says");
+    }
+
+    const int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || static_cast<std::uint64_t>(st.st_size) < header.file_bytes) {
+        if (fd >= 0) close(fd);
+        throw std::invalid_argument(path + " is truncated");
+    }
+    const std::size_t bytes = static_cast<std::size_t>(st.st_size);
+    void *map = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        throw std::runtime_error("cannot map " + path);
+    }
+    std::shared_ptr<const void> storage(map, [bytes](const void *p) { munmap(const_cast<void *>(p), bytes); });
+
+    const char *base = static_cast<const char *>(map);
+    if (verify && kd_tree_io::sections_hash(base, header) != header.data_hash) {
+        throw std::invalid_argument(path + " is damaged: its contents do not match their hash");
+    }
+    return kd_tree<D>(header.npts, header.boxsize, header.leaf_size,
+                      reinterpret_cast<const double *>(base + header.pos_offset),
+                      reinterpret_cast<const std::size_t *>(base + header.perm_offset),
+                      reinterpret_cast<const node *>(base + header.nodes_offset), header.nnodes, std::move(storage));
+}
+
+/// `open_kd_tree` returning the tree on the heap, for callers that hold it through a pointer.
+template <std::size_t D>
+std::unique_ptr<kd_tree<D>> open_kd_tree_ptr(const std::string &path, const kd_tree_source &expected,
+                                             bool verify = false) {
+    return std::unique_ptr<kd_tree<D>>(new kd_tree<D>(open_kd_tree<D>(path, expected, verify)));
+}
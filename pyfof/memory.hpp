@@ -0,0 +1,113 @@
+#pragma once
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include <sys/mman.h>
+
+/**
+ * @file memory.hpp
+ * @brief Placement of the large arrays of the engines: first touch by their owner and huge pages.
+ *
+ * On a multi-socket node a page lives in the memory of the socket whose thread first writes it. The
+ * coordinate, index and label arrays of the engines therefore use `first_touch_vector`, whose
+ * `resize` leaves the new elements uninitialised, and are filled by `schedule(static)` loops: each
+ * thread then owns the pages of the chunk it processes in the later static loops. Binding the OpenMP
+ * threads (for instance `OMP_PLACES=cores OMP_PROC_BIND=close`) keeps thread t on the same socket in
+ * every team, so the placement holds across phases and even for teams started by other threads.
+ *
+ * Arrays of at least `HUGE_PAGE_BYTES` are aligned to 2 MiB and, when huge pages are enabled (by
+ * `set_huge_pages` or a nonzero `YGG_HUGE_PAGES` in the environment), advised to be backed by
+ * transparent huge pages, which cuts the TLB misses of random accesses.
+ */
+
+/// Arrays of at least this many bytes are aligned to, and may be backed by, 2 MiB huge pages.
+const std::size_t HUGE_PAGE_BYTES = std::size_t(2) << 20;
+
+/// Process-wide huge page switch, initialised from the `YGG_HUGE_PAGES` environment variable.
+inline std::atomic<bool> &huge_pages_flag() {
+    static std::atomic<bool> flag(std::getenv("YGG_HUGE_PAGES") && std::atoi(std::getenv("YGG_HUGE_PAGES")) != 0);
+    return flag;
+}
+
+/// Whether large arrays are advised to be backed by transparent huge pages.
+inline bool huge_pages_enabled() {
+    return huge_pages_flag().load(std::memory_order_relaxed);
+}
+
+/// Enable or disable transparent huge pages for the arrays allocated from now on.
+inline void set_huge_pages(bool enable) {
+    huge_pages_flag().store(enable, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Allocator leaving new elements default-initialised, so that their pages are not touched.
+ *
+ * Large blocks are 2 MiB aligned and advised for huge pages when enabled; small ones come from the
+ * global operator new.
+ */
+template <typename T>
+struct first_touch_allocator {
+    typedef T value_type;
+
+    first_touch_allocator() noexcept {}
+    template <typename U>
+    first_touch_allocator(const first_touch_allocator<U> &) noexcept {}
+
+    T *allocate(std::size_t n) {
+        const std::size_t bytes = n * sizeof(T);
+        if (bytes < HUGE_PAGE_BYTES) {
+            return static_cast<T *>(::operator new(bytes));
+        }
+        void *p = nullptr;
+        if (posix_memalign(&p, HUGE_PAGE_BYTES, bytes) != 0) {
+            throw std::bad_alloc();
+        }
+#ifdef MADV_HUGEPAGE
+        if (huge_pages_enabled()) {
+            madvise(p, bytes, MADV_HUGEPAGE);
+        }
+#endif
+        return static_cast<T *>(p);
+    }
+
+    void deallocate(T *p, std::size_t n) noexcept {
+        if (n * sizeof(T) < HUGE_PAGE_BYTES) {
+            ::operator delete(p);
+        } else {
+            std::free(p);
+        }
+    }
+
+    /// Default-initialise, leaving trivial types uninitialised.
+    template <typename U>
+    void construct(U *p) {
+        ::new (static_cast<void *>(p)) U;
+    }
+
+    template <typename U, typename... Args>
+    void construct(U *p, Args &&...args) {
+        ::new (static_cast<void *>(p)) U(std::forward<Args>(args)...);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const first_touch_allocator<T> &, const first_touch_allocator<U> &) { return true; }
+
+template <typename T, typename U>
+bool operator!=(const first_touch_allocator<T> &, const first_touch_allocator<U> &) { return false; }
+
+/// Vector whose `resize` leaves the pages to be first touched by the loop that fills them.
+template <typename T>
+using first_touch_vector = std::vector<T, first_touch_allocator<T>>;
+
+/// Fill an array with a static schedule, so that every page is first touched by its owner thread.
+template <typename T>
+void parallel_fill(T *p, std::size_t n, const T &value) {
+    #pragma omp parallel for schedule(static)
+    for (long i = 0; i < static_cast<long>(n); ++i) {
+        p[i] = value;
+    }
+}
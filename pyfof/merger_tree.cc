@@ -0,0 +1,227 @@
+#include "merger_tree.hpp"
+
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Typedef for convenience
+typedef std::size_t size_t;
+
+namespace {
+
+/// Number of bits of the hash used to pick the partition of an ID.
+const unsigned PARTITION_BITS = 10;
+
+/// Number of partitions of the join.
+const size_t NPARTITIONS = size_t(1) << PARTITION_BITS;
+
+/// Grouped particle as seen by the join.
+struct keyed_particle {
+    std::uint64_t id;     ///< Particle ID.
+    std::int64_t label;   ///< Group of the particle in its snapshot.
+};
+
+/// Pair of linked groups.
+struct group_pair {
+    std::int64_t descendant;
+    std::int64_t progenitor;
+
+    bool operator<(const group_pair &o) const {
+        return descendant < o.descendant || (descendant == o.descendant && progenitor < o.progenitor);
+    }
+    bool operator==(const group_pair &o) const { return descendant == o.descendant && progenitor == o.progenitor; }
+};
+
+/// Pair of linked groups and the number of particles they share.
+struct pair_count {
+    group_pair pair;
+    size_t count;
+};
+
+/// SplitMix64 finaliser, so that sequential IDs spread evenly over partitions and table slots.
+inline std::uint64_t hash_id(std::uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+inline size_t partition_of(std::uint64_t id) { return hash_id(id) >> (64 - PARTITION_BITS); }
+
+/**
+ * @brief Scatter the grouped particles whose partition lies in [p0, p1) into contiguous buckets.
+ *
+ * Each thread histograms a static chunk of the input, one thread turns the histograms into
+ * per-thread write cursors, and the same chunks are scattered without synchronisation. All three
+ * steps run in one parallel region, so the chunks, and the thread count the histograms are sized
+ * for, are the same in both passes.
+ *
+ * @param offsets Set to the start of each partition of the range in `out`, with a trailing sentinel.
+ */
+void partition_particles(const std::uint64_t *ids, const std::int64_t *labels, size_t n, size_t p0, size_t p1,
+                         std::vector<keyed_particle> &out, std::vector<size_t> &offsets) {
+    const size_t np = p1 - p0;
+    offsets.assign(np + 1, 0);
+    std::vector<size_t> counts;
+    size_t nthreads = 1;
+
+    #pragma omp parallel
+    {
+        size_t t = 0;
+#ifdef _OPENMP
+        t = omp_get_thread_num();
+#endif
+        #pragma omp single
+        {
+#ifdef _OPENMP
+            nthreads = omp_get_num_threads();
+#endif
+            counts.assign(nthreads * np, 0);
+        }
+
+        size_t *local = counts.data() + t * np;
+        #pragma omp for schedule(static)
+        for (long i = 0; i < static_cast<long>(n); ++i) {
+            const size_t p = partition_of(ids[i]);
+            if (labels[i] >= 0 && p >= p0 && p < p1) ++local[p - p0];
+        }
+
+        // Exclusive prefix sum in (partition, thread) order turns the counts into write cursors
+        #pragma omp single
+        {
+            size_t total = 0;
+            for (size_t p = 0; p < np; ++p) {
+                offsets[p] = total;
+                for (size_t u = 0; u < nthreads; ++u) {
+                    const size_t c = counts[u * np + p];
+                    counts[u * np + p] = total;
+                    total += c;
+                }
+            }
+            offsets[np] = total;
+            out.resize(total);
+        }
+
+        #pragma omp for schedule(static)
+        for (long i = 0; i < static_cast<long>(n); ++i) {
+            const size_t p = partition_of(ids[i]);
+            if (labels[i] >= 0 && p >= p0 && p < p1) out[local[p - p0]++] = {ids[i], labels[i]};
+        }
+    }
+}
+
+/**
+ * @brief Join one partition and append its (descendant, progenitor) counts to `out`.
+ *
+ * @param table Open-addressing scratch table reused across the partitions of a thread.
+ */
+void join_partition(const keyed_particle *prev, size_t nprev, const keyed_particle *next, size_t nnext,
+                    std::vector<keyed_particle> &table, std::vector<pair_count> &out) {
+    if (nprev == 0 || nnext == 0) {
+        return;
+    }
+    size_t capacity = 16;
+    while (capacity < 2 * nprev) capacity *= 2;
+    const size_t mask = capacity - 1;
+    table.assign(capacity, {0, -1});
+
+    // Slots come from the low bits of the hash; the top bits already selected the partition
+    for (size_t i = 0; i < nprev; ++i) {
+        size_t s = hash_id(prev[i].id) & mask;
+        while (table[s].label >= 0 && table[s].id != prev[i].id) s = (s + 1) & mask;
+        table[s] = prev[i];
+    }
+
+    std::vector<group_pair> pairs;
+    pairs.reserve(nnext);
+    for (size_t i = 0; i < nnext; ++i) {
+        size_t s = hash_id(next[i].id) & mask;
+        while (table[s].label >= 0) {
+            if (table[s].id == next[i].id) {
+                pairs.push_back({next[i].label, table[s].label});
+                break;
+            }
+            s = (s + 1) & mask;
+        }
+    }
+
+    std::sort(pairs.begin(), pairs.end());
+    for (size_t i = 0; i < pairs.size();) {
+        size_t j = i + 1;
+        while (j < pairs.size() && pairs[j] == pairs[i]) ++j;
+        out.push_back({pairs[i], j - i});
+        i = j;
+    }
+}
+
+/// Number of members of every group, from the per-particle labels.
+std::vector<size_t> group_sizes(const std::int64_t *labels, size_t n) {
+    std::int64_t ngroups = 0;
+    for (size_t i = 0; i < n; ++i) ngroups = std::max(ngroups, labels[i] + 1);
+    std::vector<size_t> sizes(static_cast<size_t>(ngroups), 0);
+    for (size_t i = 0; i < n; ++i) {
+        if (labels[i] >= 0) ++sizes[labels[i]];
+    }
+    return sizes;
+}
+
+} // End of anonymous namespace
+
+// Radix-partitioned hash join on particle ID, streamed over `passes` batches of partitions
+merger_links link_merger_tree(const std::uint64_t *ids_prev, const std::int64_t *labels_prev, size_t nprev,
+                              const std::uint64_t *ids_next, const std::int64_t *labels_next, size_t nnext,
+                              size_t passes) {
+    passes = std::min(std::max<size_t>(passes, 1), NPARTITIONS);
+
+    std::vector<pair_count> counts;
+    std::vector<keyed_particle> prev, next;
+    std::vector<size_t> prev_offsets, next_offsets;
+    for (size_t pass = 0; pass < passes; ++pass) {
+        const size_t p0 = pass * NPARTITIONS / passes, p1 = (pass + 1) * NPARTITIONS / passes;
+        partition_particles(ids_prev, labels_prev, nprev, p0, p1, prev, prev_offsets);
+        partition_particles(ids_next, labels_next, nnext, p0, p1, next, next_offsets);
+
+        const long np = static_cast<long>(p1 - p0);
+        #pragma omp parallel
+        {
+            std::vector<keyed_particle> table;
+            std::vector<pair_count> local;
+            #pragma omp for schedule(dynamic, 1) nowait
+            for (long p = 0; p < np; ++p) {
+                join_partition(prev.data() + prev_offsets[p], prev_offsets[p + 1] - prev_offsets[p],
+                               next.data() + next_offsets[p], next_offsets[p + 1] - next_offsets[p], table, local);
+            }
+            #pragma omp critical
+            counts.insert(counts.end(), local.begin(), local.end());
+        }
+    }
+
+    // The same pair shows up once per partition it has particles in
+    std::sort(counts.begin(), counts.end(), [](const pair_count &a, const pair_count &b) { return a.pair < b.pair; });
+    merger_links links;
+    for (size_t i = 0; i < counts.size();) {
+        size_t shared = 0, j = i;
+        for (; j < counts.size() && counts[j].pair == counts[i].pair; ++j) shared += counts[j].count;
+        links.descendant.push_back(counts[i].pair.descendant);
+        links.progenitor.push_back(counts[i].pair.progenitor);
+        links.shared.push_back(shared);
+        i = j;
+    }
+
+    const std::vector<size_t> prev_sizes = group_sizes(labels_prev, nprev);
+    const std::vector<size_t> next_sizes = group_sizes(labels_next, nnext);
+    links.main_progenitor.assign(next_sizes.size(), -1);
+    links.merit.assign(next_sizes.size(), 0.);
+    for (size_t l = 0; l < links.shared.size(); ++l) {
+        const std::int64_t d = links.descendant[l], p = links.progenitor[l];
+        const double s = static_cast<double>(links.shared[l]);
+        const double merit = s * s / (static_cast<double>(prev_sizes[p]) * next_sizes[d]);
+        if (merit > links.merit[d]) {
+            links.merit[d] = merit;
+            links.main_progenitor[d] = p;
+        }
+    }
+    return links;
+}
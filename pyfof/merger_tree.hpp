@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+/**
+ * @brief Links between the groups of two snapshots.
+ *
+ * Every (progenitor, descendant) pair of groups sharing at least one particle appears once in the
+ * link arrays, sorted by descendant then progenitor. For every descendant group, the main progenitor
+ * is the linked progenitor with the highest merit `shared^2 / (n_progenitor * n_descendant)`.
+ */
+struct merger_links {
+    std::vector<std::int64_t> progenitor;       ///< Progenitor group of each link.
+    std::vector<std::int64_t> descendant;       ///< Descendant group of each link.
+    std::vector<std::size_t> shared;            ///< Number of particles shared by the two groups.
+    std::vector<std::int64_t> main_progenitor;  ///< Main progenitor of every descendant group, -1 if none.
+    std::vector<double> merit;                  ///< Merit of the main progenitor, 0 if none.
+};
+
+/**
+ * @brief Link the groups of two snapshots through the IDs of the particles they share.
+ *
+ * This is a radix-partitioned hash join on particle ID. Grouped particles of both snapshots are
+ * scattered in parallel into partitions by the top bits of a hash of their ID. Each partition is
+ * then joined independently: a hash table of the earlier snapshot's IDs is probed with the later
+ * snapshot's IDs, and the matching (progenitor, descendant) pairs are counted. Partitions are
+ * spread over OpenMP threads and are small enough to keep their hash tables in cache.
+ *
+ * With `passes` > 1 the partitions are processed in that many consecutive batches, and each pass only
+ * materialises the particles of its own partitions. Peak memory then scales with N / passes plus the
+ * number of distinct links, so full-simulation catalogs can be linked on one node.
+ *
+ * @param ids_prev IDs of the particles of the earlier snapshot, unique within the snapshot.
+ * @param labels_prev Group of every particle of the earlier snapshot, -1 when ungrouped.
+ * @param nprev Number of particles of the earlier snapshot.
+ * @param ids_next IDs of the particles of the later snapshot.
+ * @param labels_next Group of every particle of the later snapshot, -1 when ungrouped.
+ * @param nnext Number of particles of the later snapshot.
+ * @param passes Number of streaming passes over the inputs.
+ * @return merger_links Shared-particle counts of every linked pair and the main progenitors.
+ */
+merger_links link_merger_tree(const std::uint64_t *ids_prev, const std::int64_t *labels_prev, std::size_t nprev,
+                              const std::uint64_t *ids_next, const std::int64_t *labels_next, std::size_t nnext,
+                              std::size_t passes = 1);
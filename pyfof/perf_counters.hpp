@@ -0,0 +1,151 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Hardware events counted over one phase; -1 marks an event the machine could not count.
+ */
+struct hardware_counters {
+    std::int64_t cycles = -1;          ///< CPU cycles.
+    std::int64_t instructions = -1;    ///< Retired instructions.
+    std::int64_t l1d_misses = -1;      ///< L1 data-cache read misses.
+    std::int64_t llc_misses = -1;      ///< Last-level cache misses.
+    std::int64_t branch_misses = -1;   ///< Mispredicted branches.
+};
+
+/**
+ * @brief Set of `perf_event_open` counters for the calling thread and its OpenMP team.
+ *
+ * Each event is opened on its own rather than as a group, so a machine lacking one event (LLC misses
+ * on many virtual machines) still reports the others, and counts are scaled for multiplexing. When
+ * the kernel refuses access altogether (non-Linux builds, containers without CAP_PERFMON, a strict
+ * `perf_event_paranoid`), every counter simply stays at -1. Only user-space work is counted. The
+ * counters are attached to the kernel thread id of every thread of the team an `omp parallel` region
+ * of the calling thread would use, and `stop` sums them, so the phases parallelised with OpenMP
+ * report the work of all their threads rather than that of the master alone.
+ */
+class perf_counter_set {
+public:
+    perf_counter_set() = default;
+
+    ~perf_counter_set() { close(); }
+
+    perf_counter_set(const perf_counter_set &) = delete;
+    perf_counter_set &operator=(const perf_counter_set &) = delete;
+
+    /// Open the counters and start counting.
+    void start() {
+#ifdef __linux__
+        static const std::uint32_t types[NEVENTS] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+                                                     PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE};
+        static const std::uint64_t configs[NEVENTS] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+            PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_BRANCH_MISSES,
+        };
+        std::vector<pid_t> tids(1, static_cast<pid_t>(syscall(SYS_gettid)));
+#ifdef _OPENMP
+        if (!omp_in_parallel()) {
+            tids.assign(omp_get_max_threads(), -1);
+#pragma omp parallel
+            {
+                const int t = omp_get_thread_num();
+                if (t < static_cast<int>(tids.size())) tids[t] = static_cast<pid_t>(syscall(SYS_gettid));
+            }
+        }
+#endif
+        for (pid_t tid : tids) {
+            if (tid < 0) continue;
+            for (int e = 0; e < NEVENTS; ++e) {
+                struct perf_event_attr attr;
+                std::memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = types[e];
+                attr.config = configs[e];
+                attr.disabled = 1;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                fds_[e].push_back(static_cast<int>(syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0)));
+            }
+        }
+        for (const std::vector<int> &event : fds_) {
+            for (int fd : event) {
+                if (fd >= 0) {
+                    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+                }
+            }
+        }
+#endif
+    }
+
+    /// Stop counting, read the counters, summed over the threads, and close them.
+    hardware_counters stop() {
+        std::int64_t values[NEVENTS];
+        for (int e = 0; e < NEVENTS; ++e) {
+            values[e] = -1;
+            for (int fd : fds_[e]) {
+                const std::int64_t value = read(fd);
+                if (value >= 0) values[e] = (values[e] < 0 ? 0 : values[e]) + value;
+            }
+        }
+        close();
+
+        hardware_counters hw;
+        hw.cycles = values[0];
+        hw.instructions = values[1];
+        hw.l1d_misses = values[2];
+        hw.llc_misses = values[3];
+        hw.branch_misses = values[4];
+        return hw;
+    }
+
+private:
+    static const int NEVENTS = 5;
+
+    /// Value of one counter scaled for the time it was multiplexed out, -1 if unavailable.
+    static std::int64_t read(int fd) {
+#ifdef __linux__
+        if (fd < 0) {
+            return -1;
+        }
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        std::uint64_t buf[3];  // value, time enabled, time running
+        if (::read(fd, buf, sizeof(buf)) != static_cast<ssize_t>(sizeof(buf)) || buf[2] == 0) {
+            return -1;
+        }
+        return static_cast<std::int64_t>(static_cast<double>(buf[0]) * buf[1] / buf[2]);
+#else
+        (void)fd;
+        return -1;
+#endif
+    }
+
+    void close() {
+        for (std::vector<int> &event : fds_) {
+#ifdef __linux__
+            for (int fd : event) {
+                if (fd >= 0) ::close(fd);
+            }
+#endif
+            event.clear();
+        }
+    }
+
+    std::vector<int> fds_[NEVENTS];  ///< Descriptors of every event, one per thread.
+};
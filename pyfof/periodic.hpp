@@ -0,0 +1,40 @@
+#pragma once
+#include <cmath>
+
+/**
+ * @brief Separation of two coordinates under the minimum-image convention.
+ *
+ * Coordinates within a box side of the box are corrected by a single compare; those further apart,
+ * such as the unwrapped coordinates kept by `kd_tree::update_positions`, take a rounding.
+ *
+ * @param d Raw difference between the two coordinates.
+ * @param L Side of the periodic box; non-positive values return `d` unchanged.
+ * @return double The difference mapped into [-L/2, L/2].
+ */
+inline double periodic_delta(double d, double L) {
+    if (L > 0.) {
+        if (d > 0.5 * L) {
+            d -= L;
+            if (d > 0.5 * L) d -= L * std::nearbyint(d / L);
+        } else if (d < -0.5 * L) {
+            d += L;
+            if (d < -0.5 * L) d -= L * std::nearbyint(d / L);
+        }
+    }
+    return d;
+}
+
+/**
+ * @brief Wrap a coordinate back into the periodic box [0, L).
+ *
+ * @param x Coordinate to wrap.
+ * @param L Side of the periodic box; non-positive values return `x` unchanged.
+ * @return double The wrapped coordinate.
+ */
+inline double periodic_wrap(double x, double L) {
+    if (L > 0.) {
+        x = std::fmod(x, L);
+        if (x < 0.) x += L;
+    }
+    return x;
+}
@@ -0,0 +1,117 @@
+#include "phase_space.hpp"
+#include "fof_kdtree.hpp"
+#include "kdtree.hpp"
+#include "periodic.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+// Typedef for convenience
+typedef std::size_t size_t;
+
+namespace {
+
+/**
+ * @brief Link the members of group g in scaled phase space.
+ *
+ * @param u Scratch buffer for the scaled 6-D coordinates, reused across the groups of a thread.
+ * @return std::vector<std::vector<size_t>> Subgroups with at least `min_members` particles.
+ */
+std::vector<std::vector<size_t>> link_group(const group_catalog &catalog, size_t g, const double *pos,
+                                            const double *vel, double boxsize, double bx, double bv,
+                                            size_t min_members, std::vector<double> &u) {
+    const size_t begin = catalog.offsets[g], n = catalog.size(g);
+    std::vector<std::vector<size_t>> out;
+    if (n == 0 || n < min_members) {
+        return out;
+    }
+    const size_t *ids = catalog.members.data() + begin;
+    const double *xref = pos + ids[0] * 3;
+
+    // Unwrapped positions and raw velocities, first pass also gathers the dispersions
+    u.resize(6 * n);
+    double xm[3] = {0., 0., 0.}, vm[3] = {0., 0., 0.};
+    for (size_t k = 0; k < n; ++k) {
+        for (size_t d = 0; d < 3; ++d) {
+            u[k * 6 + d] = periodic_delta(pos[ids[k] * 3 + d] - xref[d], boxsize);
+            u[k * 6 + 3 + d] = vel[ids[k] * 3 + d];
+            xm[d] += u[k * 6 + d];
+            vm[d] += u[k * 6 + 3 + d];
+        }
+    }
+    if (bv <= 0.) {
+        double sx2 = 0., sv2 = 0.;
+        for (size_t d = 0; d < 3; ++d) {
+            xm[d] /= n;
+            vm[d] /= n;
+        }
+        for (size_t k = 0; k < n; ++k) {
+            for (size_t d = 0; d < 3; ++d) {
+                const double dx = u[k * 6 + d] - xm[d], dv = u[k * 6 + 3 + d] - vm[d];
+                sx2 += dx * dx;
+                sv2 += dv * dv;
+            }
+        }
+        bv = sx2 > 0. ? bx * std::sqrt(sv2 / sx2) : 0.;
+    }
+
+    // A vanishing velocity scale means all members move together, so only positions matter
+    const double inv_bx = 1. / bx, inv_bv = bv > 0. ? 1. / bv : 0.;
+    for (size_t k = 0; k < n; ++k) {
+        for (size_t d = 0; d < 3; ++d) {
+            u[k * 6 + d] *= inv_bx;
+            u[k * 6 + 3 + d] *= inv_bv;
+        }
+    }
+
+    const kd_tree<6> tree(u.data(), n, 0.);
+    const group_catalog sub = friends_of_friends_kdtree(tree, 1.);
+    for (size_t s = 0; s < sub.ngroups(); ++s) {
+        if (sub.size(s) < min_members) {
+            continue;
+        }
+        std::vector<size_t> members(sub.size(s));
+        for (size_t k = 0; k < members.size(); ++k) {
+            members[k] = ids[sub.members[sub.offsets[s] + k]];
+        }
+        out.push_back(std::move(members));
+    }
+    return out;
+}
+
+} // End of anonymous namespace
+
+// Independent 6-D FoF per group, largest groups handed out first
+phase_space_groups find_phase_space_groups(const group_catalog &catalog, const double *pos, const double *vel,
+                                           size_t npts, double boxsize, double linking_length,
+                                           double velocity_linking_length, size_t min_members) {
+    const size_t ngroups = catalog.ngroups();
+    std::vector<size_t> order(ngroups);
+    std::iota(order.begin(), order.end(), size_t(0));
+    std::stable_sort(order.begin(), order.end(),
+                     [&catalog](size_t a, size_t b) { return catalog.size(a) > catalog.size(b); });
+
+    std::vector<std::vector<std::vector<size_t>>> found(ngroups);
+    #pragma omp parallel
+    {
+        std::vector<double> u;
+        #pragma omp for schedule(dynamic, 1)
+        for (long k = 0; k < static_cast<long>(ngroups); ++k) {
+            const size_t g = order[k];
+            found[g] = link_group(catalog, g, pos, vel, boxsize, linking_length, velocity_linking_length,
+                                  min_members, u);
+        }
+    }
+
+    std::vector<std::vector<size_t>> groups;
+    phase_space_groups out;
+    for (size_t g = 0; g < ngroups; ++g) {
+        for (auto &members : found[g]) {
+            groups.push_back(std::move(members));
+            out.parent.push_back(g);
+        }
+    }
+    out.groups = make_group_catalog(groups, npts);
+    return out;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdlib>
+#include <vector>
+
+#include "groups.hpp"
+
+/**
+ * @brief Phase-space subgroups found inside a set of 3-D FoF groups.
+ */
+struct phase_space_groups {
+    group_catalog groups;              ///< Phase-space subgroups, with members given as particle indices.
+    std::vector<std::size_t> parent;   ///< Index of the 3-D group each subgroup was found in.
+};
+
+/**
+ * @brief Run 6-D friends-of-friends in phase space inside every group of a 3-D catalog.
+ *
+ * Two members of the same group are friends when `|dx|^2 / b_x^2 + |dv|^2 / b_v^2 < 1`. Positions
+ * are periodic and unwrapped around the first member of the group, velocities are not. With a
+ * positive `velocity_linking_length` the same b_v is used everywhere; otherwise every group gets the
+ * adaptive scale `b_v = b_x * sigma_v / sigma_x` from its own position and velocity dispersions, so
+ * both halves of the metric are measured in units of the group's own spread.
+ *
+ * Each group is gathered into a contiguous buffer of scaled 6-D coordinates, indexed with a
+ * `kd_tree<6>` and linked with unit linking length. Groups are independent and are spread over
+ * OpenMP threads, largest first.
+ *
+ * @param catalog CSR catalog of the 3-D groups, as built by `make_group_catalog`.
+ * @param pos Pointer to the particle positions, three contiguous values per particle.
+ * @param vel Pointer to the particle velocities, three contiguous values per particle.
+ * @param npts Number of particles, used to size the label array of the result.
+ * @param boxsize Side of the periodic box; non-positive values disable periodic unwrapping.
+ * @param linking_length Spatial linking length b_x.
+ * @param velocity_linking_length Velocity linking length b_v; non-positive values select the
+ *                                adaptive per-group scale.
+ * @param min_members Smallest phase-space subgroup that is kept.
+ * @return phase_space_groups Subgroups ordered by parent group, with their parent indices.
+ */
+phase_space_groups find_phase_space_groups(const group_catalog &catalog, const double *pos, const double *vel,
+                                           std::size_t npts, double boxsize, double linking_length,
+                                           double velocity_linking_length, std::size_t min_members);
@@ -0,0 +1,98 @@
+#pragma once
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+
+/**
+ * @brief Thread-safe FIFO with a fixed capacity, connecting two stages of a pipeline.
+ *
+ * `push` blocks while the queue is full and `pop` blocks while it is empty, so a fast producer can
+ * never run more than `capacity` items ahead of its consumer. Closing the queue wakes every waiting
+ * thread: producers are refused from then on, and consumers drain what is left before `pop` fails.
+ *
+ * @tparam T Type of the items, moved in and out of the queue.
+ */
+template <typename T>
+class bounded_queue {
+public:
+    /// Create a queue holding at most `capacity` items (at least one).
+    explicit bounded_queue(std::size_t capacity) : capacity_(capacity > 0 ? capacity : 1), closed_(false) {}
+
+    /**
+     * @brief Append an item, waiting for room.
+     *
+     * @return bool False if the queue was closed and the item was dropped.
+     */
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this] { return closed_ || items_.size() < capacity_; });
+        if (closed_) {
+            return false;
+        }
+        items_.push_back(std::move(item));
+        not_empty_.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Remove the oldest item, waiting for one to arrive.
+     *
+     * @return bool False once the queue is closed and empty.
+     */
+    bool pop(T &item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+        if (items_.empty()) {
+            return false;
+        }
+        item = std::move(items_.front());
+        items_.pop_front();
+        not_full_.notify_one();
+        return true;
+    }
+
+    /// Signal that no more items will be pushed.
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+        not_full_.notify_all();
+    }
+
+private:
+    std::size_t capacity_;
+    bool closed_;
+    std::deque<T> items_;
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+};
+
+/**
+ * @brief Counting semaphore bounding the number of items alive across several stages.
+ */
+class slot_pool {
+public:
+    /// Create a pool of `slots` free slots.
+    explicit slot_pool(std::size_t slots) : free_(slots) {}
+
+    /// Take a slot, waiting for one to be released.
+    void acquire() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        released_.wait(lock, [this] { return free_ > 0; });
+        --free_;
+    }
+
+    /// Give a slot back.
+    void release() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++free_;
+        released_.notify_one();
+    }
+
+private:
+    std::size_t free_;
+    std::mutex mutex_;
+    std::condition_variable released_;
+};
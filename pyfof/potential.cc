@@ -0,0 +1,217 @@
+#include "potential.hpp"
+#include "kdtree.hpp"
+#include "periodic.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// Typedef for convenience
+typedef std::size_t size_t;
+
+namespace {
+
+/// Groups with at least this many members are processed with all threads working on their members.
+const size_t LARGE_GROUP = 32768;
+
+/// Maximum number of particles in a leaf of the per-group tree.
+const size_t POTENTIAL_LEAF_SIZE = 8;
+
+/// Thread-local scratch space reused across the groups handled by one thread.
+struct potential_buffers {
+    std::vector<double> x, y, z;  ///< Unwrapped coordinates, structure-of-arrays for the direct sum.
+    std::vector<double> xyz;      ///< Unwrapped coordinates, interleaved for the tree build.
+    std::vector<double> m;        ///< Member masses.
+    std::vector<double> phi;      ///< Potentials of the members, in group order.
+};
+
+/// Monopole moment of a tree node.
+struct node_moment {
+    double mass;     ///< Total mass of the node.
+    double com[3];   ///< Centre of mass of the node.
+    double size2;    ///< Squared largest side of the node bounding box.
+};
+
+/**
+ * @brief Direct O(n^2) potential, vectorised over the sources.
+ *
+ * The self-interaction (j = i) is skipped inside the loop with a select, so the inner loop stays free
+ * of branches and the compiler can emit SIMD code for it. Coincident particles still contribute
+ * m / eps; only unsoftened ones, whose term is infinite, are left out.
+ */
+void direct_potential(size_t n, const double *x, const double *y, const double *z, const double *m,
+                      double eps2, double *phi, bool parallel) {
+    #pragma omp parallel for schedule(static) if (parallel)
+    for (long i = 0; i < static_cast<long>(n); ++i) {
+        const double xi = x[i], yi = y[i], zi = z[i];
+        double acc = 0.;
+        #pragma omp simd reduction(+:acc)
+        for (size_t j = 0; j < n; ++j) {
+            const double dx = x[j] - xi, dy = y[j] - yi, dz = z[j] - zi;
+            const double s2 = dx * dx + dy * dy + dz * dz + eps2;
+            acc += j != static_cast<size_t>(i) && s2 > 0. ? m[j] / std::sqrt(s2) : 0.;
+        }
+        phi[i] = -acc;
+    }
+}
+
+/**
+ * @brief Barnes-Hut potential using a kd-tree over the group members.
+ */
+void tree_potential(size_t n, const double *xyz, const double *m, double eps2, double theta, double *phi,
+                    bool parallel) {
+    const kd_tree<3> tree(xyz, n, 0., POTENTIAL_LEAF_SIZE);
+    const auto *nodes = tree.nodes();
+
+    // Masses in tree order, so the leaf loops are sequential
+    std::vector<double> mt(n);
+    for (size_t k = 0; k < n; ++k) mt[k] = m[tree.index(k)];
+
+    // Monopoles bottom-up: children always come after their parent in the flat node array
+    std::vector<node_moment> moments(tree.nnodes());
+    for (size_t id = tree.nnodes(); id-- > 0;) {
+        const auto &nd = nodes[id];
+        node_moment &mo = moments[id];
+        mo.mass = 0.;
+        mo.com[0] = mo.com[1] = mo.com[2] = 0.;
+        if (nd.leaf()) {
+            for (size_t k = nd.begin; k < nd.end; ++k) {
+                const double *xk = tree.point(k);
+                mo.mass += mt[k];
+                for (size_t d = 0; d < 3; ++d) mo.com[d] += mt[k] * xk[d];
+            }
+        } else {
+            for (size_t c : {id + 1, nd.right}) {
+                mo.mass += moments[c].mass;
+                for (size_t d = 0; d < 3; ++d) mo.com[d] += moments[c].mass * moments[c].com[d];
+            }
+        }
+        for (size_t d = 0; d < 3; ++d) mo.com[d] = mo.mass > 0. ? mo.com[d] / mo.mass : 0.5 * (nd.lo[d] + nd.hi[d]);
+        double s = 0.;
+        for (size_t d = 0; d < 3; ++d) s = std::max(s, nd.hi[d] - nd.lo[d]);
+        mo.size2 = s * s;
+    }
+
+    const double theta2 = theta * theta;
+    #pragma omp parallel for schedule(dynamic, 256) if (parallel)
+    for (long k = 0; k < static_cast<long>(n); ++k) {
+        const double *xk = tree.point(k);
+        double acc = 0.;
+        size_t stack[128];
+        size_t top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const size_t id = stack[--top];
+            const auto &nd = nodes[id];
+            if (nd.leaf()) {
+                // Leaves hold tree-order indices, like k
+                for (size_t j = nd.begin; j < nd.end; ++j) {
+                    const double *xj = tree.point(j);
+                    const double dx = xj[0] - xk[0], dy = xj[1] - xk[1], dz = xj[2] - xk[2];
+                    const double s2 = dx * dx + dy * dy + dz * dz + eps2;
+                    acc += j != static_cast<size_t>(k) && s2 > 0. ? mt[j] / std::sqrt(s2) : 0.;
+                }
+                continue;
+            }
+            // Accept the node as a point mass if it is small as seen from the particle,
+            // and never if the particle lies inside its bounding box
+            const node_moment &mo = moments[id];
+            const double dx = mo.com[0] - xk[0], dy = mo.com[1] - xk[1], dz = mo.com[2] - xk[2];
+            const double d2 = dx * dx + dy * dy + dz * dz;
+            if (mo.size2 < theta2 * d2 && tree.box_distance2(xk, nd) > 0.) {
+                acc += mo.mass / std::sqrt(d2 + eps2);
+            } else {
+                stack[top++] = nd.right;
+                stack[top++] = id + 1;
+            }
+        }
+        phi[tree.index(k)] = -acc;
+    }
+}
+
+/**
+ * @brief Potential of the members of group g, written to the output arrays.
+ */
+void group_potential_one(const group_catalog &catalog, size_t g, const double *pos, const double *mass,
+                         double particle_mass, double boxsize, double G, double eps2, double theta,
+                         size_t direct_threshold, potential_buffers &buf, group_potential &out, bool parallel) {
+    const size_t begin = catalog.offsets[g], end = catalog.offsets[g + 1];
+    const size_t n = end - begin;
+    if (n == 0) {
+        return;
+    }
+    const bool direct = n <= direct_threshold;
+    const double *xref = pos + catalog.members[begin] * 3;
+
+    buf.m.resize(n);
+    buf.phi.resize(n);
+    if (direct) {
+        buf.x.resize(n); buf.y.resize(n); buf.z.resize(n);
+    } else {
+        buf.xyz.resize(3 * n);
+    }
+
+    // Gather the members unwrapped around the first one
+    for (size_t k = 0; k < n; ++k) {
+        const size_t i = catalog.members[begin + k];
+        double u[3];
+        for (size_t d = 0; d < 3; ++d) u[d] = periodic_delta(pos[i * 3 + d] - xref[d], boxsize);
+        if (direct) {
+            buf.x[k] = u[0]; buf.y[k] = u[1]; buf.z[k] = u[2];
+        } else {
+            for (size_t d = 0; d < 3; ++d) buf.xyz[k * 3 + d] = u[d];
+        }
+        buf.m[k] = mass != nullptr ? mass[i] : particle_mass;
+    }
+
+    if (direct) {
+        direct_potential(n, buf.x.data(), buf.y.data(), buf.z.data(), buf.m.data(), eps2, buf.phi.data(), parallel);
+    } else {
+        tree_potential(n, buf.xyz.data(), buf.m.data(), eps2, theta, buf.phi.data(), parallel);
+    }
+
+    size_t best = 0;
+    for (size_t k = 0; k < n; ++k) {
+        const size_t i = catalog.members[begin + k];
+        out.potential[i] = G * buf.phi[k];
+        if (buf.phi[k] < buf.phi[best]) best = k;
+    }
+    out.most_bound[g] = catalog.members[begin + best];
+}
+
+} // End of anonymous namespace
+
+// Per-group potentials: the largest groups first with inner parallelism, then the rest across threads
+group_potential compute_group_potential(const group_catalog &catalog, const double *pos, const double *mass,
+                                        size_t npts, double particle_mass, double boxsize, double G,
+                                        double softening, double theta, size_t direct_threshold) {
+    const size_t ngroups = catalog.ngroups();
+    const double eps2 = softening * softening;
+
+    group_potential out;
+    out.potential.assign(npts, 0.);
+    out.most_bound.assign(ngroups, 0);
+
+    std::vector<size_t> small;
+    small.reserve(ngroups);
+    potential_buffers buf;
+    for (size_t g = 0; g < ngroups; ++g) {
+        if (catalog.size(g) >= LARGE_GROUP) {
+            group_potential_one(catalog, g, pos, mass, particle_mass, boxsize, G, eps2, theta, direct_threshold,
+                                buf, out, true);
+        } else {
+            small.push_back(g);
+        }
+    }
+
+    #pragma omp parallel
+    {
+        potential_buffers local;
+        #pragma omp for schedule(dynamic, 1)
+        for (long s = 0; s < static_cast<long>(small.size()); ++s) {
+            group_potential_one(catalog, small[s], pos, mass, particle_mass, boxsize, G, eps2, theta,
+                                direct_threshold, local, out, false);
+        }
+    }
+
+    return out;
+}
@@ -5,23 +5,400 @@ Created on Thu Mar 26 17:59:28 2015
 @author: simongibbons
 """
 
-__all__ = ["friends_of_friends"]
+__all__ = ["friends_of_friends", "halo_properties", "group_potential", "subgroups",
+           "phase_space_groups", "merger_tree", "SpatialIndex", "iter_groups",
+           "friends_of_friends_batch", "group_multiplicity"]
 __version__ = "0.1.3-dev"
 __author__ = "Simon Gibbons (simongibbons@gmail.com)"
 __copyright__ = "Copyright 2015 Simon Gibbons"
 
 cimport numpy as np
 import numpy as np
+import os
+from libc.stdint cimport int64_t, uint64_t
+from libcpp.memory cimport unique_ptr
+from libcpp.string cimport string
 from libcpp.vector cimport vector
 
-cdef extern from "fof.hpp":
-    cdef vector[vector[size_t]] _friends_of_friends "friends_of_friends"(double*, size_t, size_t, double) except +
+cdef extern from "perf_counters.hpp":
+    cdef cppclass hardware_counters:
+        int64_t cycles
+        int64_t instructions
+        int64_t l1d_misses
+        int64_t llc_misses
+        int64_t branch_misses
 
-cdef extern from "fof_brute.hpp":
-    cdef vector[vector[size_t]] _friends_of_friends_brute "friends_of_friends_brute"(double*, size_t, size_t, double) except +
+cdef extern from "stats.hpp":
+    cdef cppclass phase_stats:
+        string name
+        uint64_t wall_ns
+        uint64_t peak_rss_kb
+        hardware_counters hw
+        uint64_t bytes
+    cdef cppclass fof_stats:
+        bint profile
+        vector[phase_stats] phases
+        uint64_t npts
+        uint64_t points_visited
+        uint64_t pairs_tested
+        uint64_t pairs_linked
+        uint64_t nodes_touched
+        uint64_t allocations
+        double resolution_error
 
+cdef extern from "groups.hpp":
+    cdef cppclass group_catalog:
+        vector[size_t] offsets
+        vector[size_t] members
+        vector[int64_t] labels
+    cdef group_catalog make_group_catalog(const vector[vector[size_t]]&, size_t) except +
 
-def friends_of_friends(data, double linking_length, bint use_brute = False):
+cdef extern from "engine_select.hpp":
+    cdef cppclass data_shape:
+        size_t npts
+        size_t ndim
+        double boxsize
+        double extent
+        double mean_neighbours
+        int nthreads
+    cdef cppclass engine_config:
+        string engine
+        size_t leaf_size
+    cdef data_shape sample_data_shape(const double*, size_t, size_t, double, double, size_t) except +
+    cdef engine_config _select_engine "select_engine"(const data_shape&) except +
+
+cdef extern from "fof_batch.hpp":
+    cdef cppclass batch_catalog:
+        vector[size_t] set_offsets
+        vector[size_t] offsets
+        vector[size_t] members
+    cdef batch_catalog _friends_of_friends_batch "friends_of_friends_batch"(
+        const engine_config&, const double*, const size_t*, size_t, size_t, double, double) except + nogil
+
+cdef extern from "ygg.h":
+    ctypedef enum ygg_status:
+        YGG_OK
+        YGG_INVALID_ARGUMENT
+        YGG_OUT_OF_MEMORY
+        YGG_INTERNAL_ERROR
+    ctypedef struct ygg_result:
+        pass
+    ctypedef struct ygg_options:
+        const char* engine
+        size_t leaf_size
+        unsigned quantize_bits
+        int profile
+    ctypedef struct ygg_hw_counters:
+        int64_t cycles
+        int64_t instructions
+        int64_t l1d_misses
+        int64_t llc_misses
+        int64_t branch_misses
+    ctypedef struct ygg_phase:
+        const char* name
+        uint64_t wall_ns
+        uint64_t peak_rss_kb
+        ygg_hw_counters hw
+    ctypedef struct ygg_stats:
+        uint64_t npts
+        uint64_t points_visited
+        uint64_t pairs_tested
+        uint64_t pairs_linked
+        uint64_t nodes_touched
+        uint64_t allocations
+        double resolution_error
+        size_t nphases
+        const char* engine
+        size_t leaf_size
+    const char* ygg_last_error() nogil
+    void ygg_options_init(ygg_options*) nogil
+    ygg_status ygg_fof(const double*, size_t, size_t, double, double, const ygg_options*, ygg_result**) nogil
+    void ygg_result_destroy(ygg_result*) nogil
+    size_t ygg_result_ngroups(const ygg_result*) nogil
+    const size_t* ygg_result_offsets(const ygg_result*) nogil
+    const size_t* ygg_result_members(const ygg_result*) nogil
+    void ygg_result_stats(const ygg_result*, ygg_stats*) nogil
+    ygg_status ygg_result_phase(const ygg_result*, size_t, ygg_phase*) nogil
+    uint64_t ygg_result_phase_bytes(const ygg_result*, size_t) nogil
+    void ygg_set_huge_pages(int) nogil
+
+cdef extern from "halo_properties.hpp":
+    cdef cppclass _halo_properties "halo_properties":
+        size_t ndim
+        vector[size_t] npart
+        vector[double] mass
+        vector[double] com
+        vector[double] vel
+        vector[double] sigma_v
+        vector[double] extent
+    cdef _halo_properties _compute_halo_properties "compute_halo_properties"(
+        const group_catalog&, const double*, const double*, const double*, size_t, double, double) except + nogil
+
+cdef extern from "kdtree.hpp":
+    cdef cppclass kd_tree3:
+        kd_tree3(const double*, size_t, double, size_t, fof_stats*) except + nogil
+        size_t leaf_size()
+        bint mapped()
+        size_t size()
+        size_t update_positions(const double*, double) except + nogil
+
+cdef extern from "kdtree_io.hpp":
+    cdef cppclass kd_tree_file_header:
+        uint64_t dimension
+        uint64_t npts
+        double boxsize
+        uint64_t checksum
+    cdef cppclass kd_tree_source:
+        size_t npts
+        double boxsize
+        uint64_t checksum
+    cdef void _save_kd_tree "save_kd_tree<3>"(const kd_tree3&, const string&, uint64_t) except + nogil
+    cdef kd_tree_file_header read_kd_tree_header(const string&) except +
+    cdef unique_ptr[kd_tree3] _open_kd_tree "open_kd_tree_ptr<3>"(
+        const string&, const kd_tree_source&, bint) except + nogil
+
+cdef extern from "fof_kdtree.hpp":
+    cdef group_catalog _friends_of_friends_kdtree "friends_of_friends_kdtree<3>"(
+        const kd_tree3&, double, fof_stats*) except + nogil
+
+cdef extern from "fof_checkpoint.hpp":
+    cdef cppclass checkpoint_config:
+        string path
+        double interval
+    cdef group_catalog _friends_of_friends_kdtree_checkpointed "friends_of_friends_kdtree_checkpointed<3>"(
+        const kd_tree3&, double, const checkpoint_config&, fof_stats*) except + nogil
+
+cdef extern from "group_stream.hpp":
+    cdef cppclass group_batch:
+        vector[size_t] offsets
+        vector[size_t] members
+    cdef cppclass group_stream:
+        group_stream(const double*, size_t, size_t, double, double, size_t, size_t) except +
+        group_stream(const kd_tree3&, double, size_t, size_t) except +
+        bint next(group_batch&) except + nogil
+        void cancel() nogil
+
+cdef extern from "group_sizes.hpp":
+    cdef cppclass group_size_summary:
+        size_t ngroups
+        vector[size_t] edges
+        vector[size_t] counts
+        vector[size_t] top_groups
+        vector[size_t] top_sizes
+        vector[size_t] top_seeds
+        vector[size_t] sizes
+    cdef group_size_summary _kdtree_group_sizes "kdtree_group_sizes<3>"(
+        const kd_tree3&, double, const vector[size_t]&, size_t, bint, fof_stats*) except + nogil
+    cdef group_size_summary _group_sizes "group_sizes"(
+        const double*, size_t, size_t, double, double, const vector[size_t]&, size_t, bint, fof_stats*) except + nogil
+
+cdef extern from "cosmology.hpp":
+    cdef cppclass cosmology:
+        double om0
+        double oml
+        double h
+        double redshift
+        double length_unit
+        double mass_unit
+
+cdef extern from "spherical_overdensity.hpp":
+    cdef cppclass so_masses:
+        vector[double] m200c
+        vector[double] r200c
+        vector[double] m500c
+        vector[double] r500c
+        vector[double] mvir
+        vector[double] rvir
+    cdef so_masses _compute_so_masses "compute_so_masses"(
+        const kd_tree3&, const double*, size_t, const double*, const double*, double, const cosmology&) except + nogil
+
+cdef extern from "potential.hpp":
+    cdef cppclass _group_potential "group_potential":
+        vector[double] potential
+        vector[size_t] most_bound
+    cdef _group_potential _compute_group_potential "compute_group_potential"(
+        const group_catalog&, const double*, const double*, size_t, double, double, double, double, double,
+        size_t) except + nogil
+
+cdef extern from "subgroups.hpp":
+    cdef cppclass group_hierarchy:
+        vector[size_t] offsets
+        vector[size_t] members
+        vector[int64_t] parent
+        vector[size_t] level
+    cdef group_hierarchy _find_subgroups "find_subgroups"(
+        const group_catalog&, const double*, double, double, double, size_t, size_t) except + nogil
+
+cdef extern from "attach.hpp":
+    cdef vector[int64_t] _attach_to_nearest "attach_to_nearest"(
+        const kd_tree3&, const vector[int64_t]&, const double*, size_t, double) except + nogil
+
+cdef extern from "phase_space.hpp":
+    cdef cppclass _phase_space_groups "phase_space_groups":
+        group_catalog groups
+        vector[size_t] parent
+    cdef _phase_space_groups _find_phase_space_groups "find_phase_space_groups"(
+        const group_catalog&, const double*, const double*, size_t, double, double, double, size_t) except + nogil
+
+cdef extern from "merger_tree.hpp":
+    cdef cppclass merger_links:
+        vector[int64_t] progenitor
+        vector[int64_t] descendant
+        vector[size_t] shared
+        vector[int64_t] main_progenitor
+        vector[double] merit
+    cdef merger_links _link_merger_tree "link_merger_tree"(
+        const uint64_t*, const int64_t*, size_t, const uint64_t*, const int64_t*, size_t, size_t) except + nogil
+
+
+cdef dict _phase_to_dict(uint64_t wall_ns, uint64_t peak_rss_kb, dict counters, uint64_t npts, uint64_t nbytes):
+    """ Converts the statistics of one phase into a dict, adding the hardware
+    counters that could be read, the ratios derived from them and, for the
+    phases that count their memory traffic, the effective bandwidth """
+    cdef dict d = {"wall_ns": wall_ns, "peak_rss_kb": peak_rss_kb}
+    if nbytes > 0:
+        d["bytes"] = nbytes
+        if wall_ns > 0:
+            d["bandwidth_gb_s"] = nbytes / wall_ns
+    for name, value in counters.items():
+        if value >= 0:
+            d[name] = value
+            if name.endswith("_misses") and npts > 0:
+                d[name + "_per_particle"] = value / npts
+    if counters["cycles"] > 0 and counters["instructions"] >= 0:
+        d["ipc"] = counters["instructions"] / counters["cycles"]
+    return d
+
+
+cdef dict _counters_to_dict(int64_t cycles, int64_t instructions, int64_t l1d_misses, int64_t llc_misses,
+                            int64_t branch_misses):
+    """ Collects the hardware counters of one phase, -1 when unavailable """
+    return {
+        "cycles": cycles,
+        "instructions": instructions,
+        "l1d_misses": l1d_misses,
+        "llc_misses": llc_misses,
+        "branch_misses": branch_misses,
+    }
+
+
+cdef dict _stats_to_dict(fof_stats& stats):
+    """ Converts run statistics into a dict, with the phases in the order they ran """
+    return {
+        "phases": {
+            p.name.decode(): _phase_to_dict(
+                p.wall_ns, p.peak_rss_kb,
+                _counters_to_dict(p.hw.cycles, p.hw.instructions, p.hw.l1d_misses, p.hw.llc_misses,
+                                  p.hw.branch_misses),
+                stats.npts, p.bytes)
+            for p in stats.phases
+        },
+        "npts": stats.npts,
+        "points_visited": stats.points_visited,
+        "pairs_tested": stats.pairs_tested,
+        "pairs_linked": stats.pairs_linked,
+        "nodes_touched": stats.nodes_touched,
+        "allocations": stats.allocations,
+        "resolution_error": stats.resolution_error,
+    }
+
+
+cdef dict _result_stats_to_dict(const ygg_result* result):
+    """ Converts the statistics of a libygg run into the dict of _stats_to_dict,
+    with the engine and kd-tree leaf size that ran """
+    cdef ygg_stats stats
+    cdef ygg_phase phase
+    cdef size_t i
+    ygg_result_stats(result, &stats)
+    phases = {}
+    for i in range(stats.nphases):
+        ygg_result_phase(result, i, &phase)
+        phases[phase.name.decode()] = _phase_to_dict(
+            phase.wall_ns, phase.peak_rss_kb,
+            _counters_to_dict(phase.hw.cycles, phase.hw.instructions, phase.hw.l1d_misses, phase.hw.llc_misses,
+                              phase.hw.branch_misses),
+            stats.npts, ygg_result_phase_bytes(result, i))
+    return {
+        "phases": phases,
+        "npts": stats.npts,
+        "points_visited": stats.points_visited,
+        "pairs_tested": stats.pairs_tested,
+        "pairs_linked": stats.pairs_linked,
+        "nodes_touched": stats.nodes_touched,
+        "allocations": stats.allocations,
+        "resolution_error": stats.resolution_error,
+        "engine": stats.engine.decode(),
+        "leaf_size": stats.leaf_size,
+    }
+
+
+cdef _check_status(ygg_status status):
+    """ Raises the Python exception matching a failed libygg call """
+    if status == YGG_OK:
+        return
+    message = ygg_last_error().decode()
+    if status == YGG_INVALID_ARGUMENT:
+        raise ValueError(message)
+    if status == YGG_OUT_OF_MEMORY:
+        raise MemoryError(message)
+    raise RuntimeError(message)
+
+
+cdef list _catalog_to_groups(const group_catalog& catalog):
+    """ Converts a CSR catalog into the list of lists returned by friends_of_friends """
+    cdef size_t g, k
+    cdef list groups = []
+    cdef list group
+    if catalog.offsets.empty():
+        return groups
+    for g in range(catalog.offsets.size() - 1):
+        group = []
+        for k in range(catalog.offsets[g], catalog.offsets[g + 1]):
+            group.append(catalog.members[k])
+        groups.append(group)
+    return groups
+
+
+cdef list _result_to_groups(const ygg_result* result):
+    """ Converts the CSR groups of a libygg run into a list of lists """
+    cdef size_t g, k
+    cdef size_t ngroups = ygg_result_ngroups(result)
+    cdef const size_t* offsets = ygg_result_offsets(result)
+    cdef const size_t* members = ygg_result_members(result)
+    cdef list groups = []
+    cdef list group
+    for g in range(ngroups):
+        group = []
+        for k in range(offsets[g], offsets[g + 1]):
+            group.append(members[k])
+        groups.append(group)
+    return groups
+
+
+_ENGINES = ("auto", "grid", "kdtree", "rtree", "brute")
+
+
+cdef np.ndarray _size_t_array(const size_t* values, size_t n):
+    cdef np.ndarray[np.int64_t, ndim=1] array = np.empty(n, dtype=np.int64)
+    cdef size_t i
+    for i in range(n):
+        array[i] = values[i]
+    return array
+
+
+cdef np.ndarray _points3(values, name):
+    """ values as a C-contiguous (N, 3) float64 array, or ValueError naming the argument. """
+    array = np.asarray(values, order='C', dtype=np.float64)
+    if array.size == 0:
+        return array.reshape(0, 3)
+    if array.ndim != 2 or array.shape[1] != 3:
+        raise ValueError("{} must have shape (N, 3), not {}".format(name, array.shape))
+    return array
+
+
+def friends_of_friends(data, double linking_length, bint use_brute = False, double boxsize = 0.0,
+                       bint return_stats = False, bint profile = False, unsigned quantize_bits = 0,
+                       engine = None):
     """ Computes friends-of-friends clustering of data. Distances are computed
     using a euclidian metric.
 
@@ -31,7 +408,37 @@ def friends_of_friends(data, double linking_length, bint use_brute = False):
 
         :param use_brute: Use the brute force, non rtree code path
 
-        :rtype: A list of lists of indices in each cluster type
+        :param boxsize: Side of the periodic box, points are expected in [0, boxsize).
+                        Non-positive values disable periodic boundaries.
+
+        :param return_stats: Also return a dict with the wall time (ns) and
+                             peak RSS (KiB) of every phase, and the number of
+                             points visited, pairs tested and pairs linked
+
+        :param profile: Implies return_stats, and also counts cycles,
+                        instructions, L1d/LLC misses and branch misses of
+                        every phase with perf_event_open, summed over the
+                        OpenMP threads, with the IPC and misses per
+                        particle. Counters the system does not allow are
+                        left out.
+
+        :param quantize_bits: When positive, use the cell-grid engine on
+                              32-bit fixed-point coordinates keeping this many
+                              significant bits (at most 32, 31 without a
+                              periodic box), for 1 to 3 dimensions. The bound
+                              on the distance error over the linking length
+                              is reported as resolution_error in the stats.
+
+        :param engine: One of "grid", "kdtree", "rtree" and "brute", or
+                       "auto" to pick the engine and kd-tree leaf size from
+                       the calibration table given the size, dimension and
+                       sampled neighbour count of the data (see
+                       select_engine). The stats report the engine and
+                       leaf size that ran. Cannot be combined with use_brute
+                       or quantize_bits.
+
+        :rtype: A list of lists of indices in each cluster type, and the
+                statistics if return_stats is set
     """
 
     cdef np.ndarray[double, ndim=2, mode='c'] data_array = np.asarray(
@@ -43,23 +450,937 @@ def friends_of_friends(data, double linking_length, bint use_brute = False):
     if np.any( np.isnan(data) ):
         raise ValueError("NaN detected in pyfof")
 
+    cdef size_t num_points = data_array.shape[0]
+    cdef size_t num_dimensions = data_array.shape[1]
+    return_stats = return_stats or profile
+
+    if quantize_bits > 0 and use_brute:
+        raise ValueError("quantize_bits selects the grid engine and cannot be combined with use_brute")
+    if engine is not None and (use_brute or quantize_bits > 0):
+        raise ValueError("engine cannot be combined with use_brute or quantize_bits")
+    if engine is not None and engine not in _ENGINES:
+        raise ValueError("engine must be one of " + ", ".join(_ENGINES))
+
+    if engine is None:
+        engine = "brute" if use_brute else "grid" if quantize_bits > 0 else "rtree"
+    cdef bytes engine_name = engine.encode()
+    cdef ygg_options options
+    ygg_options_init(&options)
+    options.engine = engine_name
+    options.quantize_bits = quantize_bits
+    options.profile = profile
+
+    cdef const double* data_ptr = &data_array[0,0] if num_points else NULL
+    cdef ygg_result* result = NULL
+    cdef ygg_status status
+    with nogil:
+        status = ygg_fof(data_ptr, num_points, num_dimensions, linking_length, boxsize, &options, &result)
+    _check_status(status)
+    try:
+        groups = _result_to_groups(result)
+        if return_stats:
+            return groups, _result_stats_to_dict(result)
+        return groups
+    finally:
+        ygg_result_destroy(result)
+
+
+def friends_of_friends_batch(sets, double linking_length, offsets = None, double boxsize = 0.0,
+                             engine = "kdtree"):
+    """ Computes friends-of-friends clustering of many independent point sets
+    in one call, e.g. the members of every group, bootstrap resamples or
+    patches of a lightcone. The sets are linked in parallel, largest first,
+    each with the given engine.
+
+        :param sets: A list of numpy arrays with dimensions (npoints_i x ndim),
+                     or, with offsets, one array holding all the sets one
+                     after the other
+
+        :param linking_length: The linking length between cluster members
+
+        :param offsets: First row of each set in sets, followed by the
+                        number of rows (nsets + 1 values)
+
+        :param boxsize: Side of the periodic box. Non-positive values disable
+                        periodic boundaries.
+
+        :param engine: "kdtree", "grid", "rtree", "brute", or "auto" to
+                       select one per set
+
+        :rtype: A dict of arrays: the groups of every set, group g having
+                members members[offsets[g]:offsets[g+1]], indices of points
+                within their own set; set, the set of every group; and
+                set_offsets, the first group of every set
+    """
+
+    if engine not in _ENGINES:
+        raise ValueError("engine must be one of " + ", ".join(_ENGINES))
+
+    cdef np.ndarray[double, ndim=2, mode='c'] data_array
+    if offsets is None:
+        arrays = [np.asarray(s, dtype=np.float64) for s in sets]
+        ndim = arrays[0].shape[1] if arrays else 1
+        if any(a.ndim != 2 or a.shape[1] != ndim for a in arrays):
+            raise ValueError("every set must be an array of shape (npoints, ndim) with the same ndim")
+        data_array = np.ascontiguousarray(np.concatenate(arrays) if arrays else np.zeros((0, 1)))
+        offsets = np.concatenate([[0], np.cumsum([a.shape[0] for a in arrays], dtype=np.int64)])
+    else:
+        data_array = np.asarray(sets, order='C', dtype=np.float64)
+
+    cdef np.ndarray[size_t, ndim=1, mode='c'] set_offsets = np.ascontiguousarray(offsets, dtype=np.uintp)
+    if set_offsets.shape[0] < 1 or set_offsets[0] != 0 \
+            or set_offsets[set_offsets.shape[0] - 1] != <size_t> data_array.shape[0] \
+            or np.any(np.diff(set_offsets.astype(np.int64)) < 0):
+        raise ValueError("offsets must rise from 0 to the number of points")
+
+    if np.any( np.isnan(data_array) ):
+        raise ValueError("NaN detected in pyfof")
+
+    cdef size_t nsets = set_offsets.shape[0] - 1
+    cdef size_t num_dimensions = data_array.shape[1]
+    cdef engine_config config
+    config.engine = engine.encode()
+    config.leaf_size = 0
+    cdef const double* data_ptr = &data_array[0, 0] if data_array.shape[0] else NULL
+    cdef batch_catalog catalog
+    with nogil:
+        catalog = _friends_of_friends_batch(config, data_ptr, &set_offsets[0], nsets, num_dimensions,
+                                            linking_length, boxsize)
+
+    group_sets = _size_t_array(catalog.set_offsets.data(), catalog.set_offsets.size())
+    return {
+        "offsets": _size_t_array(catalog.offsets.data(), catalog.offsets.size()),
+        "members": _size_t_array(catalog.members.data(), catalog.members.size()),
+        "set": np.repeat(np.arange(nsets, dtype=np.int64), np.diff(group_sets)),
+        "set_offsets": group_sets,
+    }
+
+
+cdef vector[size_t] _size_edges(bins, size_t num_points) except *:
+    if bins is None:
+        # Powers of two, up to the first above the largest possible group
+        bins = [1]
+        while len(bins) < 2 or bins[-1] <= num_points:
+            bins.append(2 * bins[-1])
+    edges = np.asarray(bins, dtype=np.int64)
+    if edges.ndim != 1 or edges.shape[0] < 2 or np.any(edges < 0) or np.any(np.diff(edges) <= 0):
+        raise ValueError("bins must be at least two increasing, non-negative group sizes")
+    return [int(e) for e in edges]
+
+
+cdef dict _size_summary_to_dict(const group_size_summary& summary, bint return_sizes):
+    result = {
+        "ngroups": summary.ngroups,
+        "edges": _size_t_array(summary.edges.data(), summary.edges.size()),
+        "counts": _size_t_array(summary.counts.data(), summary.counts.size()),
+        "top_groups": _size_t_array(summary.top_groups.data(), summary.top_groups.size()),
+        "top_sizes": _size_t_array(summary.top_sizes.data(), summary.top_sizes.size()),
+        "top_seeds": _size_t_array(summary.top_seeds.data(), summary.top_seeds.size()),
+    }
+    if return_sizes:
+        result["sizes"] = _size_t_array(summary.sizes.data(), summary.sizes.size())
+    return result
+
+
+def group_multiplicity(data, double linking_length, double boxsize = 0.0, bins = None, size_t top_k = 10,
+                       bint return_sizes = False):
+    """ Computes the group multiplicity function of a friends-of-friends run
+    without building the member lists: every group is reduced to its size as
+    soon as it is complete, which makes each point of a parameter scan much
+    cheaper than friends_of_friends. Groups are those of the kd-tree engine
+    and are numbered as in friends_of_friends(..., engine="kdtree").
+
+        :param data: A numpy array with dimensions (npoints x ndim), 1 to 6
+                     dimensions
+
+        :param linking_length: The linking length between cluster members
+
+        :param boxsize: Side of the periodic box. Non-positive values disable
+                        periodic boundaries.
+
+        :param bins: Increasing bin edges in members, a group of n members
+                     falling in the bin with edges[i] <= n < edges[i+1];
+                     powers of two by default
+
+        :param top_k: Number of largest groups to report
+
+        :param return_sizes: Also return the size of every group
+
+        :rtype: A dict with ngroups, the histogram edges and counts, the
+                top_groups with their top_sizes and top_seeds (a member of
+                each), and the sizes if return_sizes is set
+    """
+
+    cdef np.ndarray[double, ndim=2, mode='c'] data_array = np.asarray(
+        data,
+        order='C',
+        dtype=np.float64,
+    )
+
+    if np.any( np.isnan(data_array) ):
+        raise ValueError("NaN detected in pyfof")
+
+    cdef size_t num_points = data_array.shape[0]
+    cdef size_t num_dimensions = data_array.shape[1]
+    cdef vector[size_t] edges = _size_edges(bins, num_points)
+    cdef const double* data_ptr = &data_array[0, 0] if num_points else NULL
+    cdef group_size_summary summary
+    with nogil:
+        summary = _group_sizes(data_ptr, num_points, num_dimensions, linking_length, boxsize, edges, top_k,
+                               return_sizes, NULL)
+    return _size_summary_to_dict(summary, return_sizes)
+
+
+def set_huge_pages(bint enable):
+    """ Backs the large arrays allocated from now on (coordinates, indices,
+    labels and members of the engines) by transparent huge pages, or stops
+    doing so. The default is taken from the YGG_HUGE_PAGES environment
+    variable. Arrays are always first touched by the OpenMP thread that
+    processes them, so binding the threads with OMP_PLACES and
+    OMP_PROC_BIND keeps them in the memory of their socket.
+
+        :param enable: Whether to advise huge pages
+    """
+    ygg_set_huge_pages(enable)
+
+
+def select_engine(data, double linking_length, double boxsize = 0.0, int nthreads = 0):
+    """ Measures the shape of the data and returns the engine that
+    friends_of_friends(..., engine="auto") would use.
+
+        :param data: A numpy array with dimensions (npoints x ndim)
+
+        :param linking_length: The linking length between cluster members
+
+        :param boxsize: Side of the periodic box. Non-positive values disable
+                        periodic boundaries.
+
+        :param nthreads: Number of OpenMP threads of the run, 0 for the
+                         current maximum
+
+        :rtype: A dict with the engine, the kd-tree leaf_size and the
+                measured npts, ndim, extent, mean_neighbours and nthreads
+    """
+
+    cdef np.ndarray[double, ndim=2, mode='c'] data_array = np.asarray(
+        data,
+        order='C',
+        dtype=np.float64,
+    )
+    cdef size_t num_points = data_array.shape[0]
+    cdef data_shape shape = sample_data_shape(
+        &data_array[0,0] if num_points else NULL, num_points, data_array.shape[1], linking_length, boxsize, 256)
+    if nthreads > 0:
+        shape.nthreads = nthreads
+    cdef engine_config config = _select_engine(shape)
+    return {
+        "engine": config.engine.decode(),
+        "leaf_size": config.leaf_size,
+        "npts": shape.npts,
+        "ndim": shape.ndim,
+        "extent": shape.extent,
+        "mean_neighbours": shape.mean_neighbours,
+        "nthreads": shape.nthreads,
+    }
+
+
+def halo_properties(data, groups, velocities=None, masses=None, double particle_mass = 1.0, double boxsize = 0.0):
+    """ Computes the properties of friends-of-friends groups in a single
+    parallel pass over their members.
+
+        :param data: A numpy array of positions with dimensions (npoints x ndim)
+
+        :param groups: The groups returned by friends_of_friends
+
+        :param velocities: Optional array of velocities with the same shape as data
+
+        :param masses: Optional array of per-particle masses (npoints)
+
+        :param particle_mass: Mass of every particle when masses is not given
+
+        :param boxsize: Side of the periodic box. Non-positive values disable
+                        periodic unwrapping.
+
+        :rtype: A dict of arrays indexed by group: npart, mass, com, extent and,
+                when velocities are given, vel and sigma_v
+    """
+
+    cdef np.ndarray[double, ndim=2, mode='c'] data_array = np.asarray(
+        data,
+        order='C',
+        dtype=np.float64,
+    )
+    cdef np.ndarray[double, ndim=2, mode='c'] vel_array
+    cdef np.ndarray[double, ndim=1, mode='c'] mass_array
+    cdef double* vel_ptr = NULL
+    cdef double* mass_ptr = NULL
+
     num_points = data_array.shape[0]
     num_dimensions = data_array.shape[1]
 
+    if velocities is not None:
+        vel_array = np.asarray(velocities, order='C', dtype=np.float64)
+        if vel_array.shape[0] != num_points or vel_array.shape[1] != num_dimensions:
+            raise ValueError("velocities must have the same shape as data")
+        if num_points > 0:
+            vel_ptr = &vel_array[0, 0]
+
+    if masses is not None:
+        mass_array = np.asarray(masses, order='C', dtype=np.float64)
+        if mass_array.shape[0] != num_points:
+            raise ValueError("masses must have one entry per point")
+        if num_points > 0:
+            mass_ptr = &mass_array[0]
+
+    cdef group_catalog catalog = make_group_catalog(groups, num_points)
+    cdef _halo_properties props
+
     if num_points == 0:
-        return []
-
-    if use_brute:
-        return _friends_of_friends_brute(
-            &data_array[0,0],
-            num_points,
-            num_dimensions,
-            linking_length,
-        )
+        props.ndim = num_dimensions
     else:
-        return _friends_of_friends(
-            &data_array[0,0],
-            num_points,
-            num_dimensions,
-            linking_length,
-        )
+        with nogil:
+            props = _compute_halo_properties(catalog, &data_array[0, 0], vel_ptr, mass_ptr,
+                                             num_dimensions, particle_mass, boxsize)
+
+    result = {
+        "npart": np.array(props.npart, dtype=np.intp),
+        "mass": np.array(props.mass, dtype=np.float64),
+        "com": np.array(props.com, dtype=np.float64).reshape(-1, num_dimensions),
+        "extent": np.array(props.extent, dtype=np.float64),
+    }
+    if velocities is not None:
+        result["vel"] = np.array(props.vel, dtype=np.float64).reshape(-1, num_dimensions)
+        result["sigma_v"] = np.array(props.sigma_v, dtype=np.float64)
+    return result
+
+
+def group_potential(data, groups, masses=None, double particle_mass = 1.0, double boxsize = 0.0,
+                    double G = 1.0, double softening = 0.0, double theta = 0.5, size_t direct_threshold = 256):
+    """ Computes the gravitational potential of every group member due to the
+    other members of its group, with a Barnes-Hut tree walk for large groups
+    and a direct sum for small ones.
+
+        :param data: A numpy array of positions with dimensions (npoints x 3)
+
+        :param groups: The groups returned by friends_of_friends
+
+        :param masses: Optional array of per-particle masses (npoints)
+
+        :param particle_mass: Mass of every particle when masses is not given
+
+        :param boxsize: Side of the periodic box. Non-positive values disable
+                        periodic unwrapping.
+
+        :param G: Gravitational constant in the units of data and masses
+
+        :param softening: Plummer softening length
+
+        :param theta: Opening angle of the tree walk, 0 gives the exact sum
+
+        :param direct_threshold: Groups with at most this many members use the
+                                 direct sum
+
+        :rtype: A dict with the potential of every point (0 outside groups) and
+                the index of the most-bound member of each group
+    """
+
+    cdef np.ndarray[double, ndim=2, mode='c'] data_array = _points3(data, "data")
+    cdef np.ndarray[double, ndim=1, mode='c'] mass_array
+    cdef double* mass_ptr = NULL
+    cdef size_t num_points = data_array.shape[0]
+
+    if masses is not None:
+        mass_array = np.asarray(masses, order='C', dtype=np.float64)
+        if <size_t> mass_array.shape[0] != num_points:
+            raise ValueError("masses must have one entry per point")
+        if num_points > 0:
+            mass_ptr = &mass_array[0]
+
+    cdef group_catalog catalog = make_group_catalog(groups, num_points)
+    cdef _group_potential result
+    cdef const double* data_ptr = &data_array[0, 0] if num_points > 0 else NULL
+
+    with nogil:
+        result = _compute_group_potential(catalog, data_ptr, mass_ptr, num_points, particle_mass, boxsize,
+                                          G, softening, theta, direct_threshold)
+
+    return {
+        "potential": np.array(result.potential, dtype=np.float64),
+        "most_bound": np.array(result.most_bound, dtype=np.intp),
+    }
+
+
+def subgroups(data, groups, double linking_length, double ratio = 0.5, size_t levels = 2,
+              size_t min_members = 20, double boxsize = 0.0):
+    """ Finds substructure by re-linking every group at successively shorter
+    linking lengths (b * ratio, b * ratio**2, ...).
+
+        :param data: A numpy array of positions with dimensions (npoints x 3)
+
+        :param groups: The groups returned by friends_of_friends
+
+        :param linking_length: The linking length used to find the groups
+
+        :param ratio: Factor applied to the linking length at each rung
+
+        :param levels: Number of rungs to link below the input groups
+
+        :param min_members: Smallest subgroup that is kept and recursed into
+
+        :param boxsize: Side of the periodic box. Non-positive values disable
+                        periodic unwrapping.
+
+        :rtype: A dict with the list of groups and subgroups, stored depth first,
+                the index of the parent of each (-1 for the input groups) and
+                the rung it was linked at (0 for the input groups)
+    """
+
+    cdef np.ndarray[double, ndim=2, mode='c'] data_array = _points3(data, "data")
+    cdef size_t num_points = data_array.shape[0]
+    cdef group_catalog catalog = make_group_catalog(groups, num_points)
+    cdef group_hierarchy tree
+    cdef const double* data_ptr = &data_array[0, 0] if num_points > 0 else NULL
+    cdef size_t n
+
+    with nogil:
+        tree = _find_subgroups(catalog, data_ptr, boxsize, linking_length, ratio, levels, min_members)
+
+    return {
+        "groups": [
+            [tree.members[k] for k in range(tree.offsets[n], tree.offsets[n + 1])]
+            for n in range(tree.parent.size())
+        ],
+        "parent": np.array(tree.parent, dtype=np.int64),
+        "level": np.array(tree.level, dtype=np.intp),
+    }
+
+
+def phase_space_groups(data, velocities, groups, double linking_length, double velocity_linking_length = 0.0,
+                       size_t min_members = 20, double boxsize = 0.0):
+    """ Runs 6-D friends-of-friends in phase space inside every group. Two
+    members are friends when |dx|**2 / b_x**2 + |dv|**2 / b_v**2 < 1.
+
+        :param data: A numpy array of positions with dimensions (npoints x 3)
+
+        :param velocities: A numpy array of velocities with dimensions (npoints x 3)
+
+        :param groups: The groups returned by friends_of_friends
+
+        :param linking_length: The spatial linking length b_x
+
+        :param velocity_linking_length: The velocity linking length b_v.
+                                        Non-positive values use, in every
+                                        group, b_x * sigma_v / sigma_x from
+                                        its own dispersions.
+
+        :param min_members: Smallest phase-space subgroup that is kept
+
+        :param boxsize: Side of the periodic box. Positions are periodic,
+                        velocities are not. Non-positive values disable
+                        periodic unwrapping.
+
+        :rtype: A dict with the list of phase-space groups and the index of
+                the input group each was found in
+    """
+
+    cdef np.ndarray[double, ndim=2, mode='c'] data_array = _points3(data, "data")
+    cdef np.ndarray[double, ndim=2, mode='c'] vel_array = _points3(velocities, "velocities")
+    cdef size_t num_points = data_array.shape[0]
+
+    if <size_t> vel_array.shape[0] != num_points:
+        raise ValueError("velocities must have the same shape as data")
+    if linking_length <= 0:
+        raise ValueError("linking_length must be positive")
+
+    cdef group_catalog catalog = make_group_catalog(groups, num_points)
+    cdef _phase_space_groups result
+    cdef const double* data_ptr = &data_array[0, 0] if num_points > 0 else NULL
+    cdef const double* vel_ptr = &vel_array[0, 0] if num_points > 0 else NULL
+
+    with nogil:
+        result = _find_phase_space_groups(catalog, data_ptr, vel_ptr, num_points, boxsize, linking_length,
+                                          velocity_linking_length, min_members)
+
+    return {
+        "groups": _catalog_to_groups(result.groups),
+        "parent": np.array(result.parent, dtype=np.intp),
+    }
+
+
+def merger_tree(ids_prev, labels_prev, ids_next, labels_next, size_t passes = 1):
+    """ Links the groups of two snapshots through the particle IDs they
+    share, with a partitioned parallel hash join.
+
+        :param ids_prev: Particle IDs of the earlier snapshot, unique
+
+        :param labels_prev: Group of every particle of the earlier snapshot,
+                            -1 when ungrouped
+
+        :param ids_next: Particle IDs of the later snapshot
+
+        :param labels_next: Group of every particle of the later snapshot,
+                            -1 when ungrouped
+
+        :param passes: Number of streaming passes; more passes lower the peak
+                       memory of the join
+
+        :rtype: A dict with the progenitor, descendant and number of shared
+                particles of every linked pair, and the main progenitor
+                (-1 if none) and its merit shared**2 / (n_prog * n_desc)
+                for every descendant group
+    """
+
+    cdef np.ndarray[uint64_t, ndim=1, mode='c'] prev_ids = np.ascontiguousarray(ids_prev, dtype=np.uint64)
+    cdef np.ndarray[int64_t, ndim=1, mode='c'] prev_labels = np.ascontiguousarray(labels_prev, dtype=np.int64)
+    cdef np.ndarray[uint64_t, ndim=1, mode='c'] next_ids = np.ascontiguousarray(ids_next, dtype=np.uint64)
+    cdef np.ndarray[int64_t, ndim=1, mode='c'] next_labels = np.ascontiguousarray(labels_next, dtype=np.int64)
+    cdef size_t nprev = prev_ids.shape[0]
+    cdef size_t nnext = next_ids.shape[0]
+
+    if <size_t> prev_labels.shape[0] != nprev or <size_t> next_labels.shape[0] != nnext:
+        raise ValueError("labels must have one entry per particle ID")
+
+    cdef const uint64_t* prev_ids_ptr = &prev_ids[0] if nprev > 0 else NULL
+    cdef const int64_t* prev_labels_ptr = &prev_labels[0] if nprev > 0 else NULL
+    cdef const uint64_t* next_ids_ptr = &next_ids[0] if nnext > 0 else NULL
+    cdef const int64_t* next_labels_ptr = &next_labels[0] if nnext > 0 else NULL
+    cdef merger_links links
+
+    with nogil:
+        links = _link_merger_tree(prev_ids_ptr, prev_labels_ptr, nprev, next_ids_ptr, next_labels_ptr, nnext,
+                                  passes)
+
+    return {
+        "progenitor": np.array(links.progenitor, dtype=np.int64),
+        "descendant": np.array(links.descendant, dtype=np.int64),
+        "shared": np.array(links.shared, dtype=np.intp),
+        "main_progenitor": np.array(links.main_progenitor, dtype=np.int64),
+        "merit": np.array(links.merit, dtype=np.float64),
+    }
+
+
+cdef class GroupIterator:
+    """ Friends-of-friends groups handed over while a worker thread is still
+    linking the rest, see iter_groups and SpatialIndex.iter_groups.
+    """
+
+    cdef group_stream* stream
+    cdef group_batch batch
+    cdef size_t position
+    cdef bint batched
+    cdef object owner
+
+    def __dealloc__(self):
+        with nogil:
+            del self.stream
+
+    def __iter__(self):
+        return self
+
+    cdef bint _fetch(self) except -1:
+        cdef bint more
+        with nogil:
+            more = self.stream.next(self.batch)
+        self.position = 0
+        return more
+
+    def __next__(self):
+        cdef size_t begin, end
+        if self.stream == NULL:
+            raise StopIteration
+        if self.batched:
+            if not self._fetch():
+                raise StopIteration
+            return (_size_t_array(self.batch.offsets.data(), self.batch.offsets.size()),
+                    _size_t_array(self.batch.members.data(), self.batch.members.size()))
+        while self.position + 1 >= self.batch.offsets.size():
+            if not self._fetch():
+                raise StopIteration
+        begin = self.batch.offsets[self.position]
+        end = self.batch.offsets[self.position + 1]
+        self.position += 1
+        return _size_t_array(self.batch.members.data() + begin, end - begin)
+
+    def close(self):
+        """ Stops the worker thread; the groups not yet returned are dropped. """
+        # Deleting the stream joins the worker and releases the batches still queued
+        with nogil:
+            del self.stream
+        self.stream = NULL
+        self.batch.offsets.clear()
+        self.batch.members.clear()
+
+
+cdef GroupIterator _group_iterator(object owner, batch_size, size_t queue_size):
+    if batch_size is not None and batch_size < 1:
+        raise ValueError("batch_size must be positive")
+    if queue_size < 1:
+        raise ValueError("queue_size must be positive")
+    cdef GroupIterator iterator = GroupIterator.__new__(GroupIterator)
+    iterator.owner = owner
+    iterator.batched = batch_size is not None
+    return iterator
+
+
+def iter_groups(data, double linking_length, double boxsize = 0.0, batch_size = None, size_t queue_size = 4):
+    """ Yields the friends-of-friends groups of a point set as they complete,
+    while a worker thread links the remaining points without holding the GIL.
+    The groups, and their members, are those of the kd-tree engine of
+    friends_of_friends. At most queue_size batches wait to be consumed, so
+    the memory held by the results stays bounded however many groups there
+    are; the worker pauses when the consumer falls behind, and stops when the
+    iterator is closed or garbage collected.
+
+        :param data: A numpy array with dimensions (npoints x ndim), 1 to 6
+                     dimensions, which must not change while iterating
+
+        :param linking_length: The linking length between cluster members
+
+        :param boxsize: Side of the periodic box. Non-positive values disable
+                        periodic boundaries.
+
+        :param batch_size: If given, yield (offsets, members) arrays of up to
+                           batch_size groups at once, group i being
+                           members[offsets[i]:offsets[i+1]]; otherwise yield
+                           every group as an array of indices
+
+        :param queue_size: Batches completed ahead of the consumer at most
+
+        :rtype: An iterator over the groups
+    """
+
+    cdef np.ndarray[double, ndim=2, mode='c'] data_array = np.asarray(
+        data,
+        order='C',
+        dtype=np.float64,
+    )
+
+    if np.any( np.isnan(data_array) ):
+        raise ValueError("NaN detected in pyfof")
+
+    cdef size_t num_points = data_array.shape[0]
+    cdef size_t num_dimensions = data_array.shape[1]
+    cdef GroupIterator iterator = _group_iterator(data_array, batch_size, queue_size)
+    cdef const double* data_ptr = &data_array[0, 0] if num_points else NULL
+    iterator.stream = new group_stream(data_ptr, num_points, num_dimensions, linking_length, boxsize,
+                                       batch_size if batch_size is not None else 256, queue_size)
+    return iterator
+
+
+# Placeholder data of an index whose tree SpatialIndex.load maps from a file
+_LOADED = object()
+
+
+cdef class SpatialIndex:
+    """ A kd-tree over a set of 3-D points. It is built once and then shared by
+    the friends-of-friends pass and the per-group stages that query all
+    particles around each group, such as spherical_overdensity.
+
+        :param data: A numpy array with dimensions (npoints x 3)
+
+        :param boxsize: Side of the periodic box, points are expected in [0, boxsize).
+                        Non-positive values disable periodic boundaries.
+
+        :param leaf_size: Maximum number of points in a leaf of the tree
+
+        :param profile: Count hardware events while building, see build_stats
+    """
+
+    cdef kd_tree3* tree
+    cdef fof_stats _build_stats
+    cdef readonly double boxsize
+
+    def __cinit__(self, data, double boxsize = 0.0, size_t leaf_size = 16, bint profile = False):
+        if data is _LOADED:
+            # Filled by SpatialIndex.load
+            return
+        cdef np.ndarray[double, ndim=2, mode='c'] data_array = _points3(data, "data")
+
+        if np.any( np.isnan(data_array) ):
+            raise ValueError("NaN detected in pyfof")
+
+        cdef size_t num_points = data_array.shape[0]
+        cdef const double* data_ptr = &data_array[0, 0] if num_points > 0 else NULL
+
+        self.boxsize = boxsize
+        self._build_stats.profile = profile
+        with nogil:
+            self.tree = new kd_tree3(data_ptr, num_points, boxsize, leaf_size, &self._build_stats)
+
+    def __dealloc__(self):
+        del self.tree
+
+    def __len__(self):
+        return self.tree.size()
+
+    def update_positions(self, data, double max_overlap = 0.25):
+        """ Moves the indexed points to new coordinates, e.g. the next snapshot
+        of a time series, refitting the tree instead of rebuilding it. Only
+        subtrees whose children overlap by more than max_overlap of their
+        extent in every dimension are rebuilt.
+
+            :param data: A numpy array with dimensions (npoints x 3), in the
+                         same order as the data the index was built from
+
+            :param max_overlap: Largest tolerated overlap of sibling nodes, as
+                                a fraction of the parent extent
+
+            :rtype: The number of points whose subtree was rebuilt
+        """
+        cdef np.ndarray[double, ndim=2, mode='c'] data_array = _points3(data, "data")
+
+        if <size_t> data_array.shape[0] != self.tree.size():
+            raise ValueError("data must have one row per indexed point")
+        if np.any( np.isnan(data_array) ):
+            raise ValueError("NaN detected in pyfof")
+
+        cdef const double* data_ptr = &data_array[0, 0] if data_array.shape[0] > 0 else NULL
+        cdef size_t rebuilt
+        with nogil:
+            rebuilt = self.tree.update_positions(data_ptr, max_overlap)
+        return rebuilt
+
+    def save(self, path, uint64_t checksum = 0):
+        """ Writes the index to a file that SpatialIndex.load maps back in
+        milliseconds, instead of rebuilding the tree. The file is replaced
+        atomically.
+
+            :param path: File to write
+
+            :param checksum: Any 64-bit integer identifying the indexed data,
+                             e.g. a hash of the snapshot header, which load
+                             checks
+        """
+        cdef string path_bytes = os.fsencode(path)
+        with nogil:
+            _save_kd_tree(self.tree[0], path_bytes, checksum)
+
+    @staticmethod
+    def load(path, npts = None, boxsize = None, checksum = None, bint verify = False):
+        """ Reopens an index written by save. The file is mapped read-only
+        and read in place, so processes on a node that load the same file
+        share its memory; the index is copied only if update_positions is
+        called.
+
+            :param path: File written by save
+
+            :param npts: Number of points the index must have
+
+            :param boxsize: Box size the index must have been built with
+
+            :param checksum: Checksum the index must have been saved with
+
+            :param verify: Also check the whole file against the hash stored
+                           when it was saved, which reads it
+
+            :rtype: A SpatialIndex
+        """
+        cdef string path_bytes = os.fsencode(path)
+        cdef kd_tree_file_header header = read_kd_tree_header(path_bytes)
+        if header.dimension != 3:
+            raise ValueError("{} holds a {}-dimensional index".format(path, header.dimension))
+        cdef kd_tree_source expected
+        expected.npts = header.npts if npts is None else npts
+        expected.boxsize = header.boxsize if boxsize is None else boxsize
+        expected.checksum = header.checksum if checksum is None else checksum
+
+        cdef SpatialIndex index = SpatialIndex.__new__(SpatialIndex, _LOADED)
+        with nogil:
+            index.tree = _open_kd_tree(path_bytes, expected, verify).release()
+        index.boxsize = expected.boxsize
+        return index
+
+    @property
+    def mapped(self):
+        """ Whether the index reads a file mapped by load """
+        return self.tree.mapped()
+
+    @property
+    def build_stats(self):
+        """ Statistics of the construction of the index, in the format returned
+        by friends_of_friends with return_stats """
+        return _stats_to_dict(self._build_stats)
+
+    def friends_of_friends(self, double linking_length, bint return_stats = False, bint profile = False,
+                           checkpoint = None, double checkpoint_interval = 60.0):
+        """ Computes friends-of-friends clustering of the indexed points.
+
+            :param linking_length: The linking length between cluster members
+
+            :param return_stats: Also return the statistics of the run, as in
+                                 ygg.friends_of_friends, with the number of
+                                 tree nodes touched
+
+            :param profile: Implies return_stats and adds hardware counters,
+                            as in ygg.friends_of_friends
+
+            :param checkpoint: File the progress is saved to in the
+                               background, and resumed from if it holds a
+                               checkpoint of the same index and linking
+                               length, e.g. of a run that was killed. It is
+                               left complete at the end; points_visited
+                               only counts the points linked by this call
+
+            :param checkpoint_interval: Seconds between two checkpoints
+
+            :rtype: A list of lists of indices in each cluster type, and the
+                    statistics if return_stats is set
+        """
+        cdef group_catalog catalog
+        return_stats = return_stats or profile
+        cdef fof_stats stats
+        cdef fof_stats* stats_ptr = &stats if return_stats else NULL
+        stats.profile = profile
+        cdef checkpoint_config config
+        if checkpoint is not None:
+            config.path = os.fsencode(checkpoint)
+            config.interval = checkpoint_interval
+        with nogil:
+            if config.path.empty():
+                catalog = _friends_of_friends_kdtree(self.tree[0], linking_length, stats_ptr)
+            else:
+                catalog = _friends_of_friends_kdtree_checkpointed(self.tree[0], linking_length, config, stats_ptr)
+        if return_stats:
+            return _catalog_to_groups(catalog), _stats_to_dict(stats)
+        return _catalog_to_groups(catalog)
+
+    def group_multiplicity(self, double linking_length, bins = None, size_t top_k = 10,
+                           bint return_sizes = False):
+        """ Computes the group multiplicity function of the indexed points
+        without building the member lists, as ygg.group_multiplicity but
+        reusing this tree. Groups are numbered as in friends_of_friends.
+
+            :param linking_length: The linking length between cluster members
+
+            :param bins: Increasing bin edges in members; powers of two by default
+
+            :param top_k: Number of largest groups to report
+
+            :param return_sizes: Also return the size of every group
+
+            :rtype: A dict as returned by ygg.group_multiplicity
+        """
+        cdef vector[size_t] edges = _size_edges(bins, self.tree.size())
+        cdef group_size_summary summary
+        with nogil:
+            summary = _kdtree_group_sizes(self.tree[0], linking_length, edges, top_k, return_sizes, NULL)
+        return _size_summary_to_dict(summary, return_sizes)
+
+    def iter_groups(self, double linking_length, batch_size = None, size_t queue_size = 4):
+        """ Yields the friends-of-friends groups of the indexed points as they
+        complete, like the module-level iter_groups but reusing this tree. The
+        positions must not be updated until the iterator is exhausted or
+        closed.
+
+            :param linking_length: The linking length between cluster members
+
+            :param batch_size: If given, yield (offsets, members) arrays of up
+                               to batch_size groups at once
+
+            :param queue_size: Batches completed ahead of the consumer at most
+
+            :rtype: An iterator over the groups
+        """
+        cdef GroupIterator iterator = _group_iterator(self, batch_size, queue_size)
+        iterator.stream = new group_stream(self.tree[0], linking_length,
+                                           batch_size if batch_size is not None else 256, queue_size)
+        return iterator
+
+    def spherical_overdensity(self, centres, radii=None, masses=None, double particle_mass = 1.0, *,
+                              double om0, double oml, double h, double redshift,
+                              double length_unit = 1.0, double mass_unit = 1.0):
+        """ Computes M200c, M500c and the Bryan & Norman virial mass around
+        each centre, using every indexed particle.
+
+            :param centres: A numpy array of centres (ncentres x 3), e.g. the
+                            com returned by halo_properties
+
+            :param radii: Optional initial search radius per centre, e.g. the
+                          extent returned by halo_properties
+
+            :param masses: Optional array of per-particle masses, indexed like
+                           the points the index was built from
+
+            :param particle_mass: Mass of every particle when masses is not given
+
+            :param om0, oml, h, redshift: Cosmology, as in the Gadget header;
+                                          required, and either flat or
+                                          with oml = 0 for the virial mass
+
+            :param length_unit: Position unit in comoving kpc/h
+
+            :param mass_unit: Mass unit in 1e10 Msun/h
+
+            :rtype: A dict of arrays indexed by centre: m200c, r200c, m500c,
+                    r500c, mvir and rvir, with comoving radii
+        """
+        cdef np.ndarray[double, ndim=2, mode='c'] centre_array = _points3(centres, "centres")
+        cdef np.ndarray[double, ndim=1, mode='c'] radius_array
+        cdef np.ndarray[double, ndim=1, mode='c'] mass_array
+        cdef double* radius_ptr = NULL
+        cdef double* mass_ptr = NULL
+        cdef size_t num_centres = centre_array.shape[0]
+
+        if radii is not None:
+            radius_array = np.asarray(radii, order='C', dtype=np.float64)
+            if <size_t> radius_array.shape[0] != num_centres:
+                raise ValueError("radii must have one entry per centre")
+            if num_centres > 0:
+                radius_ptr = &radius_array[0]
+
+        if masses is not None:
+            mass_array = np.asarray(masses, order='C', dtype=np.float64)
+            if <size_t> mass_array.shape[0] != self.tree.size():
+                raise ValueError("masses must have one entry per indexed point")
+            if mass_array.shape[0] > 0:
+                mass_ptr = &mass_array[0]
+
+        cdef cosmology cosmo
+        cosmo.om0 = om0
+        cosmo.oml = oml
+        cosmo.h = h
+        cosmo.redshift = redshift
+        cosmo.length_unit = length_unit
+        cosmo.mass_unit = mass_unit
+
+        cdef so_masses so
+        cdef const double* centre_ptr = &centre_array[0, 0] if num_centres > 0 else NULL
+        with nogil:
+            so = _compute_so_masses(self.tree[0], centre_ptr, num_centres, radius_ptr, mass_ptr,
+                                    particle_mass, cosmo)
+
+        return {
+            "m200c": np.array(so.m200c, dtype=np.float64),
+            "r200c": np.array(so.r200c, dtype=np.float64),
+            "m500c": np.array(so.m500c, dtype=np.float64),
+            "r500c": np.array(so.r500c, dtype=np.float64),
+            "mvir": np.array(so.mvir, dtype=np.float64),
+            "rvir": np.array(so.rvir, dtype=np.float64),
+        }
+
+    def attach(self, data, groups, double max_distance = 0.0):
+        """ Assigns points (e.g. gas and stars) to the group of their nearest
+        indexed point (e.g. dark matter), instead of running
+        friends-of-friends again on the mixed particle set.
+
+            :param data: A numpy array of positions with dimensions (npoints x 3)
+
+            :param groups: Groups of indexed points, e.g. from friends_of_friends
+
+            :param max_distance: Points farther than this from every indexed
+                                 point stay unassigned. Non-positive values
+                                 disable the limit.
+
+            :rtype: An array with the index of the group of every point, -1 if
+                    unassigned
+        """
+        cdef np.ndarray[double, ndim=2, mode='c'] data_array = _points3(data, "data")
+        cdef size_t num_points = data_array.shape[0]
+        cdef group_catalog catalog = make_group_catalog(groups, self.tree.size())
+        cdef vector[int64_t] labels
+        cdef const double* data_ptr = &data_array[0, 0] if num_points > 0 else NULL
+
+        with nogil:
+            labels = _attach_to_nearest(self.tree[0], catalog.labels, data_ptr, num_points, max_distance)
+
+        return np.array(labels, dtype=np.int64)
@@ -0,0 +1,124 @@
+#include "spherical_overdensity.hpp"
+#include "periodic.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+// Typedef for convenience
+typedef std::size_t size_t;
+
+namespace {
+
+/// Number of overdensity thresholds evaluated per centre (200c, 500c, vir).
+const size_t NDELTA = 3;
+
+/// Growth factor of the search radius when the profile has not yet dropped below the thresholds.
+const double RADIUS_GROWTH = 1.5;
+
+/// Most growth steps per centre, a factor 1.5^64 ~ 1e11 on the starting radius.
+const size_t MAX_GROWTH_STEPS = 64;
+
+/**
+ * @brief Radius at which a sphere of mass m has mean density rho.
+ */
+inline double radius_at_density(double m, double rho) {
+    return std::cbrt(3. * m / (4. * M_PI * rho));
+}
+
+} // End of anonymous namespace
+
+// Expanding ball queries around every centre, parallel over centres
+so_masses compute_so_masses(const kd_tree3 &tree, const double *centres, size_t ncentres, const double *rguess,
+                            const double *mass, double particle_mass, const cosmology &cosmo) {
+    const double rho_c = critical_density_comoving(cosmo);
+    const double thresholds[NDELTA] = {200. * rho_c, 500. * rho_c, delta_vir_bryan_norman(cosmo) * rho_c};
+    const double thr_min = *std::min_element(thresholds, thresholds + NDELTA);
+    const double boxsize = tree.boxsize();
+
+    so_masses out;
+    std::vector<double> *masses[NDELTA] = {&out.m200c, &out.m500c, &out.mvir};
+    std::vector<double> *radii[NDELTA] = {&out.r200c, &out.r500c, &out.rvir};
+    for (size_t t = 0; t < NDELTA; ++t) {
+        masses[t]->assign(ncentres, 0.);
+        radii[t]->assign(ncentres, 0.);
+    }
+
+    // Without a guess, start from the radius holding a few tens of particles at the lowest threshold,
+    // taking the mean mass when the particles have their own
+    double mean_mass = particle_mass;
+    if (mass != nullptr && tree.size() > 0) {
+        double total = 0.;
+        #pragma omp parallel for schedule(static) reduction(+ : total)
+        for (long i = 0; i < static_cast<long>(tree.size()); ++i) {
+            total += mass[i];
+        }
+        mean_mass = total / tree.size();
+    }
+    double rdefault = radius_at_density(32. * mean_mass, thr_min);
+    if (!(rdefault > 0.) || !std::isfinite(rdefault)) {
+        // Massless particles: any ball is below the thresholds, so the profile is read at once
+        rdefault = 1.;
+    }
+
+    #pragma omp parallel
+    {
+        // (squared distance, mass) profile, reused across the centres handled by this thread
+        std::vector<std::pair<double, double>> profile;
+
+        #pragma omp for schedule(dynamic, 1)
+        for (long c = 0; c < static_cast<long>(ncentres); ++c) {
+            double x[3];
+            for (size_t d = 0; d < 3; ++d) {
+                x[d] = periodic_wrap(centres[c * 3 + d], boxsize);
+            }
+            double r = (rguess != nullptr && rguess[c] > 0. && std::isfinite(rguess[c])) ? rguess[c] : rdefault;
+
+            // Grow the ball until the mean density inside it is below every threshold
+            for (size_t step = 0;; ++step) {
+                profile.clear();
+                tree.ball_query(x, r, [&](size_t k, double d2) {
+                    const size_t i = tree.index(k);
+                    profile.emplace_back(d2, mass != nullptr ? mass[i] : particle_mass);
+                });
+                double mtot = 0.;
+                for (auto const &p : profile) mtot += p.second;
+                if (mtot < thr_min * 4. / 3. * M_PI * r * r * r || (boxsize > 0. && r >= 0.5 * boxsize) ||
+                    step + 1 >= MAX_GROWTH_STEPS) {
+                    break;
+                }
+                r *= RADIUS_GROWTH;
+            }
+            std::sort(profile.begin(), profile.end());
+
+            // Walk the cumulative profile outwards; the first particle at which the mean enclosed density
+            // drops below a threshold brackets its crossing, and the mass inside is the mass before it
+            size_t todo = NDELTA;
+            bool done[NDELTA] = {false, false, false};
+            double menc = 0.;
+            for (size_t k = 0; k < profile.size() && todo > 0; ++k) {
+                const double rk = std::sqrt(profile[k].first);
+                const double mk = menc + profile[k].second;
+                const double rho = rk > 0. ? mk / (4. / 3. * M_PI * rk * rk * rk) : HUGE_VAL;
+                for (size_t t = 0; t < NDELTA; ++t) {
+                    if (!done[t] && rho < thresholds[t]) {
+                        (*masses[t])[c] = menc;
+                        (*radii[t])[c] = menc > 0. ? radius_at_density(menc, thresholds[t]) : 0.;
+                        done[t] = true;
+                        --todo;
+                    }
+                }
+                menc = mk;
+            }
+            // Thresholds never crossed inside the last particle are crossed between it and the ball edge
+            for (size_t t = 0; t < NDELTA; ++t) {
+                if (!done[t] && menc > 0.) {
+                    (*masses[t])[c] = menc;
+                    (*radii[t])[c] = radius_at_density(menc, thresholds[t]);
+                }
+            }
+        }
+    }
+
+    return out;
+}
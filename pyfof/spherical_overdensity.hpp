@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdlib>
+#include <vector>
+
+#include "cosmology.hpp"
+#include "kdtree.hpp"
+
+/**
+ * @brief Spherical-overdensity masses and radii around a set of centres.
+ *
+ * Radii are comoving, in the units of the positions; masses are in the units of the particle masses.
+ * A centre whose innermost particle already falls below the threshold gets zero mass and radius.
+ */
+struct so_masses {
+    std::vector<double> m200c;  ///< Mass within the radius enclosing 200 times the critical density.
+    std::vector<double> r200c;  ///< Radius enclosing 200 times the critical density.
+    std::vector<double> m500c;  ///< Mass within the radius enclosing 500 times the critical density.
+    std::vector<double> r500c;  ///< Radius enclosing 500 times the critical density.
+    std::vector<double> mvir;   ///< Mass within the Bryan & Norman (1998) virial radius.
+    std::vector<double> rvir;   ///< Bryan & Norman (1998) virial radius.
+};
+
+/**
+ * @brief Compute M200c, M500c and Mvir around the given centres using all particles of the index.
+ *
+ * For each centre a ball query on the shared spatial index collects every particle (not only FoF
+ * members) out to a trial radius; the distances are sorted into a cumulative mass profile and the
+ * radius is grown until the mean enclosed density drops below the smallest threshold. Centres are
+ * distributed over OpenMP threads with dynamic scheduling, since a massive cluster costs orders of
+ * magnitude more than a small group, and each thread reuses one profile buffer.
+ *
+ * @param tree Spatial index over the particles, e.g. the one used for the FoF pass.
+ * @param centres Pointer to the centres, three contiguous coordinates each (e.g. FoF centres of mass).
+ * @param ncentres Number of centres.
+ * @param rguess Optional initial search radii, one per centre (e.g. the FoF extent), or nullptr.
+ * @param mass Pointer to per-particle masses indexed like the input of the tree, or nullptr to use `particle_mass`.
+ * @param particle_mass Mass of every particle when `mass` is nullptr; also sets the default initial search radius.
+ * @param cosmo Background cosmology and units, used for the critical density and the virial overdensity.
+ * @return so_masses Masses and radii indexed like the centres.
+ */
+so_masses compute_so_masses(const kd_tree3 &tree, const double *centres, std::size_t ncentres, const double *rguess,
+                            const double *mass, double particle_mass, const cosmology &cosmo);
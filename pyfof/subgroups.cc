@@ -0,0 +1,211 @@
+#include "subgroups.hpp"
+#include "fof_kdtree.hpp"
+#include "kdtree.hpp"
+#include "periodic.hpp"
+
+#include <cmath>
+#include <cstdint>
+
+// Typedef for convenience
+typedef std::size_t size_t;
+
+namespace {
+
+/// Number of particles that make a group worth its own task; smaller groups are batched up to this size.
+const size_t TASK_PARTICLES = 16384;
+
+/// Number of particles from which a group is re-linked by the whole team rather than inside a task.
+const size_t TEAM_PARTICLES = 262144;
+
+/// Parameters shared by the whole recursion.
+struct rung_settings {
+    double linking_length;  ///< Linking length of the top-level groups.
+    double ratio;           ///< Factor applied to the linking length at each rung.
+    size_t nlevels;         ///< Number of rungs below the top level.
+    size_t min_members;     ///< Smallest subgroup that is kept.
+};
+
+/**
+ * @brief Append the nodes of `src` to `dst`, attaching the root of `src` to `parent_of_root`.
+ */
+void append_hierarchy(group_hierarchy &dst, const group_hierarchy &src, std::int64_t parent_of_root) {
+    const std::int64_t base = static_cast<std::int64_t>(dst.size());
+    if (dst.offsets.empty()) {
+        dst.offsets.push_back(0);
+    }
+    for (size_t n = 0; n < src.size(); ++n) {
+        dst.parent.push_back(src.parent[n] < 0 ? parent_of_root : src.parent[n] + base);
+        dst.level.push_back(src.level[n]);
+        dst.members.insert(dst.members.end(), src.members.begin() + src.offsets[n],
+                           src.members.begin() + src.offsets[n + 1]);
+        dst.offsets.push_back(dst.members.size());
+    }
+}
+
+group_hierarchy link_subtree(const std::vector<double> &xyz, const std::vector<size_t> &ids, size_t level,
+                             const rung_settings &rs, bool team);
+
+/**
+ * @brief Gather the members of subgroup s of `sub` and build its subtree.
+ */
+group_hierarchy link_child(const std::vector<double> &xyz, const std::vector<size_t> &ids, const group_catalog &sub,
+                           size_t s, size_t level, const rung_settings &rs, bool team) {
+    const size_t n = sub.size(s);
+    std::vector<double> child_xyz(3 * n);
+    std::vector<size_t> child_ids(n);
+    for (size_t k = 0; k < n; ++k) {
+        const size_t j = sub.members[sub.offsets[s] + k];
+        for (size_t d = 0; d < 3; ++d) child_xyz[k * 3 + d] = xyz[j * 3 + d];
+        child_ids[k] = ids[j];
+    }
+    return link_subtree(child_xyz, child_ids, level, rs, team);
+}
+
+/**
+ * @brief Build the subtrees of the kept subgroups below `max_size` particles as tasks of the current team.
+ *
+ * Subgroups of at least TASK_PARTICLES get a task each, smaller ones are batched up to that size.
+ */
+void link_children_as_tasks(const std::vector<double> &xyz, const std::vector<size_t> &ids, const group_catalog &sub,
+                            const std::vector<size_t> &kept, size_t level, const rung_settings &rs, size_t max_size,
+                            std::vector<group_hierarchy> &children) {
+    size_t c = 0;
+    while (c < kept.size()) {
+        if (sub.size(kept[c]) >= max_size) {
+            ++c;
+            continue;
+        }
+        const size_t first = c;
+        size_t count = 0;
+        do {
+            count += sub.size(kept[c]);
+            ++c;
+        } while (c < kept.size() && count < TASK_PARTICLES && sub.size(kept[c]) < TASK_PARTICLES);
+
+        #pragma omp task default(none) shared(children, xyz, ids, sub, kept, rs) firstprivate(first, c, level)
+        for (size_t k = first; k < c; ++k) {
+            children[k] = link_child(xyz, ids, sub, kept[k], level + 1, rs, false);
+        }
+    }
+    #pragma omp taskwait
+}
+
+/**
+ * @brief Emit the node made of `ids` and, below the last rung, re-link it and recurse into its subgroups.
+ *
+ * @param xyz Unwrapped coordinates of the node members, interleaved.
+ * @param ids Particle indices of the node members.
+ * @param level Rung of the node.
+ * @param rs Recursion parameters.
+ * @param team Whether the call is outside any parallel region, so that the index and the linking of the
+ *             node use the whole team; otherwise it runs inside a task and only spawns further tasks.
+ * @return group_hierarchy The node followed by its subtree, with the node's parent set to -1.
+ */
+group_hierarchy link_subtree(const std::vector<double> &xyz, const std::vector<size_t> &ids, size_t level,
+                             const rung_settings &rs, bool team) {
+    group_hierarchy out;
+    out.offsets.push_back(0);
+    out.parent.push_back(-1);
+    out.level.push_back(level);
+    out.members = ids;
+    out.offsets.push_back(ids.size());
+
+    if (level >= rs.nlevels || ids.size() < rs.min_members) {
+        return out;
+    }
+
+    // Small local index over the contiguous members, linked at the next rung
+    const kd_tree<3> tree(xyz.data(), ids.size(), 0.);
+    const group_catalog sub = friends_of_friends_kdtree(tree, rs.linking_length * std::pow(rs.ratio, level + 1));
+
+    std::vector<size_t> kept;
+    for (size_t s = 0; s < sub.ngroups(); ++s) {
+        if (sub.size(s) >= rs.min_members) kept.push_back(s);
+    }
+
+    std::vector<group_hierarchy> children(kept.size());
+    if (team) {
+        // Subgroups still large enough keep the whole team, the others are shared out as tasks
+        for (size_t c = 0; c < kept.size(); ++c) {
+            if (sub.size(kept[c]) >= TEAM_PARTICLES) {
+                children[c] = link_child(xyz, ids, sub, kept[c], level + 1, rs, true);
+            }
+        }
+        #pragma omp parallel default(none) shared(children, xyz, ids, sub, kept, rs, level)
+        #pragma omp single
+        link_children_as_tasks(xyz, ids, sub, kept, level, rs, TEAM_PARTICLES, children);
+    } else {
+        link_children_as_tasks(xyz, ids, sub, kept, level, rs, SIZE_MAX, children);
+    }
+
+    for (auto const &child : children) {
+        append_hierarchy(out, child, 0);
+    }
+    return out;
+}
+
+/**
+ * @brief Gather top-level group g (unwrapped around its first member) and build its subtree.
+ */
+group_hierarchy link_group(const group_catalog &catalog, size_t g, const double *pos, double boxsize,
+                           const rung_settings &rs, bool team) {
+    const size_t begin = catalog.offsets[g], n = catalog.size(g);
+    std::vector<double> xyz(3 * n);
+    std::vector<size_t> ids(catalog.members.begin() + begin, catalog.members.begin() + begin + n);
+    if (n > 0) {
+        const double *xref = pos + ids[0] * 3;
+        for (size_t k = 0; k < n; ++k) {
+            for (size_t d = 0; d < 3; ++d) xyz[k * 3 + d] = periodic_delta(pos[ids[k] * 3 + d] - xref[d], boxsize);
+        }
+    }
+    return link_subtree(xyz, ids, 0, rs, team);
+}
+
+} // End of anonymous namespace
+
+// Task-parallel recursive sub-FoF over every top-level group
+group_hierarchy find_subgroups(const group_catalog &catalog, const double *pos, double boxsize, double linking_length,
+                               double ratio, size_t nlevels, size_t min_members) {
+    const size_t ngroups = catalog.ngroups();
+    const rung_settings rs = {linking_length, ratio, nlevels, min_members};
+    std::vector<group_hierarchy> trees(ngroups);
+
+    // The largest groups are re-linked one after the other by the whole team: inside a task the
+    // parallel loops of their index and linking would be nested, and so serial
+    for (size_t g = 0; g < ngroups; ++g) {
+        if (catalog.size(g) >= TEAM_PARTICLES) {
+            trees[g] = link_group(catalog, g, pos, boxsize, rs, true);
+        }
+    }
+
+    #pragma omp parallel
+    #pragma omp single
+    {
+        size_t g = 0;
+        while (g < ngroups) {
+            if (catalog.size(g) >= TEAM_PARTICLES) {
+                ++g;
+                continue;
+            }
+            // A large group is a task on its own; small ones are batched up to TASK_PARTICLES members
+            const size_t first = g;
+            size_t count = 0;
+            do {
+                count += catalog.size(g);
+                ++g;
+            } while (g < ngroups && count < TASK_PARTICLES && catalog.size(g) < TASK_PARTICLES);
+
+            #pragma omp task default(none) shared(trees, catalog, pos, boxsize, rs) firstprivate(first, g)
+            for (size_t h = first; h < g; ++h) {
+                trees[h] = link_group(catalog, h, pos, boxsize, rs, false);
+            }
+        }
+    }
+
+    group_hierarchy out;
+    out.offsets.push_back(0);
+    for (auto const &tree : trees) {
+        append_hierarchy(out, tree, -1);
+    }
+    return out;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "groups.hpp"
+
+/**
+ * @brief Hierarchy of FoF groups and the subgroups found inside them at shorter linking lengths.
+ *
+ * Nodes are stored depth first: each top-level group is followed by its whole subtree. Node n has
+ * members `members[offsets[n]]` to `members[offsets[n + 1] - 1]`, was linked with the linking length
+ * of rung `level[n]`, and `parent[n]` is the index of the enclosing node, or -1 for the top-level groups.
+ */
+struct group_hierarchy {
+    std::vector<std::size_t> offsets;   ///< Start of each node in `members`, with a trailing sentinel.
+    std::vector<std::size_t> members;   ///< Particle indices of every node.
+    std::vector<std::int64_t> parent;   ///< Enclosing node, -1 for top-level groups.
+    std::vector<std::size_t> level;     ///< Rung of the node, 0 for the input groups.
+
+    /// Number of nodes in the hierarchy.
+    std::size_t size() const { return parent.size(); }
+};
+
+/**
+ * @brief Recursively re-link every FoF group at successively shorter linking lengths.
+ *
+ * The members of each group are gathered (unwrapped around the first member in a periodic box) into a
+ * contiguous buffer, a small kd-tree is built over them and FoF is run with the linking length of the
+ * next rung, `linking_length * ratio^level`. Subgroups with at least `min_members` particles are kept
+ * and processed in turn until `nlevels` rungs below the input groups have been linked.
+ *
+ * The largest groups, and their largest subgroups, are re-linked one at a time by the whole OpenMP
+ * team, whose parallel index build and linking loop would be serial inside a task. Everything else is
+ * scheduled as tasks: small groups are batched so that each task carries a comparable number of
+ * particles, while large groups get a task of their own and spawn further tasks for their large
+ * subgroups, so no single cluster serialises the pass.
+ *
+ * @param catalog CSR catalog of the top-level groups.
+ * @param pos Pointer to the particle positions, three contiguous values per particle.
+ * @param boxsize Side of the periodic box; non-positive values disable periodic unwrapping.
+ * @param linking_length Linking length used for the top-level groups.
+ * @param ratio Factor applied to the linking length at each rung (e.g. 0.5 for b/2, b/4, ...).
+ * @param nlevels Number of rungs to link below the top-level groups.
+ * @param min_members Smallest subgroup that is kept and recursed into.
+ * @return group_hierarchy The groups and all their subgroups, with parent links.
+ */
+group_hierarchy find_subgroups(const group_catalog &catalog, const double *pos, double boxsize, double linking_length,
+                               double ratio, std::size_t nlevels, std::size_t min_members);
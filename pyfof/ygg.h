@@ -0,0 +1,233 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file ygg.h
+ * @brief C interface of the YGGDRASIL engines (libygg).
+ *
+ * Every friends-of-friends engine is reached through these functions, so the command-line driver,
+ * the Python module and any other front end run the same code. Build the shared library from the
+ * repository root with
+ *
+ *   g++ -O3 -std=c++17 -fopenmp -fPIC -shared -fvisibility=hidden pyfof/ygg_c.cc pyfof/engine_select.cc \
+ *       pyfof/fof.cc pyfof/fof_brute.cc pyfof/fof_grid.cc pyfof/groups.cc pyfof/attach.cc -o libygg.so
+ *
+ * Functions return a `ygg_status`; on failure `ygg_last_error` describes the error of the calling
+ * thread and no object is returned. Objects are opaque and released with their `_destroy` function.
+ * Later versions of the interface only add functions and never change the existing structs, so a
+ * program built against an older header keeps working; `ygg_abi_version` reports the version the
+ * library implements.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_WIN32)
+#define YGG_API __declspec(dllexport)
+#else
+#define YGG_API __attribute__((visibility("default")))
+#endif
+
+/// Version of the interface declared in this header.
+#define YGG_ABI_VERSION 5
+
+/// Result of every call of the interface.
+typedef enum ygg_status {
+    YGG_OK = 0,                    ///< Success.
+    YGG_INVALID_ARGUMENT = 1,      ///< Bad argument, e.g. an unknown engine or an unsupported dimension.
+    YGG_OUT_OF_MEMORY = 2,         ///< An allocation failed.
+    YGG_INTERNAL_ERROR = 3         ///< Any other failure.
+} ygg_status;
+
+/// Points indexed once and clustered with any number of linking lengths.
+typedef struct ygg_index ygg_index;
+
+/// Groups and statistics of one friends-of-friends run.
+typedef struct ygg_result ygg_result;
+
+/// Engine settings of a run; start from `ygg_options_init`.
+typedef struct ygg_options {
+    const char *engine;        ///< "auto", "grid", "kdtree", "rtree" or "brute"; NULL means "rtree".
+    size_t leaf_size;          ///< Points per kd-tree leaf; 0 keeps the default, or the calibrated size with "auto".
+    unsigned quantize_bits;    ///< Significant bits per fixed-point coordinate of the grid engine; 0 means 32.
+    int profile;               ///< Nonzero to count hardware events in every phase.
+} ygg_options;
+
+/// Hardware events of one phase, -1 when the counter could not be read.
+typedef struct ygg_hw_counters {
+    int64_t cycles;
+    int64_t instructions;
+    int64_t l1d_misses;
+    int64_t llc_misses;
+    int64_t branch_misses;
+} ygg_hw_counters;
+
+/// Wall time and memory of one phase of a run.
+typedef struct ygg_phase {
+    const char *name;          ///< Name of the phase, owned by the result.
+    uint64_t wall_ns;          ///< Wall-clock time of the phase, in nanoseconds.
+    uint64_t peak_rss_kb;      ///< Peak resident set size of the process at the end of the phase, in KiB.
+    ygg_hw_counters hw;        ///< Hardware events, all -1 unless profiling.
+} ygg_phase;
+
+/// Work counters of a run, as in `fof_stats`.
+typedef struct ygg_stats {
+    uint64_t npts;
+    uint64_t points_visited;
+    uint64_t pairs_tested;
+    uint64_t pairs_linked;
+    uint64_t nodes_touched;
+    uint64_t allocations;
+    double resolution_error;
+    size_t nphases;            ///< Number of phases, read with `ygg_result_phase`.
+    const char *engine;        ///< Engine that ran, owned by the result.
+    size_t leaf_size;          ///< Leaf size of the kd-tree engine.
+} ygg_stats;
+
+/// Version of the interface implemented by the library, `YGG_ABI_VERSION` at its build.
+YGG_API int ygg_abi_version(void);
+
+/// Message of the last failed call on this thread, empty if there was none.
+YGG_API const char *ygg_last_error(void);
+
+/// Fill `options` with the defaults: the R-tree engine, default leaf size and 32 bits, no profiling.
+YGG_API void ygg_options_init(ygg_options *options);
+
+/**
+ * @brief Index a set of points.
+ *
+ * The coordinates are borrowed, not copied: they must stay valid and unchanged until the index is
+ * destroyed. The kd-tree of the "kdtree" engine is built on the first run that needs it and reused
+ * by the later ones; the other engines index the points on every run.
+ *
+ * @param data Coordinates, `ndim` contiguous values per point; may be NULL when `npts` is 0.
+ * @param npts Number of points.
+ * @param ndim Dimensionality of the points.
+ * @param boxsize Side of the periodic box; non-positive values disable periodic boundaries.
+ * @param options Engine settings, NULL for the defaults; copied.
+ * @param out Receives the index.
+ */
+YGG_API ygg_status ygg_index_create(const double *data, size_t npts, size_t ndim, double boxsize,
+                                    const ygg_options *options, ygg_index **out);
+
+/**
+ * @brief Reopen an index saved by `ygg_index_save`, mapping its kd-tree from the file.
+ *
+ * The file is mapped read-only, so opening takes milliseconds whatever its size and every process
+ * opening it on a node shares the same pages. It must have been saved from `npts` points of dimension
+ * `ndim` in a box of side `boxsize`, with the same `checksum`, or YGG_INVALID_ARGUMENT is returned.
+ * The kd-tree holds its own reordered copy of the coordinates, so `data` may be NULL when only the
+ * "kdtree" engine (or "auto", which then picks it) is run.
+ *
+ * @param path File written by `ygg_index_save`.
+ * @param data Coordinates as for `ygg_index_create`, or NULL.
+ * @param checksum Identifier of the data given when the file was saved.
+ * @param options Engine settings, NULL for the defaults; the leaf size is the one of the file.
+ */
+YGG_API ygg_status ygg_index_open(const char *path, const double *data, size_t npts, size_t ndim, double boxsize,
+                                  uint64_t checksum, const ygg_options *options, ygg_index **out);
+
+/**
+ * @brief Save the kd-tree of an index, building it first if no run needed it yet.
+ *
+ * The file is replaced atomically. `checksum` should identify the coordinates, e.g. `ygg_checksum` of
+ * the snapshot header, and must be given again to `ygg_index_open`.
+ */
+YGG_API ygg_status ygg_index_save(ygg_index *index, const char *path, uint64_t checksum);
+
+/// 64-bit hash of a buffer, for the checksums of `ygg_index_save`.
+YGG_API uint64_t ygg_checksum(const void *data, size_t bytes);
+
+/// Release an index; NULL is ignored.
+YGG_API void ygg_index_destroy(ygg_index *index);
+
+/**
+ * @brief Friends-of-friends groups of the indexed points.
+ *
+ * Different threads may run the same index at once. With "auto", the engine and leaf size are
+ * selected for every linking length; a kd-tree already built is reused whatever its leaf size.
+ *
+ * @param index The points.
+ * @param linking_length Maximum distance between points to be considered part of the same cluster.
+ * @param stats Nonzero to time the phases and count the work; the result is otherwise only groups.
+ * @param out Receives the result.
+ */
+YGG_API ygg_status ygg_index_fof(ygg_index *index, double linking_length, int stats, ygg_result **out);
+
+/**
+ * @brief `ygg_index_fof` with the kd-tree engine, saving its progress to a checkpoint file.
+ *
+ * The groups completed since the last checkpoint are appended to `checkpoint` every `interval`
+ * seconds by a background thread. If the file already holds a checkpoint of the same tree and
+ * linking length, e.g. of a run that was killed, its groups are restored and the run continues after
+ * them; a file of another run is replaced. The file is left complete at the end and may be removed
+ * once the result is stored. The engine of the index must be "kdtree" or "auto".
+ *
+ * @param checkpoint Checkpoint file.
+ * @param interval Seconds between two checkpoints.
+ */
+YGG_API ygg_status ygg_index_fof_checkpointed(ygg_index *index, double linking_length, int stats,
+                                              const char *checkpoint, double interval, ygg_result **out);
+
+/**
+ * @brief Assign other particles to the group of their nearest indexed point.
+ *
+ * This attaches the gas, stars and black holes of a snapshot to the groups found on its dark matter
+ * (see `attach_to_nearest`). The kd-tree of the index is built first if no run needed it yet, whatever
+ * the engine of the index. The points must be three-dimensional.
+ *
+ * @param index The points the groups were found on.
+ * @param result Groups of a run of `index`.
+ * @param pos Positions of the particles to attach, three contiguous values each, in the box of the index.
+ * @param npts Number of particles to attach.
+ * @param max_distance Particles farther than this from every indexed point are left unassigned;
+ *                     non-positive values disable the limit.
+ * @param labels Receives the group of every particle (`npts` values), -1 when unassigned.
+ */
+YGG_API ygg_status ygg_index_attach(ygg_index *index, const ygg_result *result, const double *pos, size_t npts,
+                                    double max_distance, int64_t *labels);
+
+/// One-shot run: `ygg_index_create`, `ygg_index_fof` with statistics, then `ygg_index_destroy`.
+YGG_API ygg_status ygg_fof(const double *data, size_t npts, size_t ndim, double linking_length, double boxsize,
+                           const ygg_options *options, ygg_result **out);
+
+/// Release a result; NULL is ignored.
+YGG_API void ygg_result_destroy(ygg_result *result);
+
+/// Number of groups.
+YGG_API size_t ygg_result_ngroups(const ygg_result *result);
+
+/// Number of clustered points, the length of the labels.
+YGG_API size_t ygg_result_npts(const ygg_result *result);
+
+/// Start of every group in the members, with a trailing sentinel (ngroups + 1 values).
+YGG_API const size_t *ygg_result_offsets(const ygg_result *result);
+
+/// Point indices, grouped contiguously (npts values).
+YGG_API const size_t *ygg_result_members(const ygg_result *result);
+
+/// Group index of every point (npts values).
+YGG_API const int64_t *ygg_result_labels(const ygg_result *result);
+
+/// Counters of the run; zero unless statistics were requested.
+YGG_API void ygg_result_stats(const ygg_result *result, ygg_stats *stats);
+
+/// Phase `i` of the run, in the order the phases ran.
+YGG_API ygg_status ygg_result_phase(const ygg_result *result, size_t i, ygg_phase *phase);
+
+/// Bytes phase `i` reads and writes in its main arrays, 0 when not counted; over `wall_ns` this is its bandwidth.
+YGG_API uint64_t ygg_result_phase_bytes(const ygg_result *result, size_t i);
+
+/**
+ * @brief Back the large arrays allocated from now on by transparent huge pages, or stop doing so.
+ *
+ * The default comes from the `YGG_HUGE_PAGES` environment variable. Thread placement follows the
+ * OpenMP binding (`OMP_PLACES`, `OMP_PROC_BIND`), and the arrays are first touched by their owners.
+ */
+YGG_API void ygg_set_huge_pages(int enable);
+
+#ifdef __cplusplus
+}
+#endif
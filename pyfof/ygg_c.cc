@@ -0,0 +1,405 @@
+#include "ygg.h"
+#include "attach.hpp"
+#include "engine_select.hpp"
+#include "fof_checkpoint.hpp"
+#include "fof_kdtree.hpp"
+#include "kdtree_io.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+// Typedef for convenience
+typedef std::size_t size_t;
+
+namespace {
+
+/// Message of the last failed call of each thread.
+thread_local std::string last_error;
+
+/// Groups of the particles nearest to `pos`; only three-dimensional trees support it.
+template <size_t D>
+std::vector<std::int64_t> attach_to_tree(const kd_tree<D> &, const first_touch_vector<std::int64_t> &,
+                                         const double *, size_t, double) {
+    throw std::invalid_argument("attaching particles needs three-dimensional points");
+}
+
+std::vector<std::int64_t> attach_to_tree(const kd_tree3 &tree, const first_touch_vector<std::int64_t> &labels,
+                                         const double *pos, size_t npts, double max_distance) {
+    return attach_to_nearest(tree, labels, pos, npts, max_distance);
+}
+
+/// A kd-tree of any supported dimension.
+struct kd_tree_base {
+    virtual ~kd_tree_base() {}
+    virtual group_catalog friends_of_friends(double linking_length, fof_stats *stats) const = 0;
+    virtual group_catalog friends_of_friends(double linking_length, const checkpoint_config &checkpoint,
+                                             fof_stats *stats) const = 0;
+    virtual std::vector<std::int64_t> attach(const first_touch_vector<std::int64_t> &labels, const double *pos,
+                                             size_t npts, double max_distance) const = 0;
+    virtual void save(const std::string &path, std::uint64_t checksum) const = 0;
+    virtual size_t leaf_size() const = 0;
+};
+
+template <size_t D>
+struct kd_tree_model : kd_tree_base {
+    kd_tree_model(const double *data, size_t npts, double boxsize, size_t leaf_size, fof_stats *stats)
+        : tree(data, npts, boxsize, leaf_size, stats) {}
+
+    explicit kd_tree_model(kd_tree<D> &&tree) : tree(std::move(tree)) {}
+
+    group_catalog friends_of_friends(double linking_length, fof_stats *stats) const override {
+        return friends_of_friends_kdtree(tree, linking_length, stats);
+    }
+
+    group_catalog friends_of_friends(double linking_length, const checkpoint_config &checkpoint,
+                                     fof_stats *stats) const override {
+        return friends_of_friends_kdtree_checkpointed(tree, linking_length, checkpoint, stats);
+    }
+
+    std::vector<std::int64_t> attach(const first_touch_vector<std::int64_t> &labels, const double *pos, size_t npts,
+                                     double max_distance) const override {
+        return attach_to_tree(tree, labels, pos, npts, max_distance);
+    }
+
+    void save(const std::string &path, std::uint64_t checksum) const override {
+        save_kd_tree(tree, path, checksum);
+    }
+
+    size_t leaf_size() const override {
+        return tree.leaf_size();
+    }
+
+    kd_tree<D> tree;
+};
+
+std::unique_ptr<kd_tree_base> make_kd_tree(const double *data, size_t npts, size_t ndim, double boxsize,
+                                           size_t leaf_size, fof_stats *stats) {
+    switch (ndim) {
+        case 1: return std::unique_ptr<kd_tree_base>(new kd_tree_model<1>(data, npts, boxsize, leaf_size, stats));
+        case 2: return std::unique_ptr<kd_tree_base>(new kd_tree_model<2>(data, npts, boxsize, leaf_size, stats));
+        case 3: return std::unique_ptr<kd_tree_base>(new kd_tree_model<3>(data, npts, boxsize, leaf_size, stats));
+        case 4: return std::unique_ptr<kd_tree_base>(new kd_tree_model<4>(data, npts, boxsize, leaf_size, stats));
+        case 5: return std::unique_ptr<kd_tree_base>(new kd_tree_model<5>(data, npts, boxsize, leaf_size, stats));
+        case 6: return std::unique_ptr<kd_tree_base>(new kd_tree_model<6>(data, npts, boxsize, leaf_size, stats));
+        default: throw std::invalid_argument("the kd-tree engine supports 1 to 6 dimensions");
+    }
+}
+
+template <size_t D>
+std::unique_ptr<kd_tree_base> open_kd_tree_model(const std::string &path, const kd_tree_source &expected) {
+    return std::unique_ptr<kd_tree_base>(new kd_tree_model<D>(open_kd_tree<D>(path, expected)));
+}
+
+std::unique_ptr<kd_tree_base> open_any_kd_tree(const std::string &path, size_t ndim, const kd_tree_source &expected) {
+    switch (ndim) {
+        case 1: return open_kd_tree_model<1>(path, expected);
+        case 2: return open_kd_tree_model<2>(path, expected);
+        case 3: return open_kd_tree_model<3>(path, expected);
+        case 4: return open_kd_tree_model<4>(path, expected);
+        case 5: return open_kd_tree_model<5>(path, expected);
+        case 6: return open_kd_tree_model<6>(path, expected);
+        default: throw std::invalid_argument("the kd-tree engine supports 1 to 6 dimensions");
+    }
+}
+
+bool known_engine(const std::string &engine) {
+    return engine == "auto" || engine == "grid" || engine == "kdtree" || engine == "rtree" || engine == "brute";
+}
+
+/// Run `body`, turning the exceptions it throws into a status and the message of this thread.
+template <typename F>
+ygg_status guarded(F &&body) {
+    try {
+        body();
+        last_error.clear();
+        return YGG_OK;
+    } catch (const std::invalid_argument &e) {
+        last_error = e.what();
+        return YGG_INVALID_ARGUMENT;
+    } catch (const std::bad_alloc &e) {
+        last_error = "out of memory";
+        return YGG_OUT_OF_MEMORY;
+    } catch (const std::exception &e) {
+        last_error = e.what();
+        return YGG_INTERNAL_ERROR;
+    } catch (...) {
+        last_error = "unknown error";
+        return YGG_INTERNAL_ERROR;
+    }
+}
+
+} // End of anonymous namespace
+
+struct ygg_index {
+    const double *data;
+    size_t npts;
+    size_t ndim;
+    double boxsize;
+    engine_config config;                  ///< Requested engine, "auto" until a run resolves it.
+    bool profile;
+    std::once_flag tree_once;              ///< Guards the construction of `tree`.
+    std::unique_ptr<kd_tree_base> tree;    ///< Built by the first kd-tree run.
+};
+
+struct ygg_result {
+    group_catalog catalog;
+    fof_stats stats;
+    engine_config config;                  ///< Engine that ran.
+};
+
+namespace {
+
+/// Index over the points with the given options, after checking them.
+std::unique_ptr<ygg_index> new_index(const double *data, size_t npts, size_t ndim, double boxsize,
+                                     const ygg_options *options) {
+    ygg_options opt;
+    ygg_options_init(&opt);
+    if (options) opt = *options;
+    if (!opt.engine) opt.engine = "rtree";
+    if (!known_engine(opt.engine)) throw std::invalid_argument(std::string("unknown engine ") + opt.engine);
+    if (ndim == 0) throw std::invalid_argument("the points need at least one dimension");
+
+    std::unique_ptr<ygg_index> index(new ygg_index());
+    index->data = data;
+    index->npts = npts;
+    index->ndim = ndim;
+    index->boxsize = boxsize;
+    index->config.engine = opt.engine;
+    index->config.leaf_size = opt.leaf_size;
+    index->config.bits = opt.quantize_bits > 0 ? opt.quantize_bits : 32;
+    index->profile = opt.profile != 0;
+    return index;
+}
+
+/// The kd-tree of an index, built with the requested leaf size if no run needed it yet.
+const kd_tree_base &index_kd_tree(ygg_index *index) {
+    std::call_once(index->tree_once, [&] {
+        if (!index->data && index->npts > 0) throw std::invalid_argument("the index has no coordinates");
+        const size_t leaf_size = index->config.leaf_size > 0 ? index->config.leaf_size : 16;
+        index->tree = make_kd_tree(index->data, index->npts, index->ndim, index->boxsize, leaf_size, nullptr);
+    });
+    return *index->tree;
+}
+
+/// Friends-of-friends run of `ygg_index_fof`, saving its progress if `checkpoint` is given.
+void run_fof(ygg_index *index, double linking_length, int stats, const checkpoint_config *checkpoint,
+             ygg_result **out) {
+    if (!out) throw std::invalid_argument("no output given");
+    *out = nullptr;
+    if (!index) throw std::invalid_argument("no index given");
+
+    std::unique_ptr<ygg_result> result(new ygg_result());
+    fof_stats *stats_ptr = stats ? &result->stats : nullptr;
+    result->stats.profile = index->profile;
+
+    // Resolve the engine and leaf size of this run
+    engine_config &config = result->config;
+    config = index->config;
+    const bool coordinates = index->data || index->npts == 0;
+    if (config.engine == "auto" && (!coordinates || checkpoint)) {
+        config.engine = "kdtree";  // An opened index without coordinates only has its tree
+    } else if (config.engine == "auto") {
+        const engine_config selected = select_engine(
+            sample_data_shape(index->data, index->npts, index->ndim, linking_length, index->boxsize));
+        config.engine = selected.engine;
+        if (config.leaf_size == 0) config.leaf_size = selected.leaf_size;
+    }
+    if (config.leaf_size == 0) config.leaf_size = 16;
+    if (checkpoint && config.engine != "kdtree") {
+        throw std::invalid_argument("checkpoints need the kdtree engine");
+    }
+
+    if (index->npts == 0) {
+        result->catalog.offsets.assign(1, 0);
+    } else if (config.engine == "kdtree") {
+        // An opened index has its tree already, so no coordinates are needed
+        std::call_once(index->tree_once, [&] {
+            index->tree = make_kd_tree(index->data, index->npts, index->ndim, index->boxsize, config.leaf_size,
+                                       stats_ptr);
+        });
+        result->catalog = checkpoint ? index->tree->friends_of_friends(linking_length, *checkpoint, stats_ptr)
+                                     : index->tree->friends_of_friends(linking_length, stats_ptr);
+    } else {
+        if (!coordinates) throw std::invalid_argument("the " + config.engine + " engine needs the coordinates");
+        // The engines read the coordinates without modifying them
+        result->catalog = friends_of_friends_engine(config, const_cast<double *>(index->data), index->npts,
+                                                    index->ndim, linking_length, index->boxsize, stats_ptr);
+    }
+    *out = result.release();
+}
+
+} // End of anonymous namespace
+
+extern "C" {
+
+int ygg_abi_version(void) {
+    return YGG_ABI_VERSION;
+}
+
+const char *ygg_last_error(void) {
+    return last_error.c_str();
+}
+
+void ygg_options_init(ygg_options *options) {
+    options->engine = "rtree";
+    options->leaf_size = 0;
+    options->quantize_bits = 0;
+    options->profile = 0;
+}
+
+ygg_status ygg_index_create(const double *data, size_t npts, size_t ndim, double boxsize, const ygg_options *options,
+                            ygg_index **out) {
+    return guarded([&] {
+        if (!out) throw std::invalid_argument("no output given");
+        *out = nullptr;
+        if (npts > 0 && !data) throw std::invalid_argument("no coordinates given");
+        *out = new_index(data, npts, ndim, boxsize, options).release();
+    });
+}
+
+ygg_status ygg_index_open(const char *path, const double *data, size_t npts, size_t ndim, double boxsize,
+                          uint64_t checksum, const ygg_options *options, ygg_index **out) {
+    return guarded([&] {
+        if (!out) throw std::invalid_argument("no output given");
+        *out = nullptr;
+        if (!path) throw std::invalid_argument("no path given");
+        std::unique_ptr<ygg_index> index = new_index(data, npts, ndim, boxsize, options);
+        const kd_tree_source expected = {npts, boxsize, checksum};
+        std::unique_ptr<kd_tree_base> tree = open_any_kd_tree(path, ndim, expected);
+        index->config.leaf_size = tree->leaf_size();
+        std::call_once(index->tree_once, [&] { index->tree = std::move(tree); });
+        *out = index.release();
+    });
+}
+
+ygg_status ygg_index_save(ygg_index *index, const char *path, uint64_t checksum) {
+    return guarded([&] {
+        if (!index) throw std::invalid_argument("no index given");
+        if (!path) throw std::invalid_argument("no path given");
+        index_kd_tree(index).save(path, checksum);
+    });
+}
+
+ygg_status ygg_index_attach(ygg_index *index, const ygg_result *result, const double *pos, size_t npts,
+                            double max_distance, int64_t *labels) {
+    return guarded([&] {
+        if (!index) throw std::invalid_argument("no index given");
+        if (!result) throw std::invalid_argument("no result given");
+        if (npts > 0 && (!pos || !labels)) throw std::invalid_argument("no positions or labels given");
+        if (index->ndim != 3) throw std::invalid_argument("attaching particles needs three-dimensional points");
+        if (result->catalog.labels.size() != index->npts) {
+            throw std::invalid_argument("the result does not come from this index");
+        }
+        if (npts == 0) return;
+        if (index->npts == 0) {
+            std::fill(labels, labels + npts, -1);
+            return;
+        }
+        const std::vector<std::int64_t> attached =
+            index_kd_tree(index).attach(result->catalog.labels, pos, npts, max_distance);
+        std::copy(attached.begin(), attached.end(), labels);
+    });
+}
+
+uint64_t ygg_checksum(const void *data, size_t bytes) {
+    return hash_bytes(data, bytes);
+}
+
+void ygg_index_destroy(ygg_index *index) {
+    delete index;
+}
+
+ygg_status ygg_index_fof(ygg_index *index, double linking_length, int stats, ygg_result **out) {
+    return guarded([&] { run_fof(index, linking_length, stats, nullptr, out); });
+}
+
+ygg_status ygg_index_fof_checkpointed(ygg_index *index, double linking_length, int stats, const char *checkpoint,
+                                      double interval, ygg_result **out) {
+    return guarded([&] {
+        if (!checkpoint || !*checkpoint) throw std::invalid_argument("no checkpoint file given");
+        checkpoint_config config;
+        config.path = checkpoint;
+        config.interval = interval;
+        run_fof(index, linking_length, stats, &config, out);
+    });
+}
+
+ygg_status ygg_fof(const double *data, size_t npts, size_t ndim, double linking_length, double boxsize,
+                   const ygg_options *options, ygg_result **out) {
+    ygg_index *index = nullptr;
+    ygg_status status = ygg_index_create(data, npts, ndim, boxsize, options, &index);
+    if (status == YGG_OK) {
+        status = ygg_index_fof(index, linking_length, 1, out);
+    } else if (out) {
+        *out = nullptr;
+    }
+    ygg_index_destroy(index);
+    return status;
+}
+
+void ygg_result_destroy(ygg_result *result) {
+    delete result;
+}
+
+size_t ygg_result_ngroups(const ygg_result *result) {
+    return result->catalog.ngroups();
+}
+
+size_t ygg_result_npts(const ygg_result *result) {
+    return result->catalog.labels.size();
+}
+
+const size_t *ygg_result_offsets(const ygg_result *result) {
+    return result->catalog.offsets.data();
+}
+
+const size_t *ygg_result_members(const ygg_result *result) {
+    return result->catalog.members.data();
+}
+
+const int64_t *ygg_result_labels(const ygg_result *result) {
+    return result->catalog.labels.data();
+}
+
+void ygg_result_stats(const ygg_result *result, ygg_stats *stats) {
+    const fof_stats &s = result->stats;
+    stats->npts = s.npts;
+    stats->points_visited = s.points_visited;
+    stats->pairs_tested = s.pairs_tested;
+    stats->pairs_linked = s.pairs_linked;
+    stats->nodes_touched = s.nodes_touched;
+    stats->allocations = s.allocations;
+    stats->resolution_error = s.resolution_error;
+    stats->nphases = s.phases.size();
+    stats->engine = result->config.engine.c_str();
+    stats->leaf_size = result->config.leaf_size;
+}
+
+ygg_status ygg_result_phase(const ygg_result *result, size_t i, ygg_phase *phase) {
+    return guarded([&] {
+        if (i >= result->stats.phases.size()) throw std::invalid_argument("no such phase");
+        const phase_stats &p = result->stats.phases[i];
+        phase->name = p.name.c_str();
+        phase->wall_ns = p.wall_ns;
+        phase->peak_rss_kb = p.peak_rss_kb;
+        phase->hw.cycles = p.hw.cycles;
+        phase->hw.instructions = p.hw.instructions;
+        phase->hw.l1d_misses = p.hw.l1d_misses;
+        phase->hw.llc_misses = p.hw.llc_misses;
+        phase->hw.branch_misses = p.hw.branch_misses;
+    });
+}
+
+uint64_t ygg_result_phase_bytes(const ygg_result *result, size_t i) {
+    return i < result->stats.phases.size() ? result->stats.phases[i].bytes : 0;
+}
+
+void ygg_set_huge_pages(int enable) {
+    set_huge_pages(enable != 0);
+}
+
+} // extern "C"
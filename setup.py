@@ -82,16 +82,18 @@ with io.open(os.path.join(this_directory, "README.md"), encoding="utf-8") as f:
 DEFINE_MACROS = []
 INCLUDE_DIRS = [np.get_include(), "/home/tcastro/include"]
 LIBRARY_DIRS = ["/home/tcastro/lib"]
-LIBRARIES = [
-    "boost_log_setup", "boost_log", "boost_thread", "boost_date_time",
-    "boost_system", "boost_filesystem", "pthread"
-]
-EXTRA_COMPILE_ARGS = ["-std=c++17", "-Wno-return-type", "-O3"]
-EXTRA_LINK_ARGS = ["-Wl,-rpath,/home/tcastro/lib"]
+LIBRARIES = ["pthread"]
+EXTRA_COMPILE_ARGS = ["-std=c++17", "-Wno-return-type", "-O3", "-fopenmp"]
+EXTRA_LINK_ARGS = ["-Wl,-rpath,/home/tcastro/lib", "-fopenmp"]
 
 extensions = [
     Extension("ygg",
-              sources=["pyfof/pyfof.pyx", "pyfof/fof.cc", "pyfof/fof_brute.cc"],
+              sources=["pyfof/pyfof.pyx", "pyfof/fof.cc", "pyfof/fof_brute.cc", "pyfof/fof_grid.cc",
+                       "pyfof/groups.cc", "pyfof/halo_properties.cc", "pyfof/spherical_overdensity.cc",
+                       "pyfof/potential.cc", "pyfof/subgroups.cc", "pyfof/attach.cc", "pyfof/phase_space.cc",
+                       "pyfof/merger_tree.cc", "pyfof/engine_select.cc", "pyfof/ygg_c.cc",
+                       "pyfof/group_stream.cc", "pyfof/fof_batch.cc",
+                       "pyfof/group_sizes.cc"],
               define_macros=DEFINE_MACROS,
               include_dirs=INCLUDE_DIRS,
               library_dirs=LIBRARY_DIRS,
@@ -117,6 +119,7 @@ setup(
     setup_requires=["numpy", "cython"],
     cmdclass={"build_ext": build_ext},
     ext_modules=extensions,
+    py_modules=["ygg_client"],
     long_description=long_description,
     long_description_content_type="text/markdown",
 )
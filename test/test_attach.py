@@ -0,0 +1,36 @@
+import numpy as np
+
+
+import ygg
+
+
+def test_attach_to_nearest_dark_matter():
+    rng = np.random.default_rng(12)
+    centres = np.array([[0.2, 0.2, 0.2], [0.7, 0.7, 0.7]])
+    dm = np.vstack([rng.normal(c, 0.01, (500, 3)) for c in centres])
+    gas = np.vstack([rng.normal(c, 0.01, (300, 3)) for c in centres])
+
+    index = ygg.SpatialIndex(dm, boxsize=1.0)
+    groups = index.friends_of_friends(0.01)
+    labels = index.attach(gas, groups)
+
+    dm_labels = np.full(len(dm), -1)
+    for i, g in enumerate(groups):
+        dm_labels[g] = i
+    nearest = np.argmin(((gas[:, None, :] - dm[None, :, :]) ** 2).sum(axis=-1), axis=1)
+    assert np.array_equal(labels, dm_labels[nearest])
+
+
+def test_periodic_and_max_distance():
+    dm = np.array([[0.01, 0.5, 0.5], [0.02, 0.5, 0.5], [0.5, 0.5, 0.5]])
+    index = ygg.SpatialIndex(dm, boxsize=1.0)
+    groups = [[0, 1], [2]]
+
+    gas = np.array([[0.995, 0.5, 0.5], [0.45, 0.5, 0.5], [0.28, 0.5, 0.5]])
+    assert list(index.attach(gas, groups)) == [0, 1, 1]
+    assert list(index.attach(gas, groups, max_distance=0.1)) == [0, 1, -1]
+
+
+def test_ungrouped_neighbour():
+    index = ygg.SpatialIndex([[0.0, 0.0, 0.0], [1.0, 0.0, 0.0]])
+    assert list(index.attach([[0.9, 0.0, 0.0]], [[0]])) == [-1]
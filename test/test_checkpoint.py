@@ -0,0 +1,63 @@
+import os
+
+import numpy as np
+import pytest
+
+
+import ygg
+
+
+@pytest.fixture
+def index():
+    rng = np.random.default_rng(50)
+    return ygg.SpatialIndex(rng.uniform(0.0, 1.0, (3000, 3)), boxsize=1.0)
+
+
+def run(index, b, path, interval=0.0):
+    return index.friends_of_friends(b, return_stats=True, checkpoint=path, checkpoint_interval=interval)
+
+
+def test_checkpointed_run_matches(index, tmp_path):
+    path = tmp_path / "run.ckpt"
+    b = 0.05
+    groups, stats = run(index, b, path)
+    assert groups == index.friends_of_friends(b)
+    assert stats["points_visited"] == len(index)
+
+    # A complete checkpoint is only restored
+    groups, stats = run(index, b, path)
+    assert groups == index.friends_of_friends(b)
+    assert stats["points_visited"] == 0
+
+
+@pytest.mark.parametrize("fraction", [0.1, 0.5, 0.9])
+def test_resume_after_torn_write(index, tmp_path, fraction):
+    path = tmp_path / "run.ckpt"
+    b = 0.05
+    run(index, b, path)
+    os.truncate(path, int(os.path.getsize(path) * fraction))
+
+    groups, stats = run(index, b, path)
+    assert groups == index.friends_of_friends(b)
+    assert 0 < stats["points_visited"] < len(index)
+
+
+def test_damaged_record_is_dropped(index, tmp_path):
+    path = tmp_path / "run.ckpt"
+    b = 0.05
+    run(index, b, path)
+    with open(path, "r+b") as f:
+        f.seek(os.path.getsize(path) // 2)
+        f.write(b"\xff" * 8)
+
+    groups, stats = run(index, b, path)
+    assert groups == index.friends_of_friends(b)
+    assert 0 < stats["points_visited"] < len(index)
+
+
+def test_checkpoint_of_another_run_is_replaced(index, tmp_path):
+    path = tmp_path / "run.ckpt"
+    run(index, 0.05, path, interval=60.0)
+    groups, stats = run(index, 0.04, path, interval=60.0)
+    assert groups == index.friends_of_friends(0.04)
+    assert stats["points_visited"] == len(index)
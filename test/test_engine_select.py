@@ -0,0 +1,68 @@
+import numpy as np
+import pytest
+
+
+import ygg
+
+
+def _partition(groups):
+    return sorted(map(sorted, groups))
+
+
+@pytest.mark.parametrize("ndim", [2, 3, 5])
+def test_auto_matches_rtree(ndim):
+    rng = np.random.default_rng(50 + ndim)
+    data = rng.uniform(0.0, 1.0, (3000, ndim))
+    b = 0.6 * len(data) ** (-1.0 / ndim)
+
+    groups, stats = ygg.friends_of_friends(data, b, boxsize=1.0, engine="auto", return_stats=True)
+    assert _partition(groups) == _partition(ygg.friends_of_friends(data, b, boxsize=1.0))
+    assert stats["engine"] in ("grid", "kdtree", "rtree", "brute")
+    assert stats["leaf_size"] > 0
+    assert stats["engine"] == ygg.select_engine(data, b, boxsize=1.0)["engine"]
+
+
+@pytest.mark.parametrize("engine", ["grid", "kdtree", "rtree", "brute"])
+def test_explicit_engines_agree(engine):
+    rng = np.random.default_rng(51)
+    data = rng.uniform(0.0, 1.0, (2000, 3))
+    groups, stats = ygg.friends_of_friends(data, 0.05, engine=engine, return_stats=True)
+    assert _partition(groups) == _partition(ygg.friends_of_friends(data, 0.05, use_brute=True))
+    assert stats["engine"] == engine
+
+
+def test_shape_sampling():
+    rng = np.random.default_rng(52)
+    data = rng.uniform(0.0, 2.0, (20000, 3))
+    # About 4/3 pi b^3 n neighbours for uniform points
+    b = 0.2
+    shape = ygg.select_engine(data, b)
+    assert shape["npts"] == len(data) and shape["ndim"] == 3
+    assert shape["extent"] == pytest.approx(2.0, rel=1e-2)
+    expected = 4.0 / 3.0 * np.pi * b ** 3 * len(data) / 8.0
+    assert shape["mean_neighbours"] == pytest.approx(expected, rel=0.15)
+
+    # Clustering is seen as more neighbours at the same mean density
+    blobs = np.concatenate([rng.normal(c, 0.05, (2000, 3)) for c in rng.uniform(0.0, 2.0, (10, 3))])
+    assert ygg.select_engine(blobs, b)["mean_neighbours"] > 10 * expected
+
+
+def test_engine_errors():
+    data = np.zeros((10, 3))
+    with pytest.raises(ValueError):
+        ygg.friends_of_friends(data, 0.1, engine="octree")
+    with pytest.raises(ValueError):
+        ygg.friends_of_friends(data, 0.1, engine="auto", use_brute=True)
+    with pytest.raises(ValueError):
+        ygg.friends_of_friends(np.zeros((10, 4)), 0.1, engine="grid")
+
+
+def test_table_of_other_thread_counts_is_not_used():
+    rng = np.random.default_rng(53)
+    data = rng.uniform(0.0, 1.0, (3000, 2))
+    b = 0.6 * len(data) ** (-1.0 / 2)
+    # The shipped table was measured on one thread, where the serial grid wins in 2-D
+    assert ygg.select_engine(data, b, boxsize=1.0, nthreads=1)["engine"] == "grid"
+    shape = ygg.select_engine(data, b, boxsize=1.0, nthreads=64)
+    assert shape["nthreads"] == 64
+    assert shape["engine"] == "kdtree"
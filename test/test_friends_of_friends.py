@@ -1,3 +1,7 @@
+import os
+import subprocess
+import sys
+
 import numpy as np
 import pytest
 
@@ -36,3 +40,21 @@ def test_use_brute_force_implementation():
 
 def test_no_points():
     assert ygg.friends_of_friends(np.empty((0, 2)), 1.0) == []
+
+
+PERCOLATING_SCRIPT = """
+import numpy as np
+import ygg
+data = np.random.default_rng(43).uniform(0.0, 1.0, (20000, 3))
+groups = ygg.friends_of_friends(data, 0.045, boxsize=1.0)
+reference = ygg.friends_of_friends(data, 0.045, boxsize=1.0, engine="kdtree")
+assert max(map(len, groups)) > len(data) // 2
+assert sorted(map(sorted, groups)) == sorted(map(sorted, reference))
+"""
+
+
+@pytest.mark.parametrize("threads", [1, 4])
+def test_percolating_group_with_threads(threads):
+    # The giant group is expanded by all threads one breadth-first level at a time
+    env = dict(os.environ, OMP_NUM_THREADS=str(threads))
+    subprocess.run([sys.executable, "-c", PERCOLATING_SCRIPT], env=env, check=True)
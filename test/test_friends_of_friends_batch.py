@@ -0,0 +1,68 @@
+import os
+import subprocess
+import sys
+
+import numpy as np
+import pytest
+
+
+import ygg
+
+
+def _set_groups(result, s):
+    offsets, members = result["offsets"], result["members"]
+    first, last = result["set_offsets"][s], result["set_offsets"][s + 1]
+    return [list(members[offsets[g]:offsets[g + 1]]) for g in range(first, last)]
+
+
+@pytest.fixture
+def sets():
+    rng = np.random.RandomState(3)
+    return [rng.uniform(0, 2, (n, 3)) for n in (40, 0, 500, 7, 1, 2000, 120)]
+
+
+@pytest.mark.parametrize("engine", ["kdtree", "rtree", "grid", "brute", "auto"])
+def test_batch_matches_single_sets(sets, engine):
+    result = ygg.friends_of_friends_batch(sets, 0.15, engine=engine)
+    assert len(result["set_offsets"]) == len(sets) + 1
+    assert list(result["set"]) == [s for s in range(len(sets)) for _ in _set_groups(result, s)]
+    for s, points in enumerate(sets):
+        if len(points) == 0:
+            assert _set_groups(result, s) == []
+        else:
+            assert _set_groups(result, s) == ygg.friends_of_friends(points, 0.15, engine=engine)
+
+
+def test_batch_concatenated_buffer(sets):
+    offsets = np.cumsum([0] + [len(s) for s in sets])
+    from_list = ygg.friends_of_friends_batch(sets, 0.2, boxsize=2.0)
+    from_buffer = ygg.friends_of_friends_batch(np.concatenate(sets), 0.2, offsets=offsets, boxsize=2.0)
+    for key in ("offsets", "members", "set", "set_offsets"):
+        assert np.array_equal(from_list[key], from_buffer[key])
+
+
+def test_batch_with_threads(sets):
+    script = (
+        "import numpy as np, ygg\n"
+        "rng = np.random.RandomState(3)\n"
+        "sets = [rng.uniform(0, 2, (n, 3)) for n in (40, 0, 500, 7, 1, 2000, 120)]\n"
+        "r = ygg.friends_of_friends_batch(sets, 0.15)\n"
+        "print(r['members'].sum(), r['offsets'].sum(), len(r['set']))\n"
+    )
+    outputs = set()
+    for threads in ("1", "4"):
+        env = dict(os.environ, OMP_NUM_THREADS=threads)
+        outputs.add(subprocess.check_output([sys.executable, "-c", script], env=env))
+    assert len(outputs) == 1
+
+
+def test_batch_errors(sets):
+    assert len(ygg.friends_of_friends_batch([], 0.1)["set_offsets"]) == 1
+    with pytest.raises(ValueError):
+        ygg.friends_of_friends_batch(np.zeros((10, 3)), 0.1, offsets=[0, 4, 9])
+    with pytest.raises(ValueError):
+        ygg.friends_of_friends_batch([np.zeros((3, 3)), np.zeros((3, 2))], 0.1)
+    with pytest.raises(ValueError):
+        ygg.friends_of_friends_batch(sets, 0.1, engine="octree")
+    with pytest.raises(ValueError):
+        ygg.friends_of_friends_batch([np.zeros((3, 7))], 0.1, engine="kdtree")
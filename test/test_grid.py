@@ -0,0 +1,48 @@
+import numpy as np
+import pytest
+
+
+import ygg
+
+
+def _partition(groups):
+    return sorted(map(sorted, groups))
+
+
+@pytest.mark.parametrize("ndim", [1, 2, 3])
+@pytest.mark.parametrize("boxsize", [0.0, 1.0])
+def test_grid_matches_rtree(ndim, boxsize):
+    rng = np.random.default_rng(40 + ndim)
+    data = rng.uniform(0.0, 1.0, (4000, ndim))
+    b = 0.5 * len(data) ** (-1.0 / ndim)
+
+    groups, stats = ygg.friends_of_friends(data, b, boxsize=boxsize, quantize_bits=32, return_stats=True)
+    assert _partition(groups) == _partition(ygg.friends_of_friends(data, b, boxsize=boxsize))
+    assert list(stats["phases"]) == ["index", "link", "label"]
+    assert stats["pairs_linked"] == len(data) - len(groups)
+    assert 0.0 < stats["resolution_error"] < 1e-5
+
+
+def test_periodic_wrap_is_the_minimum_image():
+    # Friends across the faces of the box, and a point exactly on the upper face
+    data = np.array([[0.001, 0.5, 0.5], [0.999, 0.5, 0.5], [1.0, 0.5, 0.5], [0.5, 0.5, 0.5]])
+    groups = ygg.friends_of_friends(data, 0.01, boxsize=1.0, quantize_bits=32)
+    assert _partition(groups) == [[0, 1, 2], [3]]
+
+
+def test_resolution_error_scales_with_bits():
+    rng = np.random.default_rng(41)
+    data = rng.uniform(0.0, 100.0, (2000, 3))
+    _, fine = ygg.friends_of_friends(data, 2.0, boxsize=100.0, quantize_bits=24, return_stats=True)
+    _, coarse = ygg.friends_of_friends(data, 2.0, boxsize=100.0, quantize_bits=12, return_stats=True)
+    # sqrt(3) quantization steps of L / 2^bits, over the linking length
+    assert coarse["resolution_error"] == pytest.approx(np.sqrt(3) * 100.0 / 2 ** 12 / 2.0)
+    assert coarse["resolution_error"] == pytest.approx(fine["resolution_error"] * 2 ** 12)
+
+
+def test_grid_rejects_unsupported_input():
+    data = np.zeros((10, 4))
+    with pytest.raises(ValueError):
+        ygg.friends_of_friends(data, 0.1, quantize_bits=32)
+    with pytest.raises(ValueError):
+        ygg.friends_of_friends(data[:, :3], 0.1, quantize_bits=32, use_brute=True)
@@ -0,0 +1,58 @@
+import numpy as np
+import pytest
+
+
+import ygg
+
+
+@pytest.fixture
+def points():
+    rng = np.random.RandomState(11)
+    centres = rng.uniform(0, 10, (30, 3))
+    blobs = centres[rng.randint(0, 30, 4000)] + rng.normal(0, 0.15, (4000, 3))
+    return np.vstack([blobs % 10.0, rng.uniform(0, 10, (1000, 3))])
+
+
+def test_sizes_match_groups(points):
+    groups = ygg.friends_of_friends(points, 0.1, boxsize=10.0, engine="kdtree")
+    result = ygg.group_multiplicity(points, 0.1, boxsize=10.0, top_k=5, return_sizes=True)
+    sizes = np.array([len(g) for g in groups])
+
+    assert result["ngroups"] == len(groups)
+    assert np.array_equal(result["sizes"], sizes)
+    assert result["edges"][0] == 1 and result["edges"][-1] > len(points)
+    assert result["counts"].sum() == len(groups)
+    for i in range(len(result["counts"])):
+        lo, hi = result["edges"][i], result["edges"][i + 1]
+        assert result["counts"][i] == np.count_nonzero((sizes >= lo) & (sizes < hi))
+
+    expected_top = sorted(range(len(groups)), key=lambda g: (-sizes[g], g))[:5]
+    assert list(result["top_groups"]) == expected_top
+    assert list(result["top_sizes"]) == list(sizes[expected_top])
+    for g, seed in zip(result["top_groups"], result["top_seeds"]):
+        assert seed in groups[g]
+
+
+def test_custom_bins_and_no_sizes(points):
+    result = ygg.group_multiplicity(points, 0.1, bins=[20, 100, 1000], top_k=0)
+    sizes = np.array([len(g) for g in ygg.friends_of_friends(points, 0.1, engine="kdtree")])
+    assert list(result["counts"]) == [np.count_nonzero((sizes >= 20) & (sizes < 100)),
+                                      np.count_nonzero((sizes >= 100) & (sizes < 1000))]
+    assert len(result["top_groups"]) == 0
+    assert "sizes" not in result
+
+
+def test_spatial_index_group_multiplicity(points):
+    index = ygg.SpatialIndex(points, boxsize=10.0)
+    groups = index.friends_of_friends(0.1)
+    result = index.group_multiplicity(0.1, top_k=3, return_sizes=True)
+    assert list(result["sizes"]) == [len(g) for g in groups]
+    assert list(result["top_sizes"]) == sorted((len(g) for g in groups), reverse=True)[:3]
+
+
+def test_group_multiplicity_errors():
+    assert ygg.group_multiplicity(np.zeros((0, 2)), 1.0)["ngroups"] == 0
+    with pytest.raises(ValueError):
+        ygg.group_multiplicity(np.zeros((4, 3)), 1.0, bins=[5, 5])
+    with pytest.raises(ValueError):
+        ygg.group_multiplicity(np.zeros((4, 7)), 1.0)
@@ -0,0 +1,65 @@
+import numpy as np
+import pytest
+
+
+import ygg
+
+
+def test_mass_and_centre_of_mass():
+    rng = np.random.default_rng(42)
+    points_per_blob = 1000
+    data = np.vstack([
+        rng.normal(-1, 0.1, (points_per_blob, 3)),
+        rng.normal(1, 0.1, (points_per_blob, 3)),
+    ])
+
+    groups = ygg.friends_of_friends(data, 0.4)
+    props = ygg.halo_properties(data, groups, particle_mass=2.0)
+
+    assert len(props["mass"]) == 2
+    assert np.all(props["npart"] == points_per_blob)
+    assert np.allclose(props["mass"], 2.0 * points_per_blob)
+    for g, com, extent in zip(groups, props["com"], props["extent"]):
+        assert np.allclose(com, data[g].mean(axis=0))
+        assert np.isclose(extent, np.linalg.norm(data[g] - com, axis=1).max())
+    assert "vel" not in props
+
+
+def test_per_particle_masses():
+    data = [[0.0, 0.0], [1.0, 0.0]]
+    props = ygg.halo_properties(data, [[0, 1]], masses=[1.0, 3.0])
+
+    assert np.allclose(props["mass"], [4.0])
+    assert np.allclose(props["com"], [[0.75, 0.0]])
+    assert np.allclose(props["extent"], [0.75])
+
+
+def test_periodic_unwrapping():
+    data = np.array([[0.01, 0.5], [0.99, 0.5], [0.97, 0.5]])
+    groups = ygg.friends_of_friends(data, 0.05, boxsize=1.0)
+    assert len(groups) == 1
+
+    props = ygg.halo_properties(data, groups, boxsize=1.0)
+    assert np.allclose(props["com"], [[0.99, 0.5]])
+    assert np.allclose(props["extent"], [0.02])
+
+
+def test_velocity_dispersion():
+    rng = np.random.default_rng(1)
+    npts = 20000
+    data = rng.uniform(0, 1, (npts, 3))
+    velocities = rng.normal(5.0, 2.0, (npts, 3))
+
+    props = ygg.halo_properties(data, [list(range(npts))], velocities=velocities)
+    assert np.allclose(props["vel"], velocities.mean(axis=0))
+    assert np.isclose(props["sigma_v"][0], np.sqrt(velocities.var(axis=0).mean()))
+
+
+def test_invalid_groups_are_rejected():
+    data = np.random.default_rng(0).uniform(0, 1, (100, 3))
+    with pytest.raises(ValueError):
+        ygg.halo_properties(data, [[0, 1, 10 ** 9]])
+    with pytest.raises(ValueError):
+        ygg.halo_properties(data, [[0, 1], [1, 2]])
+    with pytest.raises(ValueError):
+        ygg.SpatialIndex(data).attach(data, [[0, 100]])
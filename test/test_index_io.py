@@ -0,0 +1,91 @@
+import numpy as np
+import pytest
+
+
+import ygg
+
+
+def canonical(groups):
+    return sorted(sorted(g) for g in groups)
+
+
+@pytest.fixture
+def points():
+    rng = np.random.default_rng(49)
+    return rng.uniform(0.0, 1.0, (8000, 3))
+
+
+def test_round_trip(points, tmp_path):
+    path = tmp_path / "points.kdt"
+    index = ygg.SpatialIndex(points, boxsize=1.0)
+    index.save(path, checksum=1234)
+
+    loaded = ygg.SpatialIndex.load(path, npts=len(points), boxsize=1.0, checksum=1234)
+    assert loaded.mapped and not index.mapped
+    assert len(loaded) == len(points)
+    b = 0.02
+    assert loaded.friends_of_friends(b) == index.friends_of_friends(b)
+    assert canonical(ygg.SpatialIndex.load(path, verify=True).friends_of_friends(b)) == \
+        canonical(ygg.friends_of_friends(points, b, boxsize=1.0))
+
+
+def test_empty_index(tmp_path):
+    path = tmp_path / "empty.kdt"
+    ygg.SpatialIndex(np.zeros((0, 3))).save(path)
+    loaded = ygg.SpatialIndex.load(path)
+    assert len(loaded) == 0
+    assert loaded.friends_of_friends(0.1) == []
+
+
+def test_mismatch_is_rejected(points, tmp_path):
+    path = tmp_path / "points.kdt"
+    ygg.SpatialIndex(points, boxsize=1.0).save(path, checksum=7)
+    with pytest.raises(ValueError):
+        ygg.SpatialIndex.load(path, npts=len(points) + 1)
+    with pytest.raises(ValueError):
+        ygg.SpatialIndex.load(path, boxsize=2.0)
+    with pytest.raises(ValueError):
+        ygg.SpatialIndex.load(path, checksum=8)
+    with pytest.raises(ValueError):
+        ygg.SpatialIndex.load(tmp_path / "missing.kdt")
+
+
+def test_damaged_file_fails_verification(points, tmp_path):
+    path = tmp_path / "points.kdt"
+    ygg.SpatialIndex(points).save(path)
+    with open(path, "r+b") as f:
+        f.seek(-8, 2)
+        f.write(b"\xff" * 8)
+    ygg.SpatialIndex.load(path)
+    with pytest.raises(ValueError):
+        ygg.SpatialIndex.load(path, verify=True)
+
+
+@pytest.mark.parametrize("offset", [48, 80, 88, 96, 104])
+def test_damaged_header_is_rejected(points, tmp_path, offset):
+    # nnodes, then the offsets of the coordinates, permutation and nodes and the size of the file
+    path = tmp_path / "points.kdt"
+    ygg.SpatialIndex(points).save(path)
+    with open(path, "r+b") as f:
+        f.seek(offset)
+        value = int.from_bytes(f.read(8), "little")
+        f.seek(offset)
+        f.write((value + 4096).to_bytes(8, "little"))
+    with pytest.raises(ValueError):
+        ygg.SpatialIndex.load(path)
+
+
+def test_update_positions_copies_the_mapped_tree(points, tmp_path):
+    path = tmp_path / "points.kdt"
+    ygg.SpatialIndex(points, boxsize=1.0).save(path)
+    before = path.read_bytes()
+
+    loaded = ygg.SpatialIndex.load(path)
+    rng = np.random.default_rng(50)
+    moved = (points + rng.normal(0.0, 1e-3, points.shape)) % 1.0
+    loaded.update_positions(moved)
+    assert not loaded.mapped
+    assert path.read_bytes() == before
+
+    b = 0.02
+    assert canonical(loaded.friends_of_friends(b)) == canonical(ygg.friends_of_friends(moved, b, boxsize=1.0))
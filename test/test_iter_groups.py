@@ -0,0 +1,68 @@
+import numpy as np
+import pytest
+
+
+import ygg
+
+
+def _canonical(groups):
+    return sorted(sorted(int(i) for i in group) for group in groups)
+
+
+@pytest.fixture
+def points():
+    rng = np.random.RandomState(7)
+    return rng.uniform(0, 10, (3000, 3))
+
+
+def test_iter_groups_matches_kdtree(points):
+    expected = ygg.friends_of_friends(points, 0.3, boxsize=10.0, engine="kdtree")
+    groups = list(ygg.iter_groups(points, 0.3, boxsize=10.0, queue_size=1))
+    assert all(group.dtype == np.int64 for group in groups)
+    assert [list(group) for group in groups] == expected
+
+
+def test_iter_groups_batches(points):
+    expected = _canonical(ygg.friends_of_friends(points, 0.3))
+    groups = []
+    for offsets, members in ygg.iter_groups(points, 0.3, batch_size=100):
+        assert offsets[0] == 0 and offsets[-1] == len(members)
+        assert len(offsets) <= 101
+        groups.extend(members[offsets[i]:offsets[i + 1]] for i in range(len(offsets) - 1))
+    assert _canonical(groups) == expected
+
+
+@pytest.mark.parametrize("dimensions", [1, 2, 6])
+def test_iter_groups_dimensions(dimensions):
+    rng = np.random.RandomState(dimensions)
+    points = rng.uniform(0, 4, (500, dimensions))
+    assert _canonical(ygg.iter_groups(points, 0.2)) == _canonical(ygg.friends_of_friends(points, 0.2))
+
+
+def test_iter_groups_stops_early(points):
+    iterator = ygg.iter_groups(points, 0.05, batch_size=1, queue_size=1)
+    first = [next(iterator) for _ in range(3)]
+    assert len(first) == 3
+    # The batches already queued when the iterator is closed are dropped too
+    iterator.close()
+    assert list(iterator) == []
+    iterator.close()
+    with pytest.raises(StopIteration):
+        next(iterator)
+    # Dropping an iterator mid-way stops its worker as well
+    for _ in ygg.iter_groups(points, 0.05, queue_size=1):
+        break
+
+
+def test_spatial_index_iter_groups(points):
+    index = ygg.SpatialIndex(points, boxsize=10.0)
+    expected = index.friends_of_friends(0.3)
+    assert [list(group) for group in index.iter_groups(0.3)] == expected
+
+
+def test_iter_groups_errors():
+    assert list(ygg.iter_groups(np.zeros((0, 3)), 1.0)) == []
+    with pytest.raises(ValueError):
+        ygg.iter_groups(np.zeros((4, 3)), 1.0, batch_size=0)
+    with pytest.raises(ValueError):
+        list(ygg.iter_groups(np.zeros((4, 7)), 1.0))
@@ -0,0 +1,52 @@
+from collections import Counter
+
+import numpy as np
+
+
+import ygg
+
+
+def brute_links(ids_prev, labels_prev, ids_next, labels_next):
+    prev = dict(zip(ids_prev, labels_prev))
+    return Counter(
+        (prev[i], d) for i, d in zip(ids_next, labels_next) if d >= 0 and prev.get(i, -1) >= 0
+    )
+
+
+def test_shared_counts_match_brute_force():
+    rng = np.random.default_rng(33)
+    n = 20000
+    ids_prev = rng.permutation(n).astype(np.uint64) * 7 + 3
+    labels_prev = rng.integers(-1, 50, n)
+    # The later snapshot reorders the particles, loses a few and regroups them
+    keep = rng.permutation(n)[: n - 500]
+    ids_next = ids_prev[keep]
+    labels_next = np.where(rng.uniform(size=len(keep)) < 0.8, labels_prev[keep] // 2, rng.integers(-1, 25, len(keep)))
+
+    expected = brute_links(ids_prev.tolist(), labels_prev.tolist(), ids_next.tolist(), labels_next.tolist())
+    for passes in (1, 3):
+        links = ygg.merger_tree(ids_prev, labels_prev, ids_next, labels_next, passes=passes)
+        found = dict(zip(zip(links["progenitor"].tolist(), links["descendant"].tolist()), links["shared"].tolist()))
+        assert found == dict(expected)
+        order = list(zip(links["descendant"], links["progenitor"]))
+        assert order == sorted(order)
+
+
+def test_main_progenitor_by_merit():
+    ids_prev = np.arange(10)
+    labels_prev = np.array([0, 0, 0, 0, 1, 1, 1, 1, 1, 1])
+    ids_next = np.arange(12)[::-1]
+    labels_next = np.full(12, -1)
+    labels_next[ids_next < 3] = 0      # three particles of group 0
+    labels_next[ids_next >= 3] = 1     # one particle of group 0, all of group 1 and two new ones
+
+    links = ygg.merger_tree(ids_prev, labels_prev, ids_next, labels_next)
+    assert list(links["main_progenitor"]) == [0, 1]
+    assert np.isclose(links["merit"][0], 9 / (4 * 3))
+    assert np.isclose(links["merit"][1], 36 / (6 * 9))
+
+
+def test_new_groups_have_no_progenitor():
+    links = ygg.merger_tree([1, 2], [-1, -1], [1, 2, 3], [0, 0, 1])
+    assert list(links["main_progenitor"]) == [-1, -1]
+    assert len(links["shared"]) == 0
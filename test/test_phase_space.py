@@ -0,0 +1,53 @@
+import numpy as np
+
+
+import ygg
+
+
+def two_streams(rng, npts=500, centre=0.5):
+    # Two spatially overlapping populations that only differ in their bulk velocity
+    pos = rng.normal(centre, 0.01, (2 * npts, 3)) % 1.0
+    vel = rng.normal(0.0, 1.0, (2 * npts, 3))
+    vel[npts:, 0] += 50.0
+    return pos, vel
+
+
+def test_streams_separate_in_phase_space():
+    rng = np.random.default_rng(31)
+    pos, vel = two_streams(rng)
+    groups = ygg.friends_of_friends(pos, 0.01, boxsize=1.0)
+    big = [g for g in groups if len(g) > 100]
+    assert len(big) == 1
+
+    result = ygg.phase_space_groups(pos, vel, big, 0.01, velocity_linking_length=5.0, boxsize=1.0)
+    found = sorted(sorted(g) for g in result["groups"] if len(g) > 300)
+    assert len(found) == 2
+    assert {min(g) < 500 for g in found} == {True, False}
+    assert all(max(g) < 500 or min(g) >= 500 for g in found)
+    assert list(result["parent"]) == [0] * len(result["groups"])
+
+
+def test_periodic_positions_and_adaptive_scale():
+    rng = np.random.default_rng(32)
+    pos, vel = two_streams(rng, centre=0.0)
+    groups = ygg.friends_of_friends(pos, 0.01, boxsize=1.0)
+    big = [g for g in groups if len(g) > 100]
+    assert len(big) == 1
+
+    # The adaptive scale divides velocities by the group dispersion, which is dominated by the stream offset
+    result = ygg.phase_space_groups(pos, vel, big, 0.01, boxsize=1.0, min_members=100)
+    assert len(result["groups"]) == 2
+    assert all(len(g) > 450 for g in result["groups"])
+    assert all(max(g) < 500 or min(g) >= 500 for g in result["groups"])
+
+
+def test_matches_scaled_brute_force():
+    rng = np.random.default_rng(33)
+    pos = rng.uniform(0.0, 1.0, (300, 3))
+    vel = rng.normal(0.0, 1.0, (300, 3))
+    bx, bv = 0.15, 1.0
+
+    result = ygg.phase_space_groups(pos, vel, [list(range(300))], bx, velocity_linking_length=bv,
+                                    min_members=1)
+    expected = ygg.friends_of_friends(np.hstack([pos / bx, vel / bv]), 1.0, use_brute=True)
+    assert sorted(sorted(g) for g in result["groups"]) == sorted(sorted(g) for g in expected)
@@ -0,0 +1,68 @@
+import numpy as np
+import pytest
+
+
+import ygg
+
+
+def direct_potential(data, masses, softening=0.0):
+    diff = data[:, None, :] - data[None, :, :]
+    r = np.sqrt((diff ** 2).sum(axis=-1) + softening ** 2)
+    np.fill_diagonal(r, np.inf)
+    return -(masses[None, :] / r).sum(axis=1)
+
+
+def test_two_particles():
+    result = ygg.group_potential([[0, 0, 0], [1, 0, 0]], [[0, 1]], masses=[1.0, 2.0], G=2.0)
+    assert np.allclose(result["potential"], [-4.0, -2.0])
+    assert list(result["most_bound"]) == [0]
+
+
+def test_direct_sum_matches_numpy():
+    rng = np.random.default_rng(2)
+    data = rng.normal(0, 1, (200, 3))
+    masses = rng.uniform(1, 2, 200)
+
+    result = ygg.group_potential(data, [list(range(200))], masses=masses, softening=0.1)
+    expected = direct_potential(data, masses, softening=0.1)
+    assert np.allclose(result["potential"], expected)
+    assert result["most_bound"][0] == np.argmin(expected)
+
+
+def test_coincident_particles():
+    data = np.array([[0.0, 0.0, 0.0], [0.0, 0.0, 0.0], [0.0, 0.0, 0.0], [1.0, 0.0, 0.0]])
+    masses = np.array([1.0, 2.0, 3.0, 4.0])
+    expected = direct_potential(data, masses, softening=0.5)
+    for direct_threshold in (256, 1):
+        result = ygg.group_potential(data, [[0, 1, 2, 3]], masses=masses, softening=0.5, theta=0.0,
+                                     direct_threshold=direct_threshold)
+        assert np.allclose(result["potential"], expected)
+
+
+def test_tree_walk_accuracy():
+    rng = np.random.default_rng(4)
+    npts = 3000
+    data = rng.normal(0, 1, (npts, 3)) * rng.uniform(0.1, 1, (npts, 1))
+    masses = np.ones(npts)
+    expected = direct_potential(data, masses)
+    groups = [list(range(npts))]
+
+    exact = ygg.group_potential(data, groups, theta=0.0, direct_threshold=16)
+    assert np.allclose(exact["potential"], expected)
+
+    approx = ygg.group_potential(data, groups, theta=0.5, direct_threshold=16)
+    assert np.max(np.abs(approx["potential"] / expected - 1)) < 1e-2
+
+
+def test_groups_are_independent_and_periodic():
+    data = np.array([[0.01, 0.5, 0.5], [0.99, 0.5, 0.5], [0.5, 0.5, 0.5], [0.6, 0.5, 0.5]])
+    result = ygg.group_potential(data, [[0, 1], [2, 3]], boxsize=1.0)
+    assert np.allclose(result["potential"], [-50.0, -50.0, -10.0, -10.0])
+
+
+def test_points_must_be_three_dimensional():
+    data = np.random.default_rng(5).uniform(0, 1, (300, 2))
+    with pytest.raises(ValueError):
+        ygg.group_potential(data, [[0, 1]])
+    with pytest.raises(ValueError):
+        ygg.SpatialIndex(data)
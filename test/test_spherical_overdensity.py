@@ -0,0 +1,104 @@
+import numpy as np
+import pytest
+
+
+import ygg
+
+
+RHO_CRIT0 = 27.7536627  # 1e10 Msun/h / (Mpc/h)^3
+COSMOLOGY = {"om0": 0.3, "oml": 0.7, "h": 0.7, "redshift": 0.0}
+
+
+def uniform_ball(rng, centre, radius, npts):
+    direction = rng.normal(size=(npts, 3))
+    direction /= np.linalg.norm(direction, axis=1)[:, None]
+    return centre + direction * radius * rng.uniform(0, 1, (npts, 1)) ** (1 / 3)
+
+
+def test_index_friends_of_friends_matches_rtree():
+    rng = np.random.default_rng(3)
+    data = rng.uniform(0, 1, (3000, 3))
+
+    index = ygg.SpatialIndex(data, boxsize=1.0)
+    assert len(index) == len(data)
+
+    expected = ygg.friends_of_friends(data, 0.05, boxsize=1.0)
+    found = index.friends_of_friends(0.05)
+    assert sorted(sorted(g) for g in found) == sorted(sorted(g) for g in expected)
+
+
+def test_isolated_clump():
+    rng = np.random.default_rng(5)
+    npts = 1000
+    data = uniform_ball(rng, np.array([0.5, 0.5, 0.5]), 0.01, npts)
+
+    index = ygg.SpatialIndex(data, boxsize=1.0)
+    so = index.spherical_overdensity([[0.5, 0.5, 0.5]], length_unit=1000.0, **COSMOLOGY)
+
+    for delta, key in [(200, "200c"), (500, "500c")]:
+        assert np.isclose(so["m" + key][0], npts)
+        assert np.isclose(so["r" + key][0], (3 * npts / (4 * np.pi * delta * RHO_CRIT0)) ** (1 / 3))
+
+    x = 0.3 - 1
+    delta_vir = 18 * np.pi ** 2 + 82 * x - 39 * x ** 2
+    assert np.isclose(so["rvir"][0], (3 * npts / (4 * np.pi * delta_vir * RHO_CRIT0)) ** (1 / 3))
+
+
+def test_open_model_and_non_flat_rejection():
+    rng = np.random.default_rng(17)
+    npts = 1000
+    data = uniform_ball(rng, np.array([0.5, 0.5, 0.5]), 0.01, npts)
+    index = ygg.SpatialIndex(data, boxsize=1.0)
+
+    so = index.spherical_overdensity([[0.5, 0.5, 0.5]], length_unit=1000.0, om0=0.3, oml=0.0, h=0.7, redshift=0.0)
+    x = 0.3 - 1
+    delta_vir = 18 * np.pi ** 2 + 60 * x - 32 * x ** 2
+    assert np.isclose(so["rvir"][0], (3 * npts / (4 * np.pi * delta_vir * RHO_CRIT0)) ** (1 / 3))
+
+    with pytest.raises(ValueError):
+        index.spherical_overdensity([[0.5, 0.5, 0.5]], length_unit=1000.0, om0=0.3, oml=0.5, h=0.7, redshift=0.0)
+    with pytest.raises(TypeError):
+        index.spherical_overdensity([[0.5, 0.5, 0.5]], length_unit=1000.0)
+
+
+def test_includes_particles_outside_the_fof_group():
+    rng = np.random.default_rng(7)
+    npts = 1000
+    data = np.vstack([
+        uniform_ball(rng, np.array([0.5, 0.5, 0.5]), 0.005, npts),
+        uniform_ball(rng, np.array([0.52, 0.5, 0.5]), 0.005, npts),
+    ])
+
+    index = ygg.SpatialIndex(data, boxsize=1.0)
+    groups = index.friends_of_friends(0.002)
+    assert len(groups) == 2
+
+    props = ygg.halo_properties(data, groups, boxsize=1.0)
+    so = index.spherical_overdensity(props["com"], radii=props["extent"], length_unit=1000.0, **COSMOLOGY)
+    assert np.allclose(so["m200c"], 2 * npts)
+
+
+def test_periodic_centre_and_masses():
+    rng = np.random.default_rng(11)
+    npts = 500
+    data = uniform_ball(rng, np.array([0.0, 0.5, 0.5]), 0.01, npts) % 1.0
+
+    index = ygg.SpatialIndex(data, boxsize=1.0)
+    so = index.spherical_overdensity([[0.0, 0.5, 0.5]], masses=np.full(npts, 2.0), particle_mass=2.0,
+                                     length_unit=1000.0, **COSMOLOGY)
+    assert np.isclose(so["m200c"][0], 2 * npts)
+
+
+def test_masses_without_particle_mass():
+    rng = np.random.default_rng(13)
+    npts = 500
+    data = uniform_ball(rng, np.array([0.5, 0.5, 0.5]), 0.01, npts)
+
+    index = ygg.SpatialIndex(data, boxsize=1.0)
+    so = index.spherical_overdensity([[0.5, 0.5, 0.5]], masses=np.full(npts, 2.0), particle_mass=0.0,
+                                     length_unit=1000.0, **COSMOLOGY)
+    assert np.isclose(so["m200c"][0], 2 * npts)
+    # Massless particles have no overdensity, rather than an endless search
+    so = index.spherical_overdensity([[0.5, 0.5, 0.5]], masses=np.zeros(npts), particle_mass=0.0,
+                                     length_unit=1000.0, **COSMOLOGY)
+    assert so["m200c"][0] == 0.0
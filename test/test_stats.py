@@ -0,0 +1,99 @@
+import numpy as np
+import pytest
+
+
+import ygg
+
+
+@pytest.fixture
+def data():
+    rng = np.random.default_rng(35)
+    return rng.uniform(0.0, 1.0, (3000, 3))
+
+
+@pytest.mark.parametrize("use_brute", [False, True])
+def test_engine_stats(data, use_brute):
+    plain = ygg.friends_of_friends(data, 0.05, use_brute=use_brute)
+    groups, stats = ygg.friends_of_friends(data, 0.05, use_brute=use_brute, return_stats=True)
+    assert sorted(map(sorted, groups)) == sorted(map(sorted, plain))
+
+    expected_phases = ["link"] if use_brute else ["load", "index", "link"]
+    assert list(stats["phases"]) == expected_phases
+    for phase in stats["phases"].values():
+        assert phase["wall_ns"] > 0 and phase["peak_rss_kb"] > 0
+
+    # Every point but the seed of its group is linked exactly once
+    assert stats["points_visited"] == len(data)
+    assert stats["pairs_linked"] == len(data) - len(groups)
+    assert stats["pairs_tested"] >= stats["pairs_linked"]
+
+
+@pytest.mark.parametrize("kwargs, engine", [
+    ({}, "rtree"),
+    ({"use_brute": True}, "brute"),
+    ({"quantize_bits": 24}, "grid"),
+    ({"engine": "kdtree"}, "kdtree"),
+])
+def test_stats_report_engine(data, kwargs, engine):
+    # Every code path goes through the same library entry point and reports the engine that ran
+    groups, stats = ygg.friends_of_friends(data, 0.05, return_stats=True, **kwargs)
+    assert stats["engine"] == engine
+    assert stats["npts"] == len(data)
+    assert sum(map(len, groups)) == len(data)
+
+
+@pytest.mark.parametrize("use_brute", [False, True])
+def test_allocations_do_not_scale_with_groups(data, use_brute):
+    # The linking loop only grows a handful of buffers geometrically, whatever the number of groups
+    groups, stats = ygg.friends_of_friends(data, 0.05, use_brute=use_brute, return_stats=True)
+    assert len(groups) > 1000
+    assert 0 < stats["allocations"] < 64
+
+
+def test_spatial_index_stats(data):
+    index = ygg.SpatialIndex(data)
+    assert list(index.build_stats["phases"]) == ["index"]
+
+    groups, stats = index.friends_of_friends(0.05, return_stats=True)
+    assert list(stats["phases"]) == ["link", "label"]
+    assert stats["pairs_linked"] == len(data) - len(groups)
+    assert stats["nodes_touched"] > 0
+    assert 0 < stats["allocations"] < 64
+
+
+def test_profile_degrades_gracefully(data):
+    groups, stats = ygg.friends_of_friends(data, 0.05, profile=True)
+    assert sorted(map(sorted, groups)) == sorted(map(sorted, ygg.friends_of_friends(data, 0.05)))
+    assert stats["npts"] == len(data)
+    for phase in stats["phases"].values():
+        # Counters are reported only where the kernel lets us read them
+        if "cycles" in phase and "instructions" in phase and phase["cycles"] > 0:
+            assert phase["ipc"] == phase["instructions"] / phase["cycles"]
+        for name in ("l1d_misses", "llc_misses", "branch_misses"):
+            if name in phase:
+                assert phase[name + "_per_particle"] == phase[name] / len(data)
+
+    index = ygg.SpatialIndex(data, profile=True)
+    assert "index" in index.build_stats["phases"]
+    _, stats = index.friends_of_friends(0.05, profile=True)
+    assert list(stats["phases"]) == ["link", "label"]
+
+
+@pytest.mark.parametrize("engine, phase", [("kdtree", "label"), ("grid", "label"), ("rtree", "load")])
+def test_phase_bandwidth(data, engine, phase):
+    _, stats = ygg.friends_of_friends(data, 0.05, engine=engine, return_stats=True)
+    assert stats["phases"][phase]["bytes"] >= len(data) * 4
+    assert stats["phases"][phase]["bandwidth_gb_s"] > 0
+    assert "bytes" not in stats["phases"]["link"]
+
+
+def test_huge_pages(data):
+    # Huge pages only change where the arrays live, never the groups
+    plain = ygg.friends_of_friends(data, 0.05, engine="kdtree")
+    ygg.set_huge_pages(True)
+    try:
+        groups = ygg.friends_of_friends(np.tile(data, (100, 1)), 1e-9, engine="kdtree")
+        assert len(groups) == len(data)
+        assert ygg.friends_of_friends(data, 0.05, engine="kdtree") == plain
+    finally:
+        ygg.set_huge_pages(False)
@@ -0,0 +1,55 @@
+import numpy as np
+
+
+import ygg
+
+
+def blob(rng, centre, sigma, npts):
+    return rng.normal(centre, sigma, (npts, 3))
+
+
+def test_two_rungs_of_substructure():
+    rng = np.random.default_rng(8)
+    # One halo made of two subhaloes, the first of which holds two tighter cores
+    data = np.vstack([
+        blob(rng, [0.50, 0.5, 0.5], 0.001, 400),
+        blob(rng, [0.51, 0.5, 0.5], 0.001, 400),
+        blob(rng, [0.60, 0.5, 0.5], 0.003, 800),
+        [[0.54, 0.5, 0.5], [0.57, 0.5, 0.5]],
+    ])
+    b = 0.04
+    groups = ygg.friends_of_friends(data, b, boxsize=1.0)
+    big = [g for g in groups if len(g) > 100]
+    assert len(big) == 1
+
+    tree = ygg.subgroups(data, big, b, ratio=0.25, levels=2, min_members=100, boxsize=1.0)
+    assert tree["parent"][0] == -1 and tree["level"][0] == 0
+    assert sorted(tree["groups"][0]) == sorted(big[0])
+
+    sizes = {lvl: sorted(len(g) for g, l in zip(tree["groups"], tree["level"]) if l == lvl) for lvl in (1, 2)}
+    assert len(sizes[1]) == 2 and sizes[1][0] >= 700
+    assert len(sizes[2]) == 3
+
+    # Every subgroup is contained in its parent and is one rung below it
+    for g, p, lvl in zip(tree["groups"], tree["parent"], tree["level"]):
+        if p >= 0:
+            assert set(g) <= set(tree["groups"][p])
+            assert tree["level"][p] == lvl - 1
+
+
+def test_small_groups_are_leaves():
+    data = np.array([[0.0, 0.0, 0.0], [0.1, 0.0, 0.0], [5.0, 0.0, 0.0]])
+    groups = ygg.friends_of_friends(data, 0.2)
+    tree = ygg.subgroups(data, groups, 0.2, min_members=5)
+    assert len(tree["groups"]) == len(groups)
+    assert list(tree["parent"]) == [-1] * len(groups)
+
+
+def test_many_groups_are_batched():
+    rng = np.random.default_rng(9)
+    centres = rng.uniform(0, 100, (300, 3))
+    data = np.vstack([blob(rng, c, 0.05, 60) for c in centres])
+    groups = ygg.friends_of_friends(data, 0.2)
+    tree = ygg.subgroups(data, groups, 0.2, levels=1, min_members=20)
+    top = [g for g, p in zip(tree["groups"], tree["parent"]) if p < 0]
+    assert sorted(map(sorted, top)) == sorted(map(sorted, groups))
@@ -0,0 +1,75 @@
+import numpy as np
+
+
+import ygg
+
+
+def canonical(groups):
+    return sorted(sorted(g) for g in groups)
+
+
+def test_small_drift_refits_without_rebuild():
+    rng = np.random.default_rng(32)
+    data = rng.uniform(0.0, 1.0, (20000, 3))
+    index = ygg.SpatialIndex(data, boxsize=1.0)
+
+    moved = (data + rng.normal(0.0, 1e-4, data.shape)) % 1.0
+    rebuilt = index.update_positions(moved)
+    assert rebuilt < len(data) // 10
+
+    b = 0.02
+    fresh = ygg.SpatialIndex(moved, boxsize=1.0)
+    assert canonical(index.friends_of_friends(b)) == canonical(fresh.friends_of_friends(b))
+
+
+def test_scrambled_points_trigger_rebuild():
+    rng = np.random.default_rng(33)
+    data = rng.uniform(0.0, 1.0, (5000, 3))
+    index = ygg.SpatialIndex(data)
+
+    shuffled = data[rng.permutation(len(data))]
+    assert index.update_positions(shuffled) > len(data) // 2
+
+    b = 0.04
+    assert canonical(index.friends_of_friends(b)) == canonical(ygg.friends_of_friends(shuffled, b))
+    # A second update with the same positions finds nothing left to rebuild
+    assert index.update_positions(shuffled) == 0
+
+
+def test_queries_follow_the_update():
+    rng = np.random.default_rng(34)
+    data = rng.uniform(0.0, 1.0, (2000, 3))
+    index = ygg.SpatialIndex(data, boxsize=1.0)
+    groups = index.friends_of_friends(0.03)
+
+    moved = (data + 0.3) % 1.0
+    index.update_positions(moved)
+    assert canonical(index.friends_of_friends(0.03)) == canonical(groups)
+
+    gas = (data[:50] + 0.3 + 1e-6) % 1.0
+    labels = index.attach(gas, groups)
+    expected = np.full(len(data), -1)
+    for i, g in enumerate(groups):
+        expected[g] = i
+    assert list(labels) == list(expected[:50])
+
+
+def test_drift_across_opposite_faces():
+    # Two neighbours carried round the box in opposite directions end up stored almost two box
+    # sides apart, -0.45 and 1.49, while their minimum image is 0.06
+    rng = np.random.default_rng(35)
+    data = rng.uniform(0.0, 1.0, (12, 3))
+    data[:, 1:] = np.clip(data[:, 1:], 0.0, 0.3)
+    data[0] = [0.2, 0.5, 0.5]
+    data[1] = [0.8, 0.5, 0.5]
+    index = ygg.SpatialIndex(data, boxsize=1.0)
+
+    path = [(0.5, 0.5), (0.8, 0.2), (0.1, 0.9), (0.4, 0.6), (0.49, 0.55)]
+    for x0, x1 in path:
+        data[0, 0], data[1, 0] = x0, x1
+        index.update_positions(data, max_overlap=10.0)
+
+    b = 0.1
+    groups = canonical(index.friends_of_friends(b))
+    assert any(0 in g and 1 in g for g in groups)
+    assert groups == canonical(ygg.friends_of_friends(data, b, boxsize=1.0))
@@ -0,0 +1,160 @@
+"""
+Client of ygg-server (myfof/server.cc), which keeps Gadget-2 snapshots and
+their kd-trees in memory between calls.
+
+    with ygg_client.Client() as client:
+        snap = client.load("snap_000")
+        groups = snap.friends_of_friends(0.2 * snap.boxsize / snap.npart ** (1 / 3))
+        props = snap.halo_properties(0.2 * snap.boxsize / snap.npart ** (1 / 3))
+
+The methods mirror those of ygg, with lengths in the units of the snapshot
+and indices of the dark-matter particles in file order. Large results are
+mapped from the shared memory the server writes them to, without a copy;
+the protocol is described at the top of myfof/server.cc.
+"""
+
+import mmap
+import os
+import socket
+import struct
+
+import numpy as np
+
+__all__ = ["Client", "Snapshot", "ServerError"]
+
+DEFAULT_SOCKET = "/tmp/ygg-server.sock"
+
+_MAGIC = 0x53474759
+_VERSION = 1
+_REQUEST = struct.Struct("=IHHQ")
+_REPLY = struct.Struct("=IHBBQ")
+
+_OP_LOAD, _OP_UNLOAD, _OP_FOF, _OP_LABELS, _OP_BALL, _OP_HALO = range(1, 7)
+_STATUS = {1: "bad request", 2: "not found", 3: "server error"}
+
+
+class ServerError(RuntimeError):
+    """ A request the server could not answer. """
+
+
+class Client:
+    """ Connection to a running ygg-server.
+
+        :param socket_path: Unix socket the server listens on
+    """
+
+    def __init__(self, socket_path=DEFAULT_SOCKET):
+        self._sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self._sock.connect(socket_path)
+
+    def close(self):
+        self._sock.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def load(self, path):
+        """ Loads a snapshot into the server, or finds it if already loaded.
+
+            :param path: Snapshot file, as seen by the server
+
+            :rtype: A Snapshot
+        """
+        ids, reals = self._call(_OP_LOAD, os.fsencode(os.path.abspath(path)), [np.uint64, np.float64])
+        return Snapshot(self, int(ids[0]), int(ids[1]), float(reals[0]), float(reals[1]), path)
+
+    def _call(self, op, args, dtypes):
+        """ Sends a request and returns its arrays, with the given dtypes. """
+        self._sock.sendall(_REQUEST.pack(_MAGIC, _VERSION, op, len(args)) + args)
+        magic, status, narrays, shared, size = _REPLY.unpack(self._recv(_REPLY.size))
+        if magic != _MAGIC:
+            raise ServerError("not a ygg-server reply")
+        payload = self._recv(size)
+        if status != 0:
+            raise ServerError("{}: {}".format(_STATUS.get(status, "error"), payload.decode(errors="replace")))
+
+        counts = np.frombuffer(payload, dtype=np.uint64, count=narrays)
+        if shared:
+            # Mapped before the next request, after which the server unlinks the object
+            name = payload[8 * narrays:].decode()
+            fd = os.open("/dev/shm/" + name.lstrip("/"), os.O_RDONLY)
+            try:
+                buffer = mmap.mmap(fd, int(counts.sum()) * 8, access=mmap.ACCESS_READ)
+            finally:
+                os.close(fd)
+            offset = 0
+        else:
+            buffer, offset = payload, 8 * narrays
+
+        arrays = []
+        for count, dtype in zip(counts, dtypes):
+            arrays.append(np.frombuffer(buffer, dtype=dtype, count=int(count), offset=offset))
+            offset += 8 * int(count)
+        return arrays
+
+    def _recv(self, size):
+        chunks = bytearray()
+        while len(chunks) < size:
+            chunk = self._sock.recv(min(size - len(chunks), 1 << 20))
+            if not chunk:
+                raise ServerError("connection closed by the server")
+            chunks += chunk
+        return bytes(chunks)
+
+
+class Snapshot:
+    """ A snapshot resident in the server. """
+
+    def __init__(self, client, id, npart, boxsize, particle_mass, path):
+        self.client = client
+        self.id = id
+        self.npart = npart
+        self.boxsize = boxsize
+        self.particle_mass = particle_mass
+        self.path = path
+
+    def catalog(self, linking_length):
+        """ Friends-of-friends groups in CSR form.
+
+            :param linking_length: The linking length between cluster members
+
+            :rtype: offsets and members arrays, group g being
+                    members[offsets[g]:offsets[g+1]]
+        """
+        return tuple(self.client._call(_OP_FOF, struct.pack("=Qd", self.id, linking_length),
+                                       [np.uint64, np.uint64]))
+
+    def friends_of_friends(self, linking_length):
+        """ Friends-of-friends groups, as ygg.friends_of_friends.
+
+            :param linking_length: The linking length between cluster members
+
+            :rtype: A list of lists of indices in each cluster
+        """
+        offsets, members = self.catalog(linking_length)
+        members = members.tolist()
+        return [members[offsets[g]:offsets[g + 1]] for g in range(len(offsets) - 1)]
+
+    def labels(self, linking_length):
+        """ Group of every particle for a linking length. """
+        return self.client._call(_OP_LABELS, struct.pack("=Qd", self.id, linking_length), [np.int64])[0]
+
+    def ball_query(self, centre, radius):
+        """ Particles within radius of centre, in increasing order. """
+        x, y, z = centre
+        return self.client._call(_OP_BALL, struct.pack("=Qdddd", self.id, x, y, z, radius), [np.uint64])[0]
+
+    def halo_properties(self, linking_length):
+        """ npart, mass, com, vel, sigma_v and extent of the groups, as ygg.halo_properties. """
+        npart, mass, com, vel, sigma_v, extent = self.client._call(
+            _OP_HALO, struct.pack("=Qd", self.id, linking_length),
+            [np.uint64, np.float64, np.float64, np.float64, np.float64, np.float64])
+        return {"npart": npart, "mass": mass, "com": com.reshape(-1, 3), "vel": vel.reshape(-1, 3),
+                "sigma_v": sigma_v, "extent": extent}
+
+    def unload(self):
+        """ Releases the snapshot in the server. """
+        self.client._call(_OP_UNLOAD, struct.pack("=Q", self.id), [])